@@ -22,6 +22,7 @@ NAN_MODULE_INIT(InitAll) {
     NAN_EXPORT(target, _tile_getFromUserCache);
     NAN_EXPORT(target, init);
     NAN_EXPORT(target, add);
+    NAN_EXPORT(target, syncIndex);
     NAN_EXPORT(target, remove);
     NAN_EXPORT(target, move);
     NAN_EXPORT(target, share);
@@ -54,10 +54,10 @@ NAN_METHOD(init) {
 
 class AddWorker : public Nan::AsyncProgressWorker {
  public:
-  AddWorker(Nan::Callback *callback, Nan::Callback *progress, const std::string &ddbPath, const std::vector<std::string> &paths, bool recursive)
+  AddWorker(Nan::Callback *callback, Nan::Callback *progress, const std::string &ddbPath, const std::vector<std::string> &paths, bool recursive, int threads)
     : Nan::AsyncProgressWorker(callback, "nan:AddWorker"),
       progress(progress),
-      ddbPath(ddbPath), paths(paths), recursive(recursive),
+      ddbPath(ddbPath), paths(paths), recursive(recursive), threads(threads),
       cancel(false) {}
   ~AddWorker() {
       delete progress;
@@ -77,7 +77,7 @@ class AddWorker : public Nan::AsyncProgressWorker {
                     std::string serialized = j.dump();
                     progress.Send(serialized.c_str(), sizeof(char) * serialized.length());
                     return !cancel;
-                });
+                }, threads);
         output = outJson.dump();
       }catch(const ddb::AppException &e){
         SetErrorMessage(e.what());
@@ -119,6 +119,7 @@ class AddWorker : public Nan::AsyncProgressWorker {
     std::string ddbPath;
     std::vector<std::string> paths;
     bool recursive;
+    int threads;
 
     bool cancel;
 };
@@ -132,11 +133,97 @@ NAN_METHOD(add) {
 
     BIND_OBJECT_PARAM(obj, 2);
     BIND_OBJECT_VAR(obj, bool, recursive, false);
+    BIND_OBJECT_VAR(obj, int, threads, 0);
 
     BIND_FUNCTION_PARAM(progress, 3);
     BIND_FUNCTION_PARAM(callback, 4);
 
-    Nan::AsyncQueueWorker(new AddWorker(callback, progress, ddbPath, paths, recursive));
+    Nan::AsyncQueueWorker(new AddWorker(callback, progress, ddbPath, paths, recursive, threads));
+}
+
+
+class SyncWorker : public Nan::AsyncProgressWorker {
+ public:
+  SyncWorker(Nan::Callback *callback, Nan::Callback *progress, const std::string &ddbPath, int threads)
+    : Nan::AsyncProgressWorker(callback, "nan:SyncWorker"),
+      progress(progress),
+      ddbPath(ddbPath), threads(threads),
+      cancel(false) {}
+  ~SyncWorker() {
+      delete progress;
+  }
+
+  void Execute (const Nan::AsyncProgressWorker::ExecutionProgress& progress) {
+      try{
+        const auto db = ddb::open(ddbPath, true);
+        const auto stats = ddb::syncIndex(db.get(),
+                [&](const std::string &path, bool deleted) {
+                    json j = {{"path", path}, {"deleted", deleted}};
+
+                    std::string serialized = j.dump();
+                    progress.Send(serialized.c_str(), sizeof(char) * serialized.length());
+                    return !cancel;
+                }, threads);
+
+        json j;
+        stats.toJSON(j);
+        output = j.dump();
+      }catch(const ddb::AppException &e){
+        SetErrorMessage(e.what());
+      }
+  }
+
+  void HandleProgressCallback(const char *data, size_t count) {
+      Nan::HandleScope scope;
+      Nan::JSON json;
+
+      std::string str(data, count);
+
+      v8::Local<v8::Value> argv[] = {
+          json.Parse(Nan::New<v8::String>(str).ToLocalChecked()).ToLocalChecked()
+      };
+
+      auto ret = progress->Call(1, argv, async_resource).ToLocalChecked();
+      if (!ret->IsUndefined()){
+          cancel = !Nan::To<bool>(ret).FromJust();
+      }
+  }
+
+  void HandleOKCallback () {
+     Nan::HandleScope scope;
+
+     Nan::JSON json;
+     v8::Local<v8::Value> argv[] = {
+         Nan::Null(),
+         json.Parse(Nan::New<v8::String>(output.c_str()).ToLocalChecked()).ToLocalChecked()
+     };
+
+     callback->Call(2, argv, async_resource);
+   }
+
+ private:
+    Nan::Callback *progress;
+    std::string output;
+
+    std::string ddbPath;
+    int threads;
+
+    bool cancel;
+};
+
+
+NAN_METHOD(syncIndex) {
+    ASSERT_NUM_PARAMS(4);
+
+    BIND_STRING_PARAM(ddbPath, 0);
+
+    BIND_OBJECT_PARAM(obj, 1);
+    BIND_OBJECT_VAR(obj, int, threads, 0);
+
+    BIND_FUNCTION_PARAM(progress, 2);
+    BIND_FUNCTION_PARAM(callback, 3);
+
+    Nan::AsyncQueueWorker(new SyncWorker(callback, progress, ddbPath, threads));
 }
 
 
@@ -362,13 +449,13 @@ NAN_METHOD(build) {
 
 class SearchWorker : public Nan::AsyncWorker {
  public:
-  SearchWorker(Nan::Callback *callback, const std::string &ddbPath, const std::string &query)
+  SearchWorker(Nan::Callback *callback, const std::string &ddbPath, const std::string &query, const std::string &filterJson)
     : AsyncWorker(callback, "nan:SearchWorker"),
-      ddbPath(ddbPath), query(query) {}
+      ddbPath(ddbPath), query(query), filterJson(filterJson) {}
   ~SearchWorker() {}
 
   void Execute () {
-    if (DDBSearch(ddbPath.c_str(), query.c_str(), &output, "json") != DDBERR_NONE){
+    if (DDBSearch(ddbPath.c_str(), query.c_str(), &output, "json", filterJson.c_str()) != DDBERR_NONE){
         SetErrorMessage(DDBGetLastError());
     }
   }
@@ -389,17 +476,37 @@ class SearchWorker : public Nan::AsyncWorker {
  private:
     std::string ddbPath;
     std::string query;
+    std::string filterJson;
     char *output;
 };
 
+// search(ddbPath, query, [filter], callback)
+// filter: {bbox: [minx, miny, maxx, maxy], intersects: "WKT", near: [lon, lat], nearCount: 10,
+//          captureTime: [from, to], text: "words", where: "make = 'DJI' and cameraPitch < -80"}
 NAN_METHOD(search) {
-    ASSERT_NUM_PARAMS(3);
+    if (info.Length() != 3 && info.Length() != 4){
+        Nan::ThrowError("Invalid number of arguments");
+        return;
+    }
 
     BIND_STRING_PARAM(ddbPath, 0);
     BIND_STRING_PARAM(query, 1);
-    BIND_FUNCTION_PARAM(callback, 2);
 
-    Nan::AsyncQueueWorker(new SearchWorker(callback, ddbPath, query));
+    std::string filterJson;
+    if (info.Length() == 4){
+        BIND_OBJECT_PARAM(filter, 2);
+
+        Nan::JSON NanJSON;
+        Nan::MaybeLocal<v8::String> result = NanJSON.Stringify(filter);
+        if (!result.IsEmpty()) {
+            Nan::Utf8String str(result.ToLocalChecked().As<v8::String>());
+            filterJson = std::string(*str);
+        }
+    }
+
+    BIND_FUNCTION_PARAM(callback, info.Length() - 1);
+
+    Nan::AsyncQueueWorker(new SearchWorker(callback, ddbPath, query, filterJson));
 }
 
 
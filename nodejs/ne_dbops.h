@@ -8,6 +8,7 @@
 
 NAN_METHOD(init);
 NAN_METHOD(add);
+NAN_METHOD(syncIndex);
 NAN_METHOD(remove);
 NAN_METHOD(move);
 NAN_METHOD(list);
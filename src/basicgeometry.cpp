@@ -3,16 +3,58 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include "basicgeometry.h"
+
+#include <cstdint>
+#include <cstring>
+
 #include "exceptions.h"
 #include "utils.h"
 
+// ISO WKB geometry types, with Z
+#define WKB_POINT_Z 1001
+#define WKB_POLYGON_Z 1003
+
 namespace ddb{
 
+namespace {
+
+// Writes WKB in the machine's byte order (which WKB records in its first byte)
+void wkbHeader(std::string &wkb, uint32_t type){
+    const uint16_t one = 1;
+    uint8_t littleEndian;
+    std::memcpy(&littleEndian, &one, 1);
+
+    wkb.push_back(static_cast<char>(littleEndian));
+    wkb.append(reinterpret_cast<const char *>(&type), sizeof(type));
+}
+
+void wkbCount(std::string &wkb, size_t count){
+    const auto n = static_cast<uint32_t>(count);
+    wkb.append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+void wkbPoint(std::string &wkb, const Point &p){
+    const double coords[3] = {p.x, p.y, p.z};
+    wkb.append(reinterpret_cast<const char *>(coords), sizeof(coords));
+}
+
+}
+
 std::string BasicPointGeometry::toWkt() const{
     if (empty()) return "";
     return utils::stringFormat("POINT Z (%lf %lf %lf)", points[0].x, points[0].y, points[0].z);
 }
 
+std::string BasicPointGeometry::toWkb() const{
+    if (empty()) return "";
+
+    std::string wkb;
+    wkb.reserve(5 + 3 * sizeof(double));
+    wkbHeader(wkb, WKB_POINT_Z);
+    wkbPoint(wkb, points[0]);
+    return wkb;
+}
+
 json BasicPointGeometry::toGeoJSON() const{
     json j;
     initGeoJsonBase(j);
@@ -42,6 +84,19 @@ std::string BasicPolygonGeometry::toWkt() const{
     return os.str();
 }
 
+std::string BasicPolygonGeometry::toWkb() const{
+    if (empty()) return "";
+
+    // Single ring
+    std::string wkb;
+    wkb.reserve(13 + points.size() * 3 * sizeof(double));
+    wkbHeader(wkb, WKB_POLYGON_Z);
+    wkbCount(wkb, 1);
+    wkbCount(wkb, points.size());
+    for (auto &p : points) wkbPoint(wkb, p);
+    return wkb;
+}
+
 json BasicPolygonGeometry::toGeoJSON() const{
     json j;
     initGeoJsonBase(j);
@@ -36,6 +36,9 @@ struct BasicGeometry{
     DDB_DLL int size() const;
 
     DDB_DLL virtual std::string toWkt() const = 0;
+
+    // Well-known binary (ISO, with Z), empty if the geometry is empty
+    DDB_DLL virtual std::string toWkb() const = 0;
     DDB_DLL virtual json toGeoJSON() const = 0;
 
     std::vector<Point> points;
@@ -54,11 +57,13 @@ inline std::ostream& operator<<(std::ostream& os, const BasicGeometry& g)
 
 struct BasicPointGeometry : BasicGeometry{
     DDB_DLL virtual std::string toWkt() const override;
+    DDB_DLL virtual std::string toWkb() const override;
     DDB_DLL virtual json toGeoJSON() const override;
 };
 
 struct BasicPolygonGeometry : BasicGeometry{
     DDB_DLL virtual std::string toWkt() const override;
+    DDB_DLL virtual std::string toWkb() const override;
     DDB_DLL virtual json toGeoJSON() const override;
 };
 
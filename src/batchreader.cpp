@@ -0,0 +1,352 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "batchreader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+
+#include "exceptions.h"
+#include "logger.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define DDB_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace ddb {
+
+#ifdef DDB_IO_URING
+
+// Minimal io_uring wrapper using the raw syscalls
+// (avoids a dependency on liburing)
+struct BatchFileReader::Ring {
+    int fd = -1;
+
+    void *sqPtr = MAP_FAILED;
+    size_t sqSize = 0;
+    void *cqPtr = MAP_FAILED;
+    size_t cqSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe *cqes;
+    unsigned sqEntries = 0;
+    unsigned toSubmit = 0;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqPtr != MAP_FAILED && cqPtr != sqPtr) munmap(cqPtr, cqSize);
+        if (sqPtr != MAP_FAILED) munmap(sqPtr, sqSize);
+        if (fd != -1) close(fd);
+    }
+
+    // @return nullptr if io_uring (or one of the operations we need)
+    // is not supported or not allowed
+    static std::unique_ptr<Ring> create(unsigned entries) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+
+        std::unique_ptr<Ring> r(new Ring());
+        r->fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (r->fd < 0) {
+            LOGD << "io_uring is not available (" << std::strerror(errno) << ")";
+            r->fd = -1;
+            return nullptr;
+        }
+
+        r->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        r->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) r->sqSize = r->cqSize = std::max(r->sqSize, r->cqSize);
+
+        r->sqPtr = mmap(nullptr, r->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+        if (r->sqPtr == MAP_FAILED) return nullptr;
+
+        r->cqPtr = singleMmap ? r->sqPtr : mmap(nullptr, r->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cqPtr == MAP_FAILED) return nullptr;
+
+        r->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        r->sqes = static_cast<io_uring_sqe *>(mmap(nullptr, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES));
+        if (r->sqes == MAP_FAILED) return nullptr;
+
+        char *sq = static_cast<char *>(r->sqPtr);
+        r->sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        r->sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        r->sqMask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        r->sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        r->sqEntries = p.sq_entries;
+
+        char *cq = static_cast<char *>(r->cqPtr);
+        r->cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        r->cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        r->cqMask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        r->cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+
+        // Opening, reading and closing through the ring need Linux 5.6+
+        const size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<char> probeBuf(probeSize, 0);
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(probeBuf.data());
+        if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            LOGD << "Cannot probe io_uring operations (" << std::strerror(errno) << ")";
+            return nullptr;
+        }
+        for (int op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                LOGD << "io_uring operation " << op << " is not supported";
+                return nullptr;
+            }
+        }
+
+        return r;
+    }
+
+    io_uring_sqe *getSqe() {
+        const unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        const unsigned tail = *sqTail;
+        if (tail - head >= sqEntries) return nullptr;
+
+        const unsigned idx = tail & *sqMask;
+        io_uring_sqe *sqe = &sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[idx] = idx;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        toSubmit++;
+        return sqe;
+    }
+
+    // Submits queued entries and waits for at least waitNr completions
+    void submit(unsigned waitNr) {
+        for (;;) {
+            const long ret = syscall(__NR_io_uring_enter, fd, toSubmit, waitNr,
+                                     waitNr > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                throw AppException(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            }
+            toSubmit -= static_cast<unsigned>(ret);
+            return;
+        }
+    }
+};
+
+#else
+
+struct BatchFileReader::Ring {};
+
+#endif
+
+BatchFileReader::BatchFileReader(unsigned depth, size_t maxFileSize, bool useIoUring)
+    : depth(std::max(depth, 1u)), maxFileSize(maxFileSize) {
+#ifdef DDB_IO_URING
+    if (useIoUring) ring = Ring::create(this->depth);
+#else
+    (void)useIoUring;
+#endif
+
+    // One slot per file in flight, with an extra byte
+    // to find out if a file is larger than maxFileSize
+    buffers.reset(new char[(ring ? this->depth : 1) * (maxFileSize + 1)]);
+}
+
+BatchFileReader::~BatchFileReader() {}
+
+bool BatchFileReader::usingIoUring() const { return ring != nullptr; }
+
+std::vector<bool> BatchFileReader::read(const std::vector<std::string> &paths, const FileDataCallback &onFile) {
+    if (ring) return readIoUring(paths, onFile);
+    return readBlocking(paths, onFile);
+}
+
+std::vector<bool> BatchFileReader::readBlocking(const std::vector<std::string> &paths, const FileDataCallback &onFile) {
+    std::vector<bool> done(paths.size(), false);
+    const size_t capacity = maxFileSize + 1;
+    char *buf = buffers.get();
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        size_t len = 0;
+        bool ok = true;
+
+#ifndef WIN32
+        const int fd = open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) continue;
+
+        while (len < capacity) {
+            const ssize_t n = ::read(fd, buf + len, capacity - len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ok = false;  // e.g. EISDIR
+                break;
+            }
+            if (n == 0) break;
+            len += static_cast<size_t>(n);
+        }
+        close(fd);
+#else
+        std::ifstream f(paths[i], std::ios::binary);
+        if (!f.is_open()) continue;
+        f.read(buf, static_cast<std::streamsize>(capacity));
+        len = static_cast<size_t>(f.gcount());
+        ok = !f.bad();
+#endif
+
+        if (!ok || len == capacity) continue;
+
+        onFile(i, buf, len);
+        done[i] = true;
+    }
+
+    return done;
+}
+
+std::vector<bool> BatchFileReader::readIoUring(const std::vector<std::string> &paths, const FileDataCallback &onFile) {
+    std::vector<bool> done(paths.size(), false);
+
+#ifdef DDB_IO_URING
+    enum SlotState { Free, Opening, Reading, Closing };
+    struct Slot {
+        SlotState state = Free;
+        size_t index = 0;
+        int fd = -1;
+        size_t len = 0;
+    };
+
+    const size_t capacity = maxFileSize + 1;
+    std::vector<Slot> slots(depth);
+    size_t next = 0;
+    unsigned inFlight = 0;
+
+    // If the callback throws, we stop queuing new files but
+    // still need to let in-flight operations finish (and close their files)
+    std::exception_ptr error;
+
+    auto sqe = [this]() {
+        io_uring_sqe *s = ring->getSqe();
+        while (s == nullptr) {
+            ring->submit(0);
+            s = ring->getSqe();
+        }
+        return s;
+    };
+
+    auto queueRead = [&](unsigned slot) {
+        Slot &s = slots[slot];
+        io_uring_sqe *e = sqe();
+        e->opcode = IORING_OP_READ;
+        e->fd = s.fd;
+        e->addr = reinterpret_cast<uint64_t>(buffers.get() + slot * capacity + s.len);
+        e->len = static_cast<uint32_t>(capacity - s.len);
+        e->off = s.len;
+        e->user_data = slot;
+        s.state = Reading;
+    };
+
+    auto queueClose = [&](unsigned slot) {
+        Slot &s = slots[slot];
+        io_uring_sqe *e = sqe();
+        e->opcode = IORING_OP_CLOSE;
+        e->fd = s.fd;
+        e->user_data = slot;
+        s.state = Closing;
+    };
+
+    for (;;) {
+        for (unsigned slot = 0; slot < depth && next < paths.size() && !error; slot++) {
+            if (slots[slot].state != Free) continue;
+
+            Slot &s = slots[slot];
+            s.index = next++;
+            s.fd = -1;
+            s.len = 0;
+
+            io_uring_sqe *e = sqe();
+            e->opcode = IORING_OP_OPENAT;
+            e->fd = AT_FDCWD;
+            e->addr = reinterpret_cast<uint64_t>(paths[s.index].c_str());
+            e->open_flags = O_RDONLY | O_CLOEXEC;
+            e->user_data = slot;
+            s.state = Opening;
+            inFlight++;
+        }
+
+        if (inFlight == 0) break;
+
+        ring->submit(1);
+
+        unsigned head = *ring->cqHead;
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe &cqe = ring->cqes[head & *ring->cqMask];
+            const unsigned slot = static_cast<unsigned>(cqe.user_data);
+            const int res = cqe.res;
+            head++;
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+            Slot &s = slots[slot];
+            switch (s.state) {
+                case Opening:
+                    if (res < 0) {
+                        s.state = Free;
+                        inFlight--;
+                    } else {
+                        s.fd = res;
+                        if (error) queueClose(slot);
+                        else queueRead(slot);
+                    }
+                    break;
+
+                case Reading:
+                    if (res == -EINTR || res == -EAGAIN) {
+                        queueRead(slot);
+                    } else if (res > 0 && s.len + static_cast<size_t>(res) < capacity && !error) {
+                        // Short read, keep going until EOF
+                        s.len += static_cast<size_t>(res);
+                        queueRead(slot);
+                    } else {
+                        if (res == 0 && !error) {
+                            try {
+                                onFile(s.index, buffers.get() + slot * capacity, s.len);
+                                done[s.index] = true;
+                            } catch (...) {
+                                error = std::current_exception();
+                            }
+                        }
+
+                        // Errors (e.g. EISDIR) or files that are too large
+                        queueClose(slot);
+                    }
+                    break;
+
+                case Closing:
+                    s.state = Free;
+                    inFlight--;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    if (error) std::rethrow_exception(error);
+#else
+    (void)onFile;
+#endif
+
+    return done;
+}
+
+}  // namespace ddb
@@ -0,0 +1,60 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef BATCHREADER_H
+#define BATCHREADER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ddb_export.h"
+
+// Files larger than this are left to the regular (streaming) readers
+#define BATCH_READ_MAX_FILE_SIZE (256 * 1024)
+
+// Number of files in flight at the same time
+#define BATCH_READ_DEPTH 32
+
+namespace ddb {
+
+typedef std::function<void(size_t index, const char *data, size_t size)> FileDataCallback;
+
+// Reads many small files in one go. On Linux the opens, reads and closes
+// are queued on an io_uring so that many of them are in flight at the same
+// time, instead of issuing three blocking syscalls per file. When io_uring
+// is not available files are read one at a time.
+class BatchFileReader {
+   public:
+    DDB_DLL explicit BatchFileReader(unsigned depth = BATCH_READ_DEPTH,
+                                     size_t maxFileSize = BATCH_READ_MAX_FILE_SIZE,
+                                     bool useIoUring = true);
+    DDB_DLL ~BatchFileReader();
+
+    BatchFileReader(const BatchFileReader &) = delete;
+    BatchFileReader &operator=(const BatchFileReader &) = delete;
+
+    // Reads paths, calling onFile (in completion order, on the calling thread)
+    // with the contents of every file that could be read entirely.
+    // Directories, files larger than maxFileSize and files that cannot be
+    // opened are skipped, so that callers can handle them the usual way.
+    // @return for each path, whether onFile was called for it
+    DDB_DLL std::vector<bool> read(const std::vector<std::string> &paths, const FileDataCallback &onFile);
+
+    DDB_DLL bool usingIoUring() const;
+
+   private:
+    struct Ring;
+
+    std::vector<bool> readBlocking(const std::vector<std::string> &paths, const FileDataCallback &onFile);
+    std::vector<bool> readIoUring(const std::vector<std::string> &paths, const FileDataCallback &onFile);
+
+    unsigned depth;
+    size_t maxFileSize;
+    std::unique_ptr<char[]> buffers;
+    std::unique_ptr<Ring> ring;
+};
+
+}  // namespace ddb
+
+#endif  // BATCHREADER_H
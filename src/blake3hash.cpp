@@ -0,0 +1,310 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "blake3hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "workqueue.h"
+
+namespace ddb {
+
+namespace {
+
+const uint32_t IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                        0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+const uint8_t MSG_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+enum Flags : uint32_t { CHUNK_START = 1, CHUNK_END = 2, PARENT = 4, ROOT = 8 };
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t loadLE32(const uint8_t *p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+inline void g(uint32_t s[16], int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+inline void blake3Round(uint32_t s[16], const uint32_t m[16]) {
+    g(s, 0, 4, 8, 12, m[0], m[1]);
+    g(s, 1, 5, 9, 13, m[2], m[3]);
+    g(s, 2, 6, 10, 14, m[4], m[5]);
+    g(s, 3, 7, 11, 15, m[6], m[7]);
+    g(s, 0, 5, 10, 15, m[8], m[9]);
+    g(s, 1, 6, 11, 12, m[10], m[11]);
+    g(s, 2, 7, 8, 13, m[12], m[13]);
+    g(s, 3, 4, 9, 14, m[14], m[15]);
+}
+
+void compress(const uint32_t cv[8], const uint32_t blockWords[16], uint64_t counter,
+              uint32_t blockLen, uint32_t flags, uint32_t out[16]) {
+    uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                      IV[0], IV[1], IV[2], IV[3],
+                      static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+                      blockLen, flags};
+    uint32_t m[16];
+    std::memcpy(m, blockWords, sizeof(m));
+
+    for (int r = 0; r < 7; r++) {
+        blake3Round(s, m);
+        if (r < 6) {
+            uint32_t p[16];
+            for (int i = 0; i < 16; i++) p[i] = m[MSG_PERMUTATION[i]];
+            std::memcpy(m, p, sizeof(m));
+        }
+    }
+
+    for (int i = 0; i < 8; i++) {
+        s[i] ^= s[i + 8];
+        s[i + 8] ^= cv[i];
+    }
+    std::memcpy(out, s, sizeof(s));
+}
+
+inline void wordsFromBlock(const uint8_t block[64], uint32_t words[16]) {
+    for (int i = 0; i < 16; i++) words[i] = loadLE32(block + 4 * i);
+}
+
+Blake3Hash::ChainingValue parentChainingValue(const Blake3Hash::ChainingValue &left,
+                                              const Blake3Hash::ChainingValue &right) {
+    uint32_t block[16];
+    std::memcpy(block, left.words, 32);
+    std::memcpy(block + 8, right.words, 32);
+
+    uint32_t out[16];
+    compress(IV, block, 0, 64, PARENT, out);
+
+    Blake3Hash::ChainingValue cv;
+    std::memcpy(cv.words, out, 32);
+    return cv;
+}
+
+// Chaining value of a complete, non-root subtree of numChunks chunks
+// (numChunks must be a power of two)
+Blake3Hash::ChainingValue subtreeChainingValue(const uint8_t *data, size_t numChunks, uint64_t chunkCounter) {
+    if (numChunks == 1) {
+        Blake3Hash::ChunkState cs;
+        cs.reset(chunkCounter);
+        cs.update(data, Blake3Hash::ChunkSize);
+        return cs.output().chainingValue();
+    }
+
+    const size_t half = numChunks / 2;
+    const auto left = subtreeChainingValue(data, half, chunkCounter);
+    const auto right = subtreeChainingValue(data + half * Blake3Hash::ChunkSize, half, chunkCounter + half);
+    return parentChainingValue(left, right);
+}
+
+}  // namespace
+
+Blake3Hash::ChainingValue Blake3Hash::Output::chainingValue() const {
+    uint32_t out[16];
+    compress(inputCv, blockWords, counter, blockLen, flags, out);
+
+    ChainingValue cv;
+    std::memcpy(cv.words, out, 32);
+    return cv;
+}
+
+void Blake3Hash::Output::rootBytes(uint8_t out[HashBytes]) const {
+    uint32_t words[16];
+    compress(inputCv, blockWords, 0, blockLen, flags | ROOT, words);
+
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = static_cast<uint8_t>(words[i]);
+        out[4 * i + 1] = static_cast<uint8_t>(words[i] >> 8);
+        out[4 * i + 2] = static_cast<uint8_t>(words[i] >> 16);
+        out[4 * i + 3] = static_cast<uint8_t>(words[i] >> 24);
+    }
+}
+
+void Blake3Hash::ChunkState::reset(uint64_t counter) {
+    std::memcpy(cv, IV, sizeof(cv));
+    chunkCounter = counter;
+    std::memset(block, 0, sizeof(block));
+    blockLen = 0;
+    blocksCompressed = 0;
+}
+
+size_t Blake3Hash::ChunkState::len() const {
+    return 64 * static_cast<size_t>(blocksCompressed) + blockLen;
+}
+
+void Blake3Hash::ChunkState::update(const uint8_t *input, size_t len) {
+    while (len > 0) {
+        if (blockLen == 64) {
+            uint32_t words[16];
+            wordsFromBlock(block, words);
+
+            uint32_t out[16];
+            compress(cv, words, chunkCounter, 64, blocksCompressed == 0 ? static_cast<uint32_t>(CHUNK_START) : 0u, out);
+            std::memcpy(cv, out, sizeof(cv));
+
+            blocksCompressed++;
+            std::memset(block, 0, sizeof(block));
+            blockLen = 0;
+        }
+
+        const size_t take = std::min(static_cast<size_t>(64 - blockLen), len);
+        std::memcpy(block + blockLen, input, take);
+        blockLen += static_cast<uint8_t>(take);
+        input += take;
+        len -= take;
+    }
+}
+
+Blake3Hash::Output Blake3Hash::ChunkState::output() const {
+    Output o;
+    std::memcpy(o.inputCv, cv, sizeof(cv));
+    wordsFromBlock(block, o.blockWords);
+    o.counter = chunkCounter;
+    o.blockLen = blockLen;
+    o.flags = (blocksCompressed == 0 ? static_cast<uint32_t>(CHUNK_START) : 0u) | CHUNK_END;
+    return o;
+}
+
+Blake3Hash::Blake3Hash(int threads, size_t segmentChunks)
+    : segmentChunks(segmentChunks), segmentsDispatched(0), segmentsMerged(0), finalized(false) {
+    chunkState.reset(0);
+
+    // Inside a parallel job, only the cores that no other job keeps
+    // busy are used (the calling job is counted among the busy ones)
+    if (threads == 0 && isWorkerThread()) {
+        const int cores = static_cast<int>(std::thread::hardware_concurrency());
+        threads = std::max(1, cores - busyWorkerThreads() + 1);
+    }
+
+    // A single thread gains nothing from segmenting
+    // and would pay for an extra copy of the input
+    if (threads != 1 && segmentChunks > 0) {
+        queue = std::make_unique<OrderedWorkQueue<ChainingValue>>(threads);
+        if (queue->concurrency() <= 1) queue.reset();
+        else segment.reserve(segmentChunks * ChunkSize);
+    }
+}
+
+Blake3Hash::~Blake3Hash() {}
+
+size_t Blake3Hash::concurrency() const { return queue ? queue->concurrency() : 1; }
+
+void Blake3Hash::addChunkChainingValue(ChainingValue cv, uint64_t totalChunks) {
+    // Merge completed subtrees, one for each trailing zero bit
+    while ((totalChunks & 1) == 0) {
+        cv = parentChainingValue(cvStack.back(), cv);
+        cvStack.pop_back();
+        totalChunks >>= 1;
+    }
+    cvStack.push_back(cv);
+}
+
+void Blake3Hash::updateChunks(const uint8_t *input, size_t len) {
+    while (len > 0) {
+        // Only finish a chunk once we know more input follows,
+        // the last chunk might be the root
+        if (chunkState.len() == ChunkSize) {
+            const ChainingValue cv = chunkState.output().chainingValue();
+            const uint64_t totalChunks = chunkState.chunkCounter + 1;
+            addChunkChainingValue(cv, totalChunks);
+            chunkState.reset(totalChunks);
+        }
+
+        const size_t take = std::min(ChunkSize - chunkState.len(), len);
+        chunkState.update(input, take);
+        input += take;
+        len -= take;
+    }
+}
+
+void Blake3Hash::dispatchSegment() {
+    auto data = std::make_shared<std::vector<uint8_t>>(std::move(segment));
+    const uint64_t chunkCounter = segmentsDispatched * segmentChunks;
+    const size_t numChunks = segmentChunks;
+
+    queue->push([data, numChunks, chunkCounter]() {
+        return subtreeChainingValue(data->data(), numChunks, chunkCounter);
+    });
+    segmentsDispatched++;
+
+    segment = std::vector<uint8_t>();
+    segment.reserve(segmentChunks * ChunkSize);
+
+    // Bound the memory held by in-flight segments
+    drain(queue->concurrency() + 1);
+}
+
+void Blake3Hash::drain(size_t maxPending) {
+    while (queue->pending() > maxPending) {
+        // Segments are complete subtrees of the same size, so they
+        // merge on the stack exactly like chunks do
+        addChunkChainingValue(queue->pop(), ++segmentsMerged);
+    }
+}
+
+void Blake3Hash::add(const void *data, size_t numBytes) {
+    const uint8_t *input = static_cast<const uint8_t *>(data);
+
+    if (!queue) {
+        updateChunks(input, numBytes);
+        return;
+    }
+
+    const size_t segmentBytes = segmentChunks * ChunkSize;
+    while (numBytes > 0) {
+        if (segment.size() == segmentBytes) dispatchSegment();
+
+        const size_t take = std::min(segmentBytes - segment.size(), numBytes);
+        segment.insert(segment.end(), input, input + take);
+        input += take;
+        numBytes -= take;
+    }
+}
+
+std::string Blake3Hash::getHash() {
+    if (!finalized) {
+        if (queue) {
+            drain(0);
+            chunkState.reset(segmentsDispatched * segmentChunks);
+            updateChunks(segment.data(), segment.size());
+            segment = std::vector<uint8_t>();
+        }
+        finalized = true;
+    }
+
+    Output o = chunkState.output();
+    for (size_t i = cvStack.size(); i > 0; i--) {
+        const ChainingValue right = o.chainingValue();
+        std::memcpy(o.inputCv, IV, sizeof(IV));
+        std::memcpy(o.blockWords, cvStack[i - 1].words, 32);
+        std::memcpy(o.blockWords + 8, right.words, 32);
+        o.counter = 0;
+        o.blockLen = 64;
+        o.flags = PARENT;
+    }
+
+    uint8_t bytes[HashBytes];
+    o.rootBytes(bytes);
+
+    static const char dec2hex[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(2 * HashBytes);
+    for (int i = 0; i < HashBytes; i++) {
+        result += dec2hex[(bytes[i] >> 4) & 15];
+        result += dec2hex[bytes[i] & 15];
+    }
+    return result;
+}
+
+}  // namespace ddb
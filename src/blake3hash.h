@@ -0,0 +1,95 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef BLAKE3HASH_H
+#define BLAKE3HASH_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ddb_export.h"
+
+namespace ddb {
+
+template <typename T>
+class OrderedWorkQueue;
+
+// Streaming BLAKE3 (256 bit output, unkeyed mode).
+// BLAKE3 is a tree hash: input is split into segments that are complete
+// subtrees, which are hashed on a pool of worker threads while the caller
+// keeps adding data, so a single large file can be hashed on multiple cores.
+class Blake3Hash {
+   public:
+    enum { ChunkSize = 1024, HashBytes = 32 };
+
+    // @param threads number of worker threads (0 = one per CPU, or one per idle CPU
+    //        when called from an OrderedWorkQueue job, 1 = no workers)
+    // @param segmentChunks number of chunks per segment, must be a power of two
+    DDB_DLL explicit Blake3Hash(int threads = 1, size_t segmentChunks = 8192);
+    DDB_DLL ~Blake3Hash();
+
+    Blake3Hash(const Blake3Hash &) = delete;
+    Blake3Hash &operator=(const Blake3Hash &) = delete;
+
+    DDB_DLL void add(const void *data, size_t numBytes);
+
+    // Finalizes the hash. No more data can be added afterwards.
+    // @return the hash as 64 hex characters
+    DDB_DLL std::string getHash();
+
+    // Number of threads that hash segments (1 when the caller hashes all the input)
+    DDB_DLL size_t concurrency() const;
+
+    struct ChainingValue {
+        uint32_t words[8];
+    };
+
+    struct Output {
+        uint32_t inputCv[8];
+        uint32_t blockWords[16];
+        uint64_t counter;
+        uint32_t blockLen;
+        uint32_t flags;
+
+        ChainingValue chainingValue() const;
+        void rootBytes(uint8_t out[HashBytes]) const;
+    };
+
+    struct ChunkState {
+        uint32_t cv[8];
+        uint64_t chunkCounter;
+        uint8_t block[64];
+        uint8_t blockLen;
+        uint8_t blocksCompressed;
+
+        void reset(uint64_t counter);
+        size_t len() const;
+        void update(const uint8_t *input, size_t len);
+        Output output() const;
+    };
+
+   private:
+    void addChunkChainingValue(ChainingValue cv, uint64_t totalChunks);
+    void updateChunks(const uint8_t *input, size_t len);
+    void dispatchSegment();
+    void drain(size_t maxPending);
+
+    ChunkState chunkState;
+    std::vector<ChainingValue> cvStack;
+
+    // Segment being filled. It's handed to the workers only once
+    // more data arrives, since the last segment must go through
+    // the regular (lazy) chunk path to get the root flag right.
+    size_t segmentChunks;
+    std::vector<uint8_t> segment;
+    uint64_t segmentsDispatched;
+    uint64_t segmentsMerged;
+
+    std::unique_ptr<OrderedWorkQueue<ChainingValue>> queue;
+    bool finalized;
+};
+
+}  // namespace ddb
+
+#endif  // BLAKE3HASH_H
@@ -32,6 +32,7 @@
 #include "nxs.h"
 #include "search.h"
 #include "stac.h"
+#include "watch.h"
 
 namespace cmd {
 
@@ -64,7 +65,8 @@ namespace cmd {
       {"cog", new Cog()},
       {"nxs", new Nxs()},
       {"search", new Search()},
-      {"stac", new Stac()}
+      {"stac", new Stac()},
+      {"watch", new Watch()}
   };
 
   std::map<std::string, std::string> aliases = {
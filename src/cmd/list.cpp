@@ -14,6 +14,7 @@
 
 #include "exceptions.h"
 #include "basicgeometry.h"
+#include "utils.h"
 
 namespace cmd {
 
@@ -28,7 +29,9 @@ namespace cmd {
 			("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
 			("r,recursive", "Recursively search in subdirectories", cxxopts::value<bool>())
 			("d,depth", "Max recursion depth", cxxopts::value<int>()->default_value("0"))
-			("f,format", "Output format (text|json)", cxxopts::value<std::string>()->default_value("text"));
+			("f,format", "Output format (text|json)", cxxopts::value<std::string>()->default_value("text"))
+			("t,time", "Only entries captured in an interval (from,to as ISO 8601 UTC dates or milliseconds since the Unix epoch). Folders are always listed", cxxopts::value<std::string>())
+			("where", "Only entries matching a filter expression (e.g. 'make = \"DJI\" and cameraPitch < -80'). Folders are always listed", cxxopts::value<std::string>());
         // clang-format on
 		opts.parse_positional({ "input" });
 	}
@@ -50,6 +53,13 @@ namespace cmd {
 			// Take into consideration maxRecursionDepth only if the recursive flag is set and the option exists
 			const auto maxRecursionDepth = recursive ? ( depthOpt.count() > 0 ? depthOpt.as<int>() : 0) : 0;
 			
+			ddb::SearchFilter filter;
+			if (opts.count("time")) {
+				for (const auto &t : ddb::utils::split(opts["time"].as<std::string>(), ","))
+					filter.captureTime.push_back(ddb::SearchFilter::parseTime(t));
+			}
+			if (opts.count("where")) filter.where = opts["where"].as<std::string>();
+
 			const auto db = ddb::open(std::string(ddbPath), true);
 
 			if (opts.count("output")) {
@@ -57,12 +67,12 @@ namespace cmd {
 				std::ofstream file(filename, std::ios::out | std::ios::trunc | std::ios::binary);
 				if (!file.is_open()) throw ddb::FSException("Cannot open " + filename);
 
-				listIndex(db.get(), paths, file, format, recursive, maxRecursionDepth);
+				listIndex(db.get(), paths, file, format, recursive, maxRecursionDepth, filter);
 
 				file.close();
 			}
 			else {
-				listIndex(db.get(), paths, std::cout, format, recursive, maxRecursionDepth);
+				listIndex(db.get(), paths, std::cout, format, recursive, maxRecursionDepth, filter);
 			}
 
 		}
@@ -13,9 +13,23 @@
 #include "dbops.h"
 
 #include "exceptions.h"
+#include "utils.h"
 
 namespace cmd {
 
+    // "1.5,2,3" --> {1.5, 2, 3}
+    static std::vector<double> parseCoordinates(const std::string &s) {
+        std::vector<double> res;
+        for (const auto &v : ddb::utils::split(s, ",")) {
+            try {
+                res.push_back(std::stod(v));
+            } catch (const std::exception &) {
+                throw ddb::InvalidArgsException("Invalid coordinate: " + v);
+            }
+        }
+        return res;
+    }
+
     void Search::setOptions(cxxopts::Options& opts) {
         // clang-format off
 		opts
@@ -24,7 +38,14 @@ namespace cmd {
             .add_options()
             ("q,query", "Search query", cxxopts::value<std::string>())
 			("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
-			("f,format", "Output format (text|json)", cxxopts::value<std::string>()->default_value("text"));
+			("f,format", "Output format (text|json)", cxxopts::value<std::string>()->default_value("text"))
+			("bbox", "Only entries that intersect a box (minx,miny,maxx,maxy in WGS84)", cxxopts::value<std::string>())
+			("intersects", "Only entries that intersect a WKT geometry (WGS84)", cxxopts::value<std::string>())
+			("near", "Entries closest to a position (lon,lat in WGS84), sorted by distance", cxxopts::value<std::string>())
+			("k,near-count", "Number of entries returned by --near", cxxopts::value<int>()->default_value(std::to_string(SEARCH_NEAR_COUNT)))
+			("t,time", "Only entries captured in an interval (from,to as ISO 8601 UTC dates or milliseconds since the Unix epoch)", cxxopts::value<std::string>())
+			("text", "Only entries whose path or tags, annotations, description or name metadata contain all these words (case insensitive)", cxxopts::value<std::string>())
+			("where", "Only entries matching a filter expression over their fields and properties (e.g. 'make = \"DJI\" and relativeAltitude > 100 and cameraYaw between -20 and 20')", cxxopts::value<std::string>());
         // clang-format on
         opts.parse_positional({ "query" });
 	}
@@ -38,12 +59,24 @@ namespace cmd {
 		try {
 
 			const auto ddbPath = opts["working-dir"].as<std::string>();
-            const auto query = opts.count("query") > 0 ? opts["query"].as<std::string>() : "%";
+            const auto query = opts.count("query") > 0 ? opts["query"].as<std::string>() : "*";
 			const auto format = opts["format"].as<std::string>();
-			
+
+            ddb::SearchFilter filter;
+            if (opts.count("bbox")) filter.bbox = parseCoordinates(opts["bbox"].as<std::string>());
+            if (opts.count("intersects")) filter.intersects = opts["intersects"].as<std::string>();
+            if (opts.count("near")) filter.near = parseCoordinates(opts["near"].as<std::string>());
+            filter.nearCount = opts["near-count"].as<int>();
+            if (opts.count("time")) {
+                for (const auto &t : ddb::utils::split(opts["time"].as<std::string>(), ","))
+                    filter.captureTime.push_back(ddb::SearchFilter::parseTime(t));
+            }
+            if (opts.count("text")) filter.text = opts["text"].as<std::string>();
+            if (opts.count("where")) filter.where = opts["where"].as<std::string>();
+
 			const auto db = ddb::open(std::string(ddbPath), true);
 
-            searchIndex(db.get(), query, std::cout, format);
+            searchIndex(db.get(), query, std::cout, format, filter);
 		}
 		catch (ddb::InvalidArgsException) {
 			printHelp();
@@ -5,6 +5,7 @@
 #include <iostream>
 #include "sync.h"
 #include "dbops.h"
+#include "mio.h"
 
 namespace cmd {
 
@@ -14,7 +15,9 @@ void Sync::setOptions(cxxopts::Options &opts) {
     .positional_help("[args]")
     .custom_help("sync")
     .add_options()
-    ("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."));
+    ("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
+    ("t,threads", "Number of threads used to check and parse files (0 = one per CPU)", cxxopts::value<int>()->default_value("0"))
+    ("s,stats", "Print the number of files checked and the throughput", cxxopts::value<bool>());
     // clang-format on
 }
 
@@ -27,8 +30,21 @@ void Sync::run(cxxopts::ParseResult &opts) {
 
     fs::current_path(workingDir);
 
+    const auto threads = opts["threads"].as<int>();
+    const auto printStats = opts.count("stats") > 0;
+
     const auto db = ddb::open(workingDir, true);
-    syncIndex(db.get());
+    const auto stats = syncIndex(db.get(), [](const std::string &path, bool deleted) {
+        std::cout << (deleted ? "D\t" : "U\t") << path << std::endl;
+        return true;
+    }, threads);
+
+    if (printStats) {
+        std::cout << "Checked " << stats.files << " files in " << stats.seconds << "s ("
+                  << static_cast<long long>(stats.filesPerSecond()) << " files/s, "
+                  << ddb::io::bytesToHuman(static_cast<std::uintmax_t>(stats.bytesHashedPerSecond())) << "/s hashed)"
+                  << std::endl;
+    }
 }
 
 }
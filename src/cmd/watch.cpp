@@ -0,0 +1,52 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <iostream>
+#include "watch.h"
+#include "dbops.h"
+#include "watcher.h"
+
+namespace cmd {
+
+void Watch::setOptions(cxxopts::Options &opts) {
+    // clang-format off
+    opts
+    .positional_help("[args]")
+    .custom_help("watch")
+    .add_options()
+    ("w,working-dir", "Working directory", cxxopts::value<std::string>()->default_value("."))
+    ("q,quiet-time", "Milliseconds without changes after which a file is indexed", cxxopts::value<int>()->default_value(std::to_string(WATCH_QUIET_MILLIS)))
+    ("t,threads", "Number of threads used to hash and parse files (0 = one per CPU)", cxxopts::value<int>()->default_value("0"));
+    // clang-format on
+}
+
+std::string Watch::description() {
+    return "Keep the index up to date as files and directories change (Linux only)";
+}
+
+void Watch::run(cxxopts::ParseResult &opts) {
+    const auto workingDir = opts["working-dir"].as<std::string>();
+    const auto quietTime = opts["quiet-time"].as<int>();
+    const auto threads = opts["threads"].as<int>();
+
+    const auto db = ddb::open(workingDir, true);
+    ddb::DatasetWatcher watcher(db.get(), quietTime, threads);
+    watcher.run([](const std::string &path, ddb::WatchAction action) {
+        switch (action) {
+            case ddb::WatchAdded:
+                std::cout << "A\t";
+                break;
+            case ddb::WatchUpdated:
+                std::cout << "U\t";
+                break;
+            case ddb::WatchDeleted:
+                std::cout << "D\t";
+                break;
+        }
+        std::cout << path << std::endl;
+        return true;
+    });
+}
+
+}
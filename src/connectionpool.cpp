@@ -0,0 +1,99 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "connectionpool.h"
+
+#include "dbops.h"
+#include "exceptions.h"
+#include "logger.h"
+
+namespace ddb {
+
+ConnectionPool &ConnectionPool::instance() {
+    // Never destroyed, so that connections can be released at any time
+    static ConnectionPool *pool = new ConnectionPool();
+    return *pool;
+}
+
+std::shared_ptr<Database> ConnectionPool::acquire(const std::string &directory, bool traverseUp) {
+    const std::string file = databasePath(directory, traverseUp).string();
+
+    std::unique_ptr<Database> db;
+    long long dataVersion = 0;
+    long long schemaVersion = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto it = idle.begin(); it != idle.end(); it++) {
+            if (it->file == file) {
+                db = std::move(it->db);
+                dataVersion = it->dataVersion;
+                schemaVersion = it->schemaVersion;
+                idle.erase(it);
+                break;
+            }
+        }
+    }
+
+    // Kept unless another connection changed the schema since it was released
+    if (db != nullptr && db->dataVersion() != dataVersion && db->schemaVersion() != schemaVersion) {
+        LOGD << "Schema of " << file << " changed, closing pooled connection";
+        db.reset();
+    }
+
+    if (db == nullptr) {
+        db = std::make_unique<Database>();
+        db->open(file, true);
+
+        // Read-only connections can't bring the schema up to date
+        if (!db->hasCurrentSchema()) ddb::open(directory, traverseUp);
+
+        schemaVersion = db->schemaVersion();
+    }
+
+    return std::shared_ptr<Database>(db.release(), [this, file, schemaVersion](Database *d) {
+        release(file, d, schemaVersion);
+    });
+}
+
+void ConnectionPool::release(const std::string &file, Database *d, long long schemaVersion) {
+    std::unique_ptr<Database> db(d);
+    std::list<Idle> closing;
+
+    try {
+        // Its caller left a query running, which holds a snapshot
+        if (db->hasActiveStatements()) {
+            LOGD << "Closing pooled connection with active statements";
+            return;
+        }
+
+        const long long dataVersion = db->dataVersion();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_front({file, std::move(db), dataVersion, schemaVersion});
+        while (idle.size() > CONNECTION_POOL_SIZE) {
+            closing.splice(closing.end(), idle, std::prev(idle.end()));
+        }
+    } catch (const AppException &e) {
+        LOGD << "Cannot return connection to pool: " << e.what();
+    }
+}
+
+void ConnectionPool::clear() {
+    std::list<Idle> closing;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing.swap(idle);
+    }
+
+    LOGD << "Closing " << closing.size() << " pooled connections";
+}
+
+size_t ConnectionPool::idleCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return idle.size();
+}
+
+}  // namespace ddb
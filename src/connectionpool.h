@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "database.h"
+#include "ddb_export.h"
+
+namespace ddb {
+
+// Idle connections kept open, across all databases
+#define CONNECTION_POOL_SIZE 64
+
+// Read-only connections to indexes, shared by the threads of a process.
+// A connection serves one caller at a time and goes back to the pool when
+// the last copy of its pointer is released, so that repeated reads skip
+// opening the database and loading SpatiaLite. Readers don't block
+// writers in WAL mode.
+// Idle connections are checked with PRAGMA data_version when handed out
+// and closed if another connection changed the schema in the meantime.
+class ConnectionPool {
+    struct Idle {
+        std::string file;
+        std::unique_ptr<Database> db;
+        long long dataVersion;
+        long long schemaVersion;
+    };
+
+    std::mutex mutex;
+
+    // Most recently released first
+    std::list<Idle> idle;
+
+    ConnectionPool() = default;
+    void release(const std::string &file, Database *db, long long schemaVersion);
+
+  public:
+    // The pool lives until the process exits
+    DDB_DLL static ConnectionPool &instance();
+
+    // A read-only connection to the index in directory. Any write through it fails.
+    // @param traverseUp look for the index in the parents of directory too
+    // @throws FSException if there is no index, as ddb::open
+    DDB_DLL std::shared_ptr<Database> acquire(const std::string &directory, bool traverseUp = false);
+
+    // Closes the idle connections
+    DDB_DLL void clear();
+
+    DDB_DLL size_t idleCount();
+
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+};
+
+}  // namespace ddb
+
+#endif  // CONNECTIONPOOL_H
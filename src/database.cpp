@@ -5,26 +5,163 @@
 #include "database.h"
 #include "metamanager.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <string>
+#include <unordered_set>
 
 #include "exceptions.h"
 #include "hash.h"
 #include "logger.h"
 #include "mio.h"
+#include "utils.h"
 
 namespace ddb {
 
+extern const char *entriesIndexesDdl;
+extern const char *propertyIndexesDdl;
+
+// Names of the indexes created by a DDL script
+static std::vector<std::string> indexNames(const std::string &ddl) {
+    const std::string create = "CREATE INDEX IF NOT EXISTS ";
+    std::vector<std::string> names;
+    for (auto pos = ddl.find(create); pos != std::string::npos; pos = ddl.find(create, pos)) {
+        pos += create.length();
+        names.push_back(ddl.substr(pos, ddl.find_first_of(" \n", pos) - pos));
+    }
+    return names;
+}
+
 // Initialize spatialite
 void Database::Initialize() { spatialite_init(0); }
 
 void Database::afterOpen() {
-    this->setJournalMode("wal");
+    // Read-only connections can't change it, but can read WAL databases
+    if (!this->isReadOnly()) this->setJournalMode("wal");
 
     // If table is locked, sleep up to 30 seconds
     if (sqlite3_busy_timeout(db, 30000) != SQLITE_OK) {
         LOGD << "Cannot set busy timeout";
     }
+
+    std::string profileEnv = std::getenv(DDB_DB_PROFILE_ENV) != nullptr ? std::getenv(DDB_DB_PROFILE_ENV) : "read";
+    utils::toLower(profileEnv);
+    if (profileEnv != "read" && profileEnv != "default") {
+        LOGD << "Invalid " << DDB_DB_PROFILE_ENV << " value: " << profileEnv;
+    }
+    this->setProfile(profileEnv == "default" ? ProfileDefault : ProfileRead);
+
+    const char *bulkEnv = std::getenv(DDB_BULK_LOAD_ENV);
+    autoBulkLoad = bulkEnv == nullptr || std::string(bulkEnv) != "0";
+}
+
+void Database::setProfile(DatabaseProfile profile) {
+    const bool tuned = profile != ProfileDefault;
+
+    this->exec("PRAGMA cache_size=" + std::to_string(tuned ? -DDB_CACHE_SIZE_KB : -2000) + ";"
+               "PRAGMA mmap_size=" + std::to_string(tuned ? DDB_MMAP_SIZE : 0) + ";"
+               "PRAGMA temp_store=" + (tuned ? "MEMORY" : "DEFAULT") + ";");
+
+    // SQLite refuses to change it inside a transaction
+    if (this->inTransaction()) {
+        LOGD << "Cannot change synchronous mode inside a transaction";
+    } else {
+        this->exec(std::string("PRAGMA synchronous=") + (profile == ProfileBulk ? "NORMAL" : "FULL") + ";");
+    }
+
+    this->profile = profile;
+    LOGD << "Database profile: " << profile;
+}
+
+DatabaseProfile Database::getProfile() const {
+    return profile;
+}
+
+void Database::setAutoBulkLoad(bool enabled) {
+    autoBulkLoad = enabled;
+}
+
+bool Database::getAutoBulkLoad() const {
+    return autoBulkLoad;
+}
+
+void Database::beginBulkLoad() {
+    if (bulkLoads++ > 0) return;
+
+    profileBeforeBulkLoad = profile;
+    changesBeforeBulkLoad = this->totalChanges();
+    this->setProfile(ProfileBulk);
+
+    auto q = this->query("SELECT 1 FROM entries LIMIT 1");
+    const bool empty = !q->fetch();
+    q->reset();
+
+    // Other connections see the indexes go, so they are only
+    // dropped when there are no rows for them to look up
+    if (!empty) {
+        this->buildEntriesIndexes();
+        return;
+    }
+
+    // Building an index once from sorted data is
+    // faster than updating it one row at a time
+    const auto names = indexNames(std::string(entriesIndexesDdl) + propertyIndexesDdl);
+    for (const auto &name : names) this->exec("DROP INDEX IF EXISTS \"" + name + "\"");
+    indexesDeferred = true;
+    LOGD << "Deferred " << names.size() << " indexes";
+}
+
+void Database::endBulkLoad() {
+    if (bulkLoads == 0 || --bulkLoads > 0) return;
+
+    const bool rebuild = indexesDeferred;
+    indexesDeferred = false;
+
+    try {
+        if (rebuild) {
+            this->buildEntriesIndexes();
+            LOGD << "Built deferred indexes";
+            this->updateChecksums();
+        }
+
+        if (this->totalChanges() - changesBeforeBulkLoad >= BULK_LOAD_MAINTENANCE_ROWS) {
+            if (this->inTransaction()) {
+                LOGD << "Skipping bulk load maintenance inside a transaction";
+            } else {
+                // Sampled statistics, so that this stays quick on large indexes
+                this->exec("PRAGMA analysis_limit=1000; ANALYZE; PRAGMA wal_checkpoint(TRUNCATE);");
+                LOGD << "Analyzed database and checkpointed WAL";
+            }
+        }
+    } catch (const AppException &) {
+        // Missing indexes are built by the next bulk load
+        this->setProfile(profileBeforeBulkLoad);
+        throw;
+    }
+
+    this->setProfile(profileBeforeBulkLoad);
+}
+
+BulkLoad::BulkLoad(Database *db) : db(db), active(db->getAutoBulkLoad()) {
+    if (active) db->beginBulkLoad();
+}
+
+BulkLoad::~BulkLoad() {
+    if (!active) return;
+
+    try {
+        db->endBulkLoad();
+    } catch (const AppException &e) {
+        LOGD << "Cannot end bulk load: " << e.what();
+    }
+}
+
+void BulkLoad::end() {
+    if (!active) return;
+
+    active = false;
+    db->endBulkLoad();
 }
 
 const char *entriesTableDdl = R"<<<(
@@ -38,15 +175,54 @@ const char *entriesTableDdl = R"<<<(
       properties TEXT,
       mtime INTEGER,
       size  INTEGER,
-      depth INTEGER
+      depth INTEGER,
+      quick_hash TEXT,
+      blake3 TEXT,
+      capture_time REAL
   );
   SELECT AddGeometryColumn("entries", "point_geom", 4326, "POINTZ", "XYZ");
   SELECT AddGeometryColumn("entries", "polygon_geom", 4326, "POLYGONZ", "XYZ");
+  SELECT CreateSpatialIndex("entries", "point_geom");
+  SELECT CreateSpatialIndex("entries", "polygon_geom");
+)<<<";
 
+const char *entriesIndexesDdl = R"<<<(
   CREATE INDEX IF NOT EXISTS ix_entries_type
   ON entries (type);
+
+  CREATE INDEX IF NOT EXISTS ix_entries_capture_time
+  ON entries (capture_time);
+
+  CREATE INDEX IF NOT EXISTS ix_entries_folder
+  ON entries (rtrim(path, replace(path, '/', '')), path);
+
+  CREATE INDEX IF NOT EXISTS ix_entries_path_nocase
+  ON entries (path COLLATE NOCASE);
+)<<<";
+
+// Expression indexes on the properties that searches filter on the most
+// (camera, flight altitude and heading), other keys are scanned.
+// Filters must read them with the same json_extract(properties, '$.key')
+// expression to use them (see FilterExpression).
+const char *propertyIndexesDdl = R"<<<(
+  CREATE INDEX IF NOT EXISTS ix_entries_make
+  ON entries (json_extract(properties, '$.make'));
+
+  CREATE INDEX IF NOT EXISTS ix_entries_model
+  ON entries (json_extract(properties, '$.model'));
+
+  CREATE INDEX IF NOT EXISTS ix_entries_camera_yaw
+  ON entries (json_extract(properties, '$.cameraYaw'));
+
+  CREATE INDEX IF NOT EXISTS ix_entries_relative_altitude
+  ON entries (json_extract(properties, '$.relativeAltitude'));
 )<<<";
 
+// Creates the secondary indexes of entries that are missing
+void Database::buildEntriesIndexes() {
+    this->exec(std::string(entriesIndexesDdl) + propertyIndexesDdl);
+}
+
 const char *passwordsTableDdl = R"<<<(
   CREATE TABLE IF NOT EXISTS passwords (
       salt TEXT,
@@ -79,21 +255,187 @@ BEGIN
 END;
 )<<<";
 
+// Metadata of entries that is searched as text, together with their paths
+const char *entriesTextMetaDdl = R"<<<(
+  CREATE VIEW IF NOT EXISTS entries_text_meta AS
+  SELECT path, group_concat(data, ' ') AS meta
+  FROM entries_meta
+  WHERE key IN ('tags', 'annotations', 'description', 'name')
+  GROUP BY path;
+)<<<";
+
+// Trigram index over the paths and the text metadata of entries, so that
+// substring searches don't have to scan the whole table. Rows share the
+// rowid of their entry and are kept up to date with triggers.
+const char *fullTextIndexDdl = R"<<<(
+  CREATE VIRTUAL TABLE entries_fts USING fts5(path, meta, tokenize = 'trigram');
+
+  CREATE TRIGGER tg_entries_fts_insert
+  AFTER INSERT ON entries
+  BEGIN
+    INSERT INTO entries_fts (rowid, path, meta)
+    VALUES (NEW.rowid, NEW.path, (SELECT meta FROM entries_text_meta WHERE path = NEW.path));
+  END;
+
+  CREATE TRIGGER tg_entries_fts_delete
+  AFTER DELETE ON entries
+  BEGIN
+    DELETE FROM entries_fts WHERE rowid = OLD.rowid;
+  END;
+
+  CREATE TRIGGER tg_entries_fts_update
+  AFTER UPDATE OF path ON entries
+  BEGIN
+    DELETE FROM entries_fts WHERE rowid = OLD.rowid;
+    INSERT INTO entries_fts (rowid, path, meta)
+    VALUES (NEW.rowid, NEW.path, (SELECT meta FROM entries_text_meta WHERE path = NEW.path));
+  END;
+
+  CREATE TRIGGER tg_entries_meta_fts_insert
+  AFTER INSERT ON entries_meta
+  BEGIN
+    UPDATE entries_fts SET meta = (SELECT meta FROM entries_text_meta WHERE path = NEW.path)
+    WHERE rowid = (SELECT rowid FROM entries WHERE path = NEW.path);
+  END;
+
+  CREATE TRIGGER tg_entries_meta_fts_update
+  AFTER UPDATE ON entries_meta
+  BEGIN
+    UPDATE entries_fts SET meta = (SELECT meta FROM entries_text_meta WHERE path = OLD.path)
+    WHERE rowid = (SELECT rowid FROM entries WHERE path = OLD.path);
+    UPDATE entries_fts SET meta = (SELECT meta FROM entries_text_meta WHERE path = NEW.path)
+    WHERE rowid = (SELECT rowid FROM entries WHERE path = NEW.path);
+  END;
+
+  CREATE TRIGGER tg_entries_meta_fts_delete
+  AFTER DELETE ON entries_meta
+  BEGIN
+    UPDATE entries_fts SET meta = (SELECT meta FROM entries_text_meta WHERE path = OLD.path)
+    WHERE rowid = (SELECT rowid FROM entries WHERE path = OLD.path);
+  END;
+
+  INSERT INTO entries_fts (rowid, path, meta)
+  SELECT e.rowid, e.path, m.meta FROM entries e LEFT JOIN entries_text_meta m ON m.path = e.path;
+)<<<";
+
+// Checksums of the folders of the index, each one covering the entries and
+// metadata directly inside it and the checksums of its subfolders (a Merkle
+// tree). The root folder is "", the others end with a slash. Triggers note
+// the folders that changed, using the folder of a path computed with plain
+// SQL (rtrim drops everything after the last slash), and the checksums are
+// brought up to date when read (see Database::getChecksum).
+const char *checksumsDdl = R"<<<(
+  CREATE TABLE IF NOT EXISTS entries_checksums (
+      folder TEXT PRIMARY KEY,
+      parent TEXT NOT NULL,
+      checksum TEXT NOT NULL
+  );
+
+  CREATE INDEX IF NOT EXISTS ix_entries_checksums_parent
+  ON entries_checksums (parent, folder);
+
+  CREATE TABLE IF NOT EXISTS entries_checksums_dirty (
+      folder TEXT PRIMARY KEY
+  );
+
+  CREATE INDEX IF NOT EXISTS ix_entries_meta_folder
+  ON entries_meta (rtrim(path, replace(path, '/', '')), id);
+
+  CREATE TRIGGER IF NOT EXISTS tg_entries_checksums_insert
+  AFTER INSERT ON entries
+  BEGIN
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(NEW.path, replace(NEW.path, '/', '')));
+  END;
+
+  CREATE TRIGGER IF NOT EXISTS tg_entries_checksums_delete
+  AFTER DELETE ON entries
+  BEGIN
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(OLD.path, replace(OLD.path, '/', '')));
+  END;
+
+  CREATE TRIGGER IF NOT EXISTS tg_entries_checksums_update
+  AFTER UPDATE OF path, hash ON entries
+  BEGIN
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(OLD.path, replace(OLD.path, '/', '')));
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(NEW.path, replace(NEW.path, '/', '')));
+  END;
+
+  CREATE TRIGGER IF NOT EXISTS tg_entries_meta_checksums_insert
+  AFTER INSERT ON entries_meta
+  BEGIN
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(NEW.path, replace(NEW.path, '/', '')));
+  END;
+
+  CREATE TRIGGER IF NOT EXISTS tg_entries_meta_checksums_delete
+  AFTER DELETE ON entries_meta
+  BEGIN
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(OLD.path, replace(OLD.path, '/', '')));
+  END;
+
+  CREATE TRIGGER IF NOT EXISTS tg_entries_meta_checksums_update
+  AFTER UPDATE OF id, path ON entries_meta
+  BEGIN
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(OLD.path, replace(OLD.path, '/', '')));
+    INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES (rtrim(NEW.path, replace(NEW.path, '/', '')));
+  END;
+
+  INSERT OR IGNORE INTO entries_checksums_dirty (folder)
+  SELECT DISTINCT rtrim(path, replace(path, '/', '')) FROM entries;
+  INSERT OR IGNORE INTO entries_checksums_dirty (folder)
+  SELECT DISTINCT rtrim(path, replace(path, '/', '')) FROM entries_meta;
+  INSERT OR IGNORE INTO entries_checksums_dirty (folder) VALUES ('');
+)<<<";
+
 Database &Database::createTables() {
     const std::string sql = std::string(entriesTableDdl) + '\n' +
+                            entriesIndexesDdl + '\n' +
+                            propertyIndexesDdl + '\n' +
                             passwordsTableDdl;
 
     LOGD << "About to create tables...";
     this->exec(sql);
     LOGD << "Created tables";
 
+    // Adds the rest and records the schema version,
+    // so that opening the new database needs no checks
+    this->ensureSchemaConsistency();
+
     return *this;
 }
 
+bool Database::hasCurrentSchema() {
+    return this->getUserVersion() >= DDB_SCHEMA_VERSION;
+}
+
 DDB_DLL void Database::ensureSchemaConsistency() {
+    const int version = this->getUserVersion();
+
+    // Databases written by newer versions are left as they are
+    if (version >= DDB_SCHEMA_VERSION) {
+        if (version > DDB_SCHEMA_VERSION) {
+            LOGD << "Schema version " << version << " is newer than " << DDB_SCHEMA_VERSION;
+        }
+        return;
+    }
+
+    LOGD << "Upgrading schema from version " << version << " to " << DDB_SCHEMA_VERSION;
 
-    LOGD << "Ensuring schema consistency";
+    if (version < 1) this->upgradeUnversionedSchema();
 
+    // we added the folder checksums
+    if (version < 2) {
+        this->exec(std::string("BEGIN TRANSACTION;") + entriesIndexesDdl + checksumsDdl + "COMMIT;");
+        LOGD << "Added folder checksums";
+    }
+
+    this->setUserVersion(DDB_SCHEMA_VERSION);
+    LOGD << "Schema is at version " << DDB_SCHEMA_VERSION;
+}
+
+// Brings any database from before the schema was versioned up to version 1.
+// Their layout can only be found out by looking, and every step is safe
+// to run on a database that already has it.
+void Database::upgradeUnversionedSchema() {
     if (!this->tableExists("entries")) {
         LOGD << "Entries table does not exist, creating it";
         this->exec(entriesTableDdl);
@@ -139,6 +481,54 @@ DDB_DLL void Database::ensureSchemaConsistency() {
         LOGD << "Dropped attributes table";
     }
 
+    // Migration from 1.0.10 --> 1.0.11
+    // we added the quick hash column (computed on the next add/sync)
+    if (!this->columnExists("entries", "quick_hash")){
+        this->exec("ALTER TABLE entries ADD COLUMN quick_hash TEXT");
+        LOGD << "Added entries.quick_hash column";
+    }
+
+    // we added the BLAKE3 column (set for large files only)
+    if (!this->columnExists("entries", "blake3")){
+        this->exec("ALTER TABLE entries ADD COLUMN blake3 TEXT");
+        LOGD << "Added entries.blake3 column";
+    }
+
+    // we added the capture time column, filled from the properties
+    // of the entries that have one
+    if (!this->columnExists("entries", "capture_time")){
+        this->exec("ALTER TABLE entries ADD COLUMN capture_time REAL; "
+                   "UPDATE entries SET capture_time = json_extract(properties, '$.captureTime') "
+                   "WHERE json_extract(properties, '$.captureTime') > 0;");
+        LOGD << "Added entries.capture_time column";
+    }
+
+    // we added R*Tree indexes on the geometry columns (SpatiaLite
+    // keeps them up to date with triggers on entries)
+    if (!this->tableExists("idx_entries_point_geom")){
+        this->exec("SELECT CreateSpatialIndex('entries', 'point_geom'); "
+                   "SELECT CreateSpatialIndex('entries', 'polygon_geom');");
+        LOGD << "Added spatial indexes on entries";
+    }
+
+    // Secondary indexes of entries, including the expression indexes on the
+    // properties used by search filters that we added
+    this->buildEntriesIndexes();
+
+    // we added the full-text index, which older SQLite builds cannot
+    // create (searches fall back to scanning the entries)
+    this->exec(entriesTextMetaDdl);
+    if (!this->tableExists("entries_fts")){
+        try{
+            this->exec(std::string("BEGIN TRANSACTION;") + fullTextIndexDdl + "COMMIT;");
+            LOGD << "Added full-text index on entries";
+        }catch(const SQLException &e){
+            this->exec("ROLLBACK;");
+            LOGD << "Cannot create full-text index: " << e.what();
+        }
+        fullTextIndex = -1;
+    }
+
 }
 
 json Database::getProperties() const {
@@ -201,7 +591,184 @@ json Database::getProperties() const {
     return j;
 }
 
-json Database::getStamp() const{
+// Folder of a path, as in checksumsDdl
+static std::string parentFolder(const std::string &path) {
+    const auto slash = path.rfind('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+static std::string folderKey(const std::string &folder) {
+    if (folder.empty() || folder.back() == '/') return folder;
+    return folder + "/";
+}
+
+void Database::updateChecksums() {
+    // They are looked up by folder, which needs the indexes
+    if (indexesDeferred) return;
+
+    const bool readOnly = this->isReadOnly();
+    if (readOnly && pendingChecksumsVersion == this->dataVersion()) return;
+
+    if (!readOnly) {
+        auto q = this->cachedQuery("SELECT 1 FROM entries_checksums_dirty LIMIT 1");
+        const bool dirty = q->fetch();
+        q->reset();
+        if (!dirty) return;
+    }
+
+    // Reads and writes must see the same rows
+    const bool transaction = !readOnly && !this->inTransaction();
+    if (transaction) this->exec("BEGIN IMMEDIATE");
+
+    try {
+        std::vector<std::string> folders;
+        {
+            std::unordered_set<std::string> dirty;
+            auto q = this->cachedQuery("SELECT folder FROM entries_checksums_dirty");
+            while (q->fetch()) {
+                // Along with the folders that contain them
+                for (std::string f = q->getText(0); dirty.insert(f).second && !f.empty();) {
+                    f = parentFolder(f.substr(0, f.size() - 1));
+                }
+            }
+            q->reset();
+            folders.assign(dirty.begin(), dirty.end());
+        }
+
+        // Subfolders first
+        std::sort(folders.begin(), folders.end(), [](const std::string &l, const std::string &r) {
+            const auto ld = std::count(l.begin(), l.end(), '/');
+            const auto rd = std::count(r.begin(), r.end(), '/');
+            return ld != rd ? ld > rd : l < r;
+        });
+
+        std::unordered_map<std::string, std::string> computed;
+        for (const auto &folder : folders) {
+            const std::string checksum = this->computeChecksum(folder, computed);
+            computed[folder] = checksum;
+        }
+
+        if (readOnly) {
+            pendingChecksums.swap(computed);
+            pendingChecksumsVersion = this->dataVersion();
+        } else if (!folders.empty()) {
+            auto update = this->cachedQuery("INSERT OR REPLACE INTO entries_checksums (folder, parent, checksum) VALUES (?, ?, ?)");
+            auto remove = this->cachedQuery("DELETE FROM entries_checksums WHERE folder = ?");
+            for (const auto &c : computed) {
+                if (c.second.empty()) {
+                    remove->bind(1, c.first);
+                    remove->execute();
+                } else {
+                    update->bind(1, c.first);
+                    update->bind(2, c.first.empty() ? "" : parentFolder(c.first.substr(0, c.first.size() - 1)));
+                    update->bind(3, c.second);
+                    update->execute();
+                }
+            }
+            this->exec("DELETE FROM entries_checksums_dirty");
+            LOGD << "Updated checksums of " << folders.size() << " folders";
+        }
+
+        if (transaction) this->exec("COMMIT");
+    } catch (const AppException &) {
+        if (transaction) this->exec("ROLLBACK");
+        throw;
+    }
+}
+
+// Checksum of the entries and metadata directly inside a folder and of its
+// subfolders, or "" if there are none (the root always has one)
+std::string Database::computeChecksum(const std::string &folder,
+                                      const std::unordered_map<std::string, std::string> &computed) {
+    SHA256 checksum;
+    bool empty = true;
+    auto add = [&checksum, &empty](const std::string &s) {
+        checksum.add(s.c_str(), s.length());
+        checksum.add("\n", 1);
+        empty = false;
+    };
+
+    auto q = this->cachedQuery("SELECT path, hash FROM entries WHERE rtrim(path, replace(path, '/', '')) = ? ORDER BY path");
+    q->bind(1, folder);
+    while (q->fetch()) {
+        add(q->getText(0));
+        add(q->getText(1));
+    }
+    q->reset();
+
+    q = this->cachedQuery("SELECT id FROM entries_meta WHERE rtrim(path, replace(path, '/', '')) = ? ORDER BY id");
+    q->bind(1, folder);
+    while (q->fetch()) add(q->getText(0));
+    q->reset();
+
+    for (const auto &child : this->childChecksums(folder, computed)) {
+        add(child.first);
+        add(child.second);
+    }
+
+    return empty && !folder.empty() ? "" : checksum.getHash();
+}
+
+std::map<std::string, std::string> Database::childChecksums(const std::string &folder,
+                                                            const std::unordered_map<std::string, std::string> &computed) {
+    std::map<std::string, std::string> children;
+
+    auto q = this->cachedQuery("SELECT folder, checksum FROM entries_checksums WHERE parent = ? AND folder != ''");
+    q->bind(1, folder);
+    while (q->fetch()) children[q->getText(0)] = q->getText(1);
+    q->reset();
+
+    // Computed but not stored yet
+    for (const auto &c : computed) {
+        if (c.first.empty() || parentFolder(c.first.substr(0, c.first.size() - 1)) != folder) continue;
+        if (c.second.empty()) children.erase(c.first);
+        else children[c.first] = c.second;
+    }
+
+    return children;
+}
+
+std::string Database::getChecksum(const std::string &folder) {
+    this->updateChecksums();
+
+    const std::string key = folderKey(folder);
+    const auto pending = pendingChecksums.find(key);
+    if (pending != pendingChecksums.end()) return pending->second;
+
+    auto q = this->cachedQuery("SELECT checksum FROM entries_checksums WHERE folder = ?");
+    q->bind(1, key);
+    const std::string checksum = q->fetch() ? q->getText(0) : "";
+    q->reset();
+
+    return checksum;
+}
+
+std::map<std::string, std::string> Database::getChildChecksums(const std::string &folder) {
+    this->updateChecksums();
+    return this->childChecksums(folderKey(folder), pendingChecksums);
+}
+
+// The stored root checksum, or "" if some folders changed after it was
+// computed (by a write that did not update the checksums)
+std::string Database::storedRootChecksum() {
+    auto q = this->cachedQuery("SELECT 1 FROM entries_checksums_dirty LIMIT 1");
+    const bool dirty = q->fetch();
+    q->reset();
+    if (dirty) return "";
+
+    q = this->cachedQuery("SELECT checksum FROM entries_checksums WHERE folder = ''");
+    const std::string checksum = q->fetch() ? q->getText(0) : "";
+    q->reset();
+
+    return checksum;
+}
+
+json Database::getStamp() {
+    // Unchanged since the last call. The stamp lists every entry,
+    // so only reusing it saves the scan below
+    const std::string root = this->storedRootChecksum();
+    if (!root.empty() && !stamp.is_null() && root == stampRoot) return stamp;
+
     json j;
     SHA256 checksum;
 
@@ -225,6 +792,9 @@ json Database::getStamp() const{
     }
 
     j["checksum"] = checksum.getHash();
+
+    stamp = j;
+    stampRoot = root;
     return j;
 }
 
@@ -280,15 +850,19 @@ json Database::getExtent() const{
                         }};
     }
 
-    // No reliable temporal information is available
-    // TODO: some assets (geoimages) have temporal information
-    // perhaps there might be use in the future to populate it here
-    // Other ideas include using creation date / modification date, but
-    // these do not reflect the actual time of the assets
-    j["temporal"] = {{"interval", json::array({
-                                      json::array({j_null, j_null})
-                                  })
-                    }};
+    // Capture times of the assets that have one (e.g. geoimages),
+    // each bound is a lookup on the capture time index.
+    // Creation / modification dates do not reflect
+    // the actual time of the assets, so they are not used
+    json interval = json::array({j_null, j_null});
+    const auto tq = this->query("SELECT (SELECT MIN(capture_time) FROM entries), "
+                                "(SELECT MAX(capture_time) FROM entries)");
+    if (tq->fetch() && !tq->getText(0).empty()){
+        interval = json::array({utils::millisToIso8601(tq->getDouble(0)),
+                                utils::millisToIso8601(tq->getDouble(1))});
+    }
+
+    j["temporal"] = {{"interval", json::array({interval})}};
 
     return j;
 }
@@ -300,6 +874,13 @@ MetaManager *Database::getMetaManager(){
     return metaManager;
 }
 
+bool Database::hasFullTextIndex(){
+    if (fullTextIndex == -1){
+        fullTextIndex = this->tableExists("entries_fts") ? 1 : 0;
+    }
+    return fullTextIndex == 1;
+}
+
 Database::~Database(){
     if (metaManager != nullptr){
         delete metaManager;
@@ -6,6 +6,31 @@
 
 #define DDB_BUILD_PATH "build"
 
+// Connection profile: "read" (default) or "default" (SQLite's defaults)
+#define DDB_DB_PROFILE_ENV "DDB_DB_PROFILE"
+
+// Set to 0 to keep functions that write many rows from switching
+// to the bulk profile (see Database::setAutoBulkLoad)
+#define DDB_BULK_LOAD_ENV "DDB_BULK_LOAD"
+
+// Page cache and memory map sizes of the read profile
+// (SQLite caps the memory map to its compile time maximum)
+#define DDB_CACHE_SIZE_KB 65536
+#define DDB_MMAP_SIZE 4294967296LL
+
+// Version of the schema, stored in PRAGMA user_version. Databases that
+// have it open without any check, add a migration when changing it.
+#define DDB_SCHEMA_VERSION 2
+
+// A bulk load that wrote at least this many rows updates the query
+// planner statistics and checkpoints the WAL when done
+#define BULK_LOAD_MAINTENANCE_ROWS 1000
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "metamanager.h"
 #include "sqlite_database.h"
 #include "ddb_export.h"
@@ -14,18 +39,78 @@
 
 namespace ddb{
 
+enum DatabaseProfile {
+    // SQLite defaults
+    ProfileDefault,
+
+    // Larger page cache, memory-mapped reads and in-memory temporary storage
+    ProfileRead,
+
+    // ProfileRead with synchronous = NORMAL, which is still safe in WAL mode
+    // but might lose the last transactions on power loss
+    ProfileBulk
+};
+
 class Database : public SqliteDatabase {
   private:
     MetaManager *metaManager = nullptr;   
+
+    // -1 until checked
+    int fullTextIndex = -1;
+
+    DatabaseProfile profile = ProfileDefault;
+    bool autoBulkLoad = true;
+
+    // Nesting depth of beginBulkLoad calls
+    int bulkLoads = 0;
+    DatabaseProfile profileBeforeBulkLoad = ProfileDefault;
+    int changesBeforeBulkLoad = 0;
+
+    // Whether the indexes of entries are built when the bulk load ends
+    bool indexesDeferred = false;
+
+    // Folder checksums computed by a read-only connection, which
+    // can't store them, and the data version they are valid for
+    std::unordered_map<std::string, std::string> pendingChecksums;
+    long long pendingChecksumsVersion = -1;
+
+    // Last stamp and the root checksum it was computed for
+    json stamp;
+    std::string stampRoot;
+
+    void upgradeUnversionedSchema();
+    void buildEntriesIndexes();
+    std::string storedRootChecksum();
+    std::string computeChecksum(const std::string &folder,
+                                const std::unordered_map<std::string, std::string> &computed);
+    std::map<std::string, std::string> childChecksums(const std::string &folder,
+                                                      const std::unordered_map<std::string, std::string> &computed);
   public:
       DDB_DLL ~Database();
       DDB_DLL static void Initialize();
       DDB_DLL void afterOpen() override;
       DDB_DLL Database &createTables();
+
+      // Runs the migrations the database needs, if its schema version is old
       DDB_DLL void ensureSchemaConsistency();
+      DDB_DLL bool hasCurrentSchema();
 
       DDB_DLL json getProperties() const;
-      DDB_DLL json getStamp() const;
+      // Kept until the index changes
+      DDB_DLL json getStamp();
+
+      // Checksum of everything below a folder ("" for the root, else "a/b"
+      // or "a/b/"), or "" if there is nothing. Equal checksums mean equal
+      // entries and metadata, so unchanged subtrees can be skipped.
+      DDB_DLL std::string getChecksum(const std::string &folder = "");
+
+      // Checksums of the subfolders of a folder, by folder ("a/b/")
+      DDB_DLL std::map<std::string, std::string> getChildChecksums(const std::string &folder);
+
+      // Computes the checksums of the folders that changed and, unless
+      // the connection is read-only, stores them. Write operations call it
+      // before they finish, so that readers only need to look them up.
+      DDB_DLL void updateChecksums();
 
       DDB_DLL fs::path rootDirectory() const;
       DDB_DLL fs::path ddbDirectory() const;
@@ -36,6 +121,50 @@ class Database : public SqliteDatabase {
       DDB_DLL json getExtent() const;
 
       DDB_DLL MetaManager* getMetaManager();
+
+      // Whether the entries_fts trigram index is available
+      // (it needs SQLite 3.34 or later built with FTS5)
+      DDB_DLL bool hasFullTextIndex();
+
+      // Applies the pragmas of a profile. The synchronous setting
+      // is left as is while a transaction is open.
+      DDB_DLL void setProfile(DatabaseProfile profile);
+      DDB_DLL DatabaseProfile getProfile() const;
+
+      // Switches to ProfileBulk until the matching endBulkLoad call (nested
+      // calls do nothing). Use the BulkLoad scope rather than calling these.
+      // If entries is empty, its secondary indexes are dropped and built
+      // once at the end; otherwise any that are missing (because a previous
+      // load was interrupted) are built now.
+      DDB_DLL void beginBulkLoad();
+
+      // Builds the deferred indexes, updates the statistics and checkpoints
+      // the WAL (if enough rows were written and no transaction is open),
+      // then goes back to the previous profile
+      DDB_DLL void endBulkLoad();
+
+      // Whether addToIndex, syncIndex, applyDelta and MetaManager::restore
+      // switch to bulk loads (initially false if DDB_BULK_LOAD is 0)
+      DDB_DLL void setAutoBulkLoad(bool enabled);
+      DDB_DLL bool getAutoBulkLoad() const;
+};
+
+// Keeps a database in a bulk load for its lifetime,
+// if automatic bulk loads are enabled
+class BulkLoad {
+    Database *db;
+    bool active;
+  public:
+    DDB_DLL BulkLoad(Database *db);
+
+    // Errors of a bulk load ended by the destructor are only logged
+    DDB_DLL ~BulkLoad();
+
+    // Ends the bulk load now, throwing if the indexes cannot be built
+    DDB_DLL void end();
+
+    BulkLoad(const BulkLoad &) = delete;
+    BulkLoad &operator=(const BulkLoad &) = delete;
 };
 
 DDB_DLL json wktBboxCoordinates(const std::string &wktBbox);
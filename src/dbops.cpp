@@ -8,28 +8,63 @@
 #include <status.h>
 
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <mutex>
+#include <set>
+#include <unordered_set>
 
+#include "batchreader.h"
 #include "entry_types.h"
 #include "exceptions.h"
 #include "exif.h"
+#include "filterexpression.h"
 #include "hash.h"
 #include "logger.h"
 #include "mio.h"
 #include "net.h"
 #include "userprofile.h"
 #include "utils.h"
+#include "transactionbatch.h"
 #include "version.h"
+#include "workqueue.h"
 
 namespace ddb {
 
 #define UPDATE_QUERY                                                        \
     "UPDATE entries SET hash=?, type=?, properties=?, mtime=?, size=?, depth=?, " \
-    "point_geom=GeomFromText(?, 4326), polygon_geom=GeomFromText(?, 4326) " \
-    "WHERE path=?"
+    "point_geom=GeomFromWKB(?, 4326), polygon_geom=GeomFromWKB(?, 4326), " \
+    "quick_hash=?, blake3=?, capture_time=? WHERE path=?"
 
-std::unique_ptr<Database> open(const std::string &directory,
-                               bool traverseUp = false) {
+#define INSERT_QUERY                                                        \
+    "INSERT INTO entries (path, hash, type, properties, mtime, size, depth, " \
+    "point_geom, polygon_geom, quick_hash, blake3, capture_time) VALUES "
+
+#define INSERT_QUERY_ROW "(?, ?, ?, ?, ?, ?, ?, GeomFromWKB(?, 4326), GeomFromWKB(?, 4326), ?, ?, ?)"
+
+// A path given twice (e.g. a file and a folder that contains it) is
+// looked up before either copy is written, so both are added: the
+// second one updates the first
+#define INSERT_QUERY_UPSERT                                                 \
+    " ON CONFLICT(path) DO UPDATE SET hash=excluded.hash, type=excluded.type, " \
+    "properties=excluded.properties, mtime=excluded.mtime, size=excluded.size, " \
+    "depth=excluded.depth, point_geom=excluded.point_geom, polygon_geom=excluded.polygon_geom, " \
+    "quick_hash=excluded.quick_hash, blake3=excluded.blake3, capture_time=excluded.capture_time"
+#define INSERT_QUERY_PARAMS 12
+
+// Shortest string that can be looked up in the trigram index
+#define FULL_TEXT_MIN_LENGTH 3
+
+// Maximum number of rows added by a single INSERT (stays
+// below SQLite's default limit of 999 parameters)
+#define INSERT_MAX_ROWS 64
+
+// Used for files whose modified time changed, but whose contents did not
+#define TOUCH_QUERY "UPDATE entries SET mtime=?, quick_hash=? WHERE path=?"
+
+fs::path databasePath(const std::string &directory, bool traverseUp) {
     const fs::path dirPath = fs::absolute(directory);
     const fs::path ddbDirPath = dirPath / DDB_FOLDER;
     const fs::path dbasePath = ddbDirPath / "dbase.sqlite";
@@ -40,39 +75,49 @@ std::unique_ptr<Database> open(const std::string &directory,
                 "Not a valid DroneDB directory, .ddb does not exist. Did you "
                 "run ddb init?");
 
-        return open(dirPath.parent_path().string(), true);
+        return databasePath(dirPath.parent_path().string(), true);
     }
 
+    return dbasePath;
+}
+
+std::unique_ptr<Database> open(const std::string &directory,
+                               bool traverseUp = false) {
+    const fs::path dbasePath = databasePath(directory, traverseUp);
+
     LOGD << dbasePath.string() + " exists";
 
     auto db = std::make_unique<Database>();
 
     db->open(dbasePath.string());
 
-    if (!db->tableExists("entries"))
-        throw DBException("Table 'entries' not found (not a valid database: " +
-                          dbasePath.string() + ")");
+    // A single pragma read for databases that are up to date
+    if (!db->hasCurrentSchema()) {
+        if (!db->tableExists("entries"))
+            throw DBException("Table 'entries' not found (not a valid database: " +
+                              dbasePath.string() + ")");
 
-    db->ensureSchemaConsistency();
+        db->ensureSchemaConsistency();
+    }
 
     return db;
 }
 
-// Computes a list of paths inside rootDirectory
+// Walks the paths inside rootDirectory, streaming them to cb
 // all paths must be subfolders/files within rootDirectory
 // or an exception is thrown
 // If includeDirs is true and the list includes paths to directories that are in
 // paths eg. if path/to/file is in paths, both "path/" and "path/to" are
 // included in the result.
-// ".ddb" files/dirs are always ignored and skipped.
+// ".ddb" files/dirs in paths are ignored and skipped.
 // If a directory is in the input paths, they are included regardless of
 // includeDirs
-std::vector<fs::path> getIndexPathList(const fs::path &rootDirectory,
-                                       const std::vector<std::string> &paths,
-                                       bool includeDirs) {
-    std::vector<fs::path> result;
-    std::unordered_map<std::string, bool> directories;
-
+// Directories are always reported before their children, so that
+// adding the results in order never leaves a file without its parent folders
+// Return false from cb to stop the walk
+void walkIndexPathList(const fs::path &rootDirectory,
+                       const std::vector<std::string> &paths,
+                       bool includeDirs, const WalkCallback &cb) {
     for (const std::string &p : paths) {
         if (p.empty()) throw FSException("Some paths are empty");
     }
@@ -84,124 +129,144 @@ std::vector<fs::path> getIndexPathList(const fs::path &rootDirectory,
 
     io::Path rootDir = rootDirectory;
 
-    for (fs::path p : paths) {
-        // fs::directory_options::skip_permission_denied
-        if (p.filename() == DDB_FOLDER) continue;
+    struct Input {
+        WalkEntry e;
+        std::string key;
+    };
+    std::vector<Input> inputs;
+    std::unordered_set<std::string> inputDirs;
 
-        if (fs::is_directory(p)) {
-            try {
-                for (auto i = fs::recursive_directory_iterator(p);
-                     i != fs::recursive_directory_iterator(); ++i) {
-                    fs::path rp = i->path();
-
-                    // Skip .ddb
-                    if (rp.filename() == DDB_FOLDER)
-                        i.disable_recursion_pending();
-
-                    if (fs::is_directory(rp) && includeDirs) {
-                        directories[rp.string()] = true;
-                    } else {
-                        result.push_back(rp);
-                    }
+    for (const fs::path p : paths) {
+        if (p.filename() == DDB_FOLDER) continue;
 
-                    if (includeDirs) {
-                        while (rp.has_parent_path() &&
-                               rootDir.isParentOf(rp.parent_path()) &&
-                               rp.string() != rp.parent_path().string()) {
-                            rp = rp.parent_path();
-                            directories[rp.string()] = true;
-                        }
-                    }
-                }
-            } catch (const fs::filesystem_error &e) {
-                throw FSException(e.what());
-            }
+        Input in;
+        if (!DirectoryWalker::stat(p, in.e)) {
+            throw FSException("Path does not exist: " + p.string());
+        }
+        in.key = fs::absolute(p).lexically_normal().generic_string();
+        if (in.e.directory) inputDirs.insert(in.key);
+        inputs.push_back(std::move(in));
+    }
 
-            directories[p.string()] = true;
-            if (includeDirs) {
-                while (p.has_parent_path() &&
-                       rootDir.isParentOf(p.parent_path()) &&
-                       p.string() != p.parent_path().string()) {
-                    p = p.parent_path();
-                    directories[p.string()] = true;
-                }
+    // Only tracks the ancestors of the input paths,
+    // whatever is below them comes from the walk
+    std::set<std::string> directories;
+    std::vector<const Input *> roots;
+    std::unordered_set<std::string> seen;
+
+    for (const auto &in : inputs) {
+        if (!seen.insert(in.key).second) continue;
+
+        // Skip inputs within another input directory,
+        // the walk of the latter covers them
+        bool covered = false;
+        for (fs::path a = fs::path(in.key).parent_path();
+             !a.empty() && a != a.parent_path(); a = a.parent_path()) {
+            if (inputDirs.count(a.generic_string())) {
+                covered = true;
+                break;
             }
-        } else if (fs::exists(p)) {
-            // File
-            result.push_back(p);
-
-            if (includeDirs) {
-                while (p.has_parent_path() &&
-                       rootDir.isParentOf(p.parent_path()) &&
-                       p.string() != p.parent_path().string()) {
-                    p = p.parent_path();
-                    directories[p.string()] = true;
-                }
+        }
+        if (covered) continue;
+
+        roots.push_back(&in);
+
+        fs::path p = in.e.path;
+        if (in.e.directory) directories.insert(p.string());
+        if (includeDirs) {
+            while (p.has_parent_path() &&
+                   rootDir.isParentOf(p.parent_path()) &&
+                   p.string() != p.parent_path().string()) {
+                p = p.parent_path();
+                directories.insert(p.string());
             }
-        } else {
-            throw FSException("Path does not exist: " + p.string());
         }
     }
 
-    for (auto [fst, snd] : directories) {
-        result.emplace_back(fst);
+    // Sorted, so parents come before their children
+    for (const auto &d : directories) {
+        WalkEntry e;
+        if (!DirectoryWalker::stat(d, e)) e.path = d;
+        e.directory = true;
+        if (!cb(e)) return;
     }
 
-    return result;
+    for (const Input *in : roots) {
+        if (!in->e.directory && !cb(in->e)) return;
+    }
+
+    for (const Input *in : roots) {
+        if (!in->e.directory) continue;
+
+        DirectoryWalker walker(in->e.path);
+        WalkEntry e;
+        while (walker.next(e)) {
+            if (!cb(e)) return;
+        }
+    }
 }
 
-std::vector<fs::path> getPathList(const std::vector<std::string> &paths,
-                                  bool includeDirs, int maxDepth, bool includeFiles) {
-    std::vector<fs::path> result;
-    std::unordered_map<std::string, bool> directories;
+// Same as walkIndexPathList, but returns the paths
+// Directories are listed first, sorted
+std::vector<fs::path> getIndexPathList(const fs::path &rootDirectory,
+                                       const std::vector<std::string> &paths,
+                                       bool includeDirs) {
+    std::vector<fs::path> dirs;
+    std::vector<fs::path> files;
 
-    for (fs::path p : paths) {
-        // fs::directory_options::skip_permission_denied
-        if (p.filename() == DDB_FOLDER) continue;
+    walkIndexPathList(rootDirectory, paths, includeDirs, [&dirs, &files](const WalkEntry &e) {
+        if (e.directory) dirs.push_back(e.path);
+        else files.push_back(e.path);
+        return true;
+    });
 
-        try {
-            if (fs::is_directory(p)) {
-                for (auto i = fs::recursive_directory_iterator(p);
-                     i != fs::recursive_directory_iterator(); ++i) {
-                    fs::path rp = i->path();
+    std::sort(dirs.begin(), dirs.end(), [](const fs::path &a, const fs::path &b) {
+        return a.string() < b.string();
+    });
+
+    dirs.insert(dirs.end(), files.begin(), files.end());
+    return dirs;
+}
 
-                    // Ignore system files on Windows
+void walkPathList(const std::vector<std::string> &paths, bool includeDirs,
+                  int maxDepth, bool includeFiles, const WalkCallback &cb) {
+    // Ignore system files on Windows
 #ifdef WIN32
-                    const DWORD attrs =
-                        GetFileAttributesW(rp.wstring().c_str());
-                    if (attrs & FILE_ATTRIBUTE_HIDDEN ||
-                        attrs & FILE_ATTRIBUTE_SYSTEM) {
-                        i.disable_recursion_pending();
-                        continue;
-                    }
+    const bool skipSystemFiles = true;
+#else
+    const bool skipSystemFiles = false;
 #endif
 
-                    // Skip .ddb recursion
-                    if (rp.filename() == DDB_FOLDER)
-                        i.disable_recursion_pending();
+    for (fs::path p : paths) {
+        if (p.filename() == DDB_FOLDER) continue;
 
-                    // Max depth
-                    if (maxDepth > 0 && i.depth() >= (maxDepth - 1))
-                        i.disable_recursion_pending();
-                    else if (maxDepth == -1)
-                        i.disable_recursion_pending();
+        WalkEntry input;
+        const bool exists = DirectoryWalker::stat(p, input);
 
-                    if (fs::is_directory(rp)) {
-                        if (includeDirs) result.push_back(rp);
-                    } else {
-                        if (includeFiles) result.push_back(rp);
-                    }
-                }
-            } else if (fs::exists(p) && includeFiles) {
-                // File
-                result.push_back(p);
-            } else {
-                throw FSException("Path does not exist: " + p.string());
+        if (exists && input.directory) {
+            DirectoryWalker walker(p, maxDepth, 0, skipSystemFiles);
+            WalkEntry e;
+            while (walker.next(e)) {
+                if (e.directory ? !includeDirs : !includeFiles) continue;
+                if (!cb(e)) return;
             }
-        } catch (const fs::filesystem_error &e) {
-            throw FSException(e.what());
+        } else if (exists && includeFiles) {
+            // File
+            if (!cb(input)) return;
+        } else {
+            throw FSException("Path does not exist: " + p.string());
         }
     }
+}
+
+std::vector<fs::path> getPathList(const std::vector<std::string> &paths,
+                                  bool includeDirs, int maxDepth, bool includeFiles) {
+    std::vector<fs::path> result;
+
+    walkPathList(paths, includeDirs, maxDepth, includeFiles, [&result](const WalkEntry &e) {
+        result.push_back(e.path);
+        return true;
+    });
 
     return result;
 }
@@ -215,45 +280,162 @@ std::vector<std::string> expandPathList(const std::vector<std::string> &paths,
             result.push_back(fs::absolute(p).string());
         }
     }else{
-        auto pl = getPathList(paths, true, maxRecursionDepth);
-        for (auto &p : pl) {
-            result.push_back(fs::absolute(p).string());
-        }
+        walkPathList(paths, true, maxRecursionDepth, true, [&result](const WalkEntry &e) {
+            result.push_back(fs::absolute(e.path).string());
+            return true;
+        });
     }
 
     return result;
 }
 
-FileStatus checkUpdate(Entry &e, const fs::path &p, long long dbMtime,
-                 const std::string &dbHash) {
+static ChangeDetection changeDetectionFromEnv() {
+    const char *env = std::getenv(DDB_CHANGE_DETECTION_ENV);
+    if (env == nullptr) return CDStrict;
+
+    std::string mode = env;
+    utils::toLower(mode);
+    if (mode == "quick") return CDQuick;
+    if (mode != "strict") {
+        LOGD << "Invalid " << DDB_CHANGE_DETECTION_ENV << " value: " << mode;
+    }
 
-    if (!exists(p))
+    return CDStrict;
+}
+
+static std::atomic<ChangeDetection> changeDetection(changeDetectionFromEnv());
+
+ChangeDetection getChangeDetection() { return changeDetection; }
+
+void setChangeDetection(ChangeDetection mode) { changeDetection = mode; }
+
+// Checks whether a file has changed compared to its index entry. Hashes are
+// computed only when the file metadata is not enough to decide:
+// - same size and modified time: not modified
+// - different size: modified
+// - different modified time: compare the quick hash (if allowed by the
+//   current ChangeDetection mode and available), otherwise the BLAKE3 hash
+//   (large files, hashed on all cores) or the SHA256 hash
+// When a file is found to be unchanged, e.mtime and e.quickHash are set
+// so that callers can refresh the entry's modified time.
+FileStatus checkUpdate(Entry &e, const fs::path &p, long long dbMtime,
+                 const std::string &dbHash, std::uintmax_t dbSize,
+                 const std::string &dbQuickHash, const std::string &dbBlake3) {
+    WalkEntry file;
+    if (!DirectoryWalker::stat(p, file))
         return Deleted;
 
-    const bool folder = fs::is_directory(p);
+    return checkUpdate(e, file, dbMtime, dbHash, dbSize, dbQuickHash, dbBlake3);
+}
+
+FileStatus checkUpdate(Entry &e, const WalkEntry &file, long long dbMtime,
+                 const std::string &dbHash, std::uintmax_t dbSize,
+                 const std::string &dbQuickHash, const std::string &dbBlake3,
+                 std::uintmax_t *bytesHashed) {
+    if (file.directory) return NotModified;
 
-    if (folder) return NotModified;
+    auto countHashed = [bytesHashed](std::uintmax_t bytes) {
+        if (bytesHashed != nullptr) *bytesHashed += bytes;
+    };
+    const std::uintmax_t quickHashBytes = std::min<std::uintmax_t>(file.size, 2 * QUICK_HASH_CHUNK_SIZE);
 
     // Did it change?
-    e.mtime = io::Path(p).getModifiedTime();
+    const fs::path &p = file.path;
+    e.mtime = file.mtime;
+    e.size = file.size;
+
+    if (e.size != dbSize) {
+        LOGD << p.string() << " size ( " << dbSize
+             << " ) differs from file value: " << e.size;
+        return Modified;
+    }
 
     if (e.mtime != dbMtime) {
         LOGD << p.string() << " modified time ( " << dbMtime
              << " ) differs from file value: " << e.mtime;
 
-        e.hash = Hash::fileSHA256(p.string());
+        if (getChangeDetection() == CDQuick && !dbQuickHash.empty()) {
+            e.quickHash = Hash::fileQuickHash(p.string());
+            countHashed(quickHashBytes);
+
+            if (dbQuickHash != e.quickHash) {
+                LOGD << p.string() << " quick hash differs (old: " << dbQuickHash
+                        << " | new: " << e.quickHash << ")";
+                e.quickHash = "";
+                return Modified;
+            }
+
+            return NotModified;
+        }
+
+        // A missing quick hash comes with the full read
+        std::string *quickHash = dbQuickHash.empty() ? &e.quickHash : nullptr;
+
+        if (!dbBlake3.empty()) {
+            e.blake3 = Hash::fileBLAKE3(p.string(), 0, quickHash);
+            countHashed(e.size);
 
-        if (dbHash != e.hash) {
-            LOGD << p.string() << " hash differs (old: " << dbHash
-                    << " | new: " << e.hash << ")";
-            return Modified;
+            if (dbBlake3 != e.blake3) {
+                LOGD << p.string() << " BLAKE3 hash differs (old: " << dbBlake3
+                        << " | new: " << e.blake3 << ")";
+                return Modified;
+            }
+        } else {
+            e.hash = Hash::fileSHA256(p.string(), quickHash);
+            countHashed(e.size);
+
+            if (dbHash != e.hash) {
+                LOGD << p.string() << " hash differs (old: " << dbHash
+                        << " | new: " << e.hash << ")";
+                return Modified;
+            }
         }
 
+        if (!dbQuickHash.empty()) e.quickHash = dbQuickHash;
     }
 
     return NotModified;
 }
 
+bool checkUpdateNeedsHash(const WalkEntry &file, long long dbMtime, std::uintmax_t dbSize) {
+    return !file.directory && file.size == dbSize && file.mtime != dbMtime;
+}
+
+// Geometries are bound as WKB, which SpatiaLite
+// reads without parsing any text
+static void bindGeometry(Statement *q, int paramNum, const BasicGeometry &g) {
+    const std::string wkb = g.toWkb();
+    if (wkb.empty()) q->bindNull(paramNum);
+    else q->bind(paramNum, wkb.data(), static_cast<int>(wkb.size()));
+}
+
+// The capture time of images and videos, when known, is
+// also stored in its own (indexed) column
+static void bindCaptureTime(Statement *q, int paramNum, const Entry &e) {
+    const auto it = e.properties.find("captureTime");
+    if (it != e.properties.end() && it->is_number() && it->get<double>() > 0)
+        q->bind(paramNum, it->get<double>());
+    else
+        q->bindNull(paramNum);
+}
+
+// Binds the values of one row of INSERT_QUERY
+static void bindInsert(Statement *q, int row, const Entry &e) {
+    const int p = row * INSERT_QUERY_PARAMS;
+    q->bind(p + 1, e.path);
+    q->bind(p + 2, e.hash);
+    q->bind(p + 3, e.type);
+    q->bind(p + 4, e.properties.dump());
+    q->bind(p + 5, static_cast<long long>(e.mtime));
+    q->bind(p + 6, static_cast<long long>(e.size));
+    q->bind(p + 7, e.depth);
+    bindGeometry(q, p + 8, e.point_geom);
+    bindGeometry(q, p + 9, e.polygon_geom);
+    q->bind(p + 10, e.quickHash);
+    q->bind(p + 11, e.blake3);
+    bindCaptureTime(q, p + 12, e);
+}
+
 void doUpdate(Statement *updateQ, const Entry &e) {
     // Fields
     updateQ->bind(1, e.hash);
@@ -262,17 +444,512 @@ void doUpdate(Statement *updateQ, const Entry &e) {
     updateQ->bind(4, static_cast<long long>(e.mtime));
     updateQ->bind(5, static_cast<long long>(e.size));
     updateQ->bind(6, e.depth);
-    updateQ->bind(7, e.point_geom.toWkt());
-    updateQ->bind(8, e.polygon_geom.toWkt());
+    bindGeometry(updateQ, 7, e.point_geom);
+    bindGeometry(updateQ, 8, e.polygon_geom);
+    updateQ->bind(9, e.quickHash);
+    updateQ->bind(10, e.blake3);
+    bindCaptureTime(updateQ, 11, e);
 
     // Where
-    updateQ->bind(9, e.path);
+    updateQ->bind(12, e.path);
 
     updateQ->execute();
 }
 
-void listIndex(Database* db, const std::vector<std::string>& paths, std::ostream& output, const std::string& format, bool recursive, int maxRecursionDepth) {
-    if (format != "json" && format != "text") throw InvalidArgsException("Invalid format " + format);
+std::string sanitize_query_param(const std::string &str) {
+    std::string res(str);
+
+    // TAKES INTO ACCOUNT PATHS THAT CONTAINS EVERY SORT OF STUFF
+    utils::stringReplace(res, "/", "//");
+    utils::stringReplace(res, "%", "/%");
+    utils::stringReplace(res, "_", "/_");
+    utils::stringReplace(res, "*", "%");
+
+    return res;
+}
+
+// Smallest string that is greater than every string starting with prefix
+// (in binary order), or empty if there is none
+std::string pathUpperBound(std::string prefix) {
+    while (!prefix.empty()) {
+        auto &last = reinterpret_cast<unsigned char &>(prefix.back());
+        if (last < 0xFF) {
+            last++;
+            return prefix;
+        }
+        prefix.pop_back();
+    }
+
+    return prefix;
+}
+
+// Same as pathUpperBound, for strings compared with the NOCASE collation,
+// which folds ASCII upper case letters to lower case
+std::string pathUpperBoundNoCase(std::string prefix) {
+    for (auto &c : prefix) {
+        if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+    }
+
+    prefix = pathUpperBound(prefix);
+
+    // No character folds to an upper case letter, the next one that
+    // compares greater is the one after 'Z'
+    if (!prefix.empty() && prefix.back() >= 'A' && prefix.back() <= 'Z') prefix.back() = 'Z' + 1;
+    return prefix;
+}
+
+// Number of characters of an UTF-8 string
+size_t utf8Length(const std::string &s) {
+    size_t len = 0;
+    for (const char c : s) {
+        if ((static_cast<unsigned char>(c) & 0xC0) != 0x80) len++;
+    }
+    return len;
+}
+
+// FTS5 query for the rows that contain all the strings
+// in column (in any column if it's empty)
+std::string fullTextQuery(const std::vector<std::string> &strings, const std::string &column = "") {
+    std::string res;
+    for (const auto &str : strings) {
+        std::string phrase = str;
+        utils::stringReplace(phrase, "\"", "\"\"");
+
+        if (!res.empty()) res += " AND ";
+        res += (column.empty() ? "" : column + " : ") + "\"" + phrase + "\"";
+    }
+    return res;
+}
+
+// Rows of the full-text index that match a parameter
+std::string fullTextMatch(const std::string &rowid) {
+    return rowid + " IN (SELECT rowid FROM entries_fts WHERE entries_fts MATCH ?)";
+}
+
+// A path pattern ('*' matches anything) compiled into a predicate.
+// The literal prefix becomes a range on the case insensitive path index,
+// so SQLite only visits the rows that can match instead of scanning
+// the whole table; LIKE is left for what comes after the first wildcard.
+// Like LIKE, patterns ignore the case of ASCII letters.
+struct PathPredicate {
+    std::string sql;
+    std::vector<std::string> params;
+
+    // @param rowid if set, entries are first looked up in the full-text
+    //        index by this rowid column, using the literal parts of the
+    //        pattern that come after a wildcard (LIKE then checks them)
+    PathPredicate(const std::string &column, const std::string &pattern, const std::string &rowid = "") {
+        const auto wildcard = pattern.find('*');
+
+        if (wildcard == std::string::npos) {
+            sql = column + " = ? COLLATE NOCASE";
+            params.push_back(pattern);
+            return;
+        }
+
+        std::vector<std::string> terms;
+        const std::string prefix = pattern.substr(0, wildcard);
+
+        if (!prefix.empty()) {
+            terms.push_back(column + " >= ? COLLATE NOCASE");
+            params.push_back(prefix);
+
+            const auto upper = pathUpperBoundNoCase(prefix);
+            if (!upper.empty()) {
+                terms.push_back(column + " < ? COLLATE NOCASE");
+                params.push_back(upper);
+            }
+        }
+
+        // A trailing '*' is all covered by the range
+        if (wildcard != pattern.length() - 1) {
+            terms.push_back(column + " LIKE ? ESCAPE '/'");
+            params.push_back(sanitize_query_param(pattern));
+        }
+
+        if (!rowid.empty()) {
+            std::vector<std::string> substrings;
+            for (const auto &part : utils::split(pattern.substr(wildcard), "*")) {
+                if (utf8Length(part) >= FULL_TEXT_MIN_LENGTH) substrings.push_back(part);
+            }
+
+            if (!substrings.empty()) {
+                terms.push_back(fullTextMatch(rowid));
+                params.push_back(fullTextQuery(substrings, "path"));
+            }
+        }
+
+        sql = "1";
+        for (size_t i = 0; i < terms.size(); i++) {
+            sql = i == 0 ? terms[i] : sql + " AND " + terms[i];
+        }
+        if (terms.size() > 1) sql = "(" + sql + ")";
+    }
+
+    // The entries below folder, as a range on the path primary key.
+    // Unlike a pattern, the folder name is taken literally
+    static PathPredicate below(const std::string &column, const std::string &folder) {
+        PathPredicate res;
+        const std::string prefix = folder + "/";
+
+        res.sql = "(" + column + " >= ? AND " + column + " < ?)";
+        res.params.push_back(prefix);
+        res.params.push_back(pathUpperBound(prefix));
+        return res;
+    }
+
+    // An entry and, if it's a folder, everything below it
+    static PathPredicate subtree(const std::string &column, const std::string &path) {
+        PathPredicate res = below(column, path);
+
+        res.sql = "(" + column + " = ? OR " + res.sql + ")";
+        res.params.insert(res.params.begin(), path);
+        return res;
+    }
+
+    // @return the index of the next parameter
+    int bind(Statement *q, int first = 1) const {
+        for (const auto &p : params) q->bind(first++, p);
+        return first;
+    }
+
+private:
+    PathPredicate() = default;
+};
+
+SearchFilter SearchFilter::fromJSON(const json &j) {
+    SearchFilter f;
+    if (!j.is_object()) throw InvalidArgsException("Search filter must be a JSON object");
+
+    try {
+        if (j.contains("bbox")) f.bbox = j["bbox"].get<std::vector<double>>();
+        if (j.contains("intersects")) f.intersects = j["intersects"].get<std::string>();
+        if (j.contains("near")) f.near = j["near"].get<std::vector<double>>();
+        if (j.contains("nearCount")) f.nearCount = j["nearCount"].get<int>();
+
+        // Milliseconds or ISO 8601 dates
+        if (j.contains("captureTime")) {
+            for (const auto &t : j["captureTime"]) {
+                f.captureTime.push_back(t.is_string() ? parseTime(t.get<std::string>()) : t.get<double>());
+            }
+        }
+
+        if (j.contains("where")) f.where = j["where"].get<std::string>();
+        if (j.contains("text")) f.text = j["text"].get<std::string>();
+    } catch (const json::exception &e) {
+        throw InvalidArgsException(std::string("Invalid search filter: ") + e.what());
+    }
+
+    f.validate();
+    return f;
+}
+
+double SearchFilter::parseTime(const std::string &s) {
+    double millis = 0;
+    if (utils::iso8601ToMillis(s, millis)) return millis;
+
+    char *end = nullptr;
+    millis = std::strtod(s.c_str(), &end);
+    if (s.empty() || *end != '\0') throw InvalidArgsException("Invalid time: " + s);
+
+    return millis;
+}
+
+void SearchFilter::validate() const {
+    if (!bbox.empty()) {
+        if (bbox.size() != 4) throw InvalidArgsException("bbox must be minx,miny,maxx,maxy");
+        if (bbox[0] > bbox[2] || bbox[1] > bbox[3]) throw InvalidArgsException("bbox min cannot be greater than its max");
+    }
+
+    if (!near.empty()) {
+        if (near.size() != 2) throw InvalidArgsException("near must be lon,lat");
+        if (near[1] < -90 || near[1] > 90) throw InvalidArgsException("near latitude must be between -90 and 90");
+        if (nearCount <= 0) throw InvalidArgsException("nearCount must be positive");
+    }
+
+    if (!captureTime.empty()) {
+        if (captureTime.size() != 2) throw InvalidArgsException("captureTime must be from,to");
+        if (captureTime[0] > captureTime[1]) throw InvalidArgsException("captureTime start cannot be after its end");
+    }
+
+    if (!where.empty()) FilterExpression check(where);
+}
+
+// A SearchFilter compiled into SQL. Spatial candidates are looked up
+// in the R*Tree indexes that SpatiaLite keeps for the geometry columns
+// and then checked against the actual geometries, capture times
+// are a range on their own index and text is looked up in the
+// full-text index when possible. The where expression comes last.
+class SearchPredicate {
+    struct Param {
+        bool isText;
+        double number;
+        std::string text;
+    };
+    std::vector<Param> params;
+    std::vector<Param> orderParams;
+    std::unique_ptr<FilterExpression> expression;
+
+    void add(double v) { params.push_back({false, v, ""}); }
+    void add(const std::string &v) { params.push_back({true, 0, v}); }
+
+    // Rows of column whose bounding box overlaps the given one
+    std::string mbrSearch(const std::string &column, double minx, double miny, double maxx, double maxy) {
+        add(maxx);
+        add(minx);
+        add(maxy);
+        add(miny);
+        return "e.rowid IN (SELECT pkid FROM idx_entries_" + column +
+               " WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?)";
+    }
+
+    // Entries with a point or polygon that intersects geometry
+    // (an SQL expression taking a single text parameter)
+    std::string intersects(const std::string &geometry, const std::string &param, const std::vector<double> &mbr) {
+        std::string res = "(";
+        for (const std::string column : {"point_geom", "polygon_geom"}) {
+            if (column != "point_geom") res += " OR ";
+            res += "(" + mbrSearch(column, mbr[0], mbr[1], mbr[2], mbr[3]) +
+                   " AND Intersects(e." + column + ", " + geometry + ") = 1)";
+            add(param);
+        }
+        return res + ")";
+    }
+
+    static std::string wktPolygon(const std::vector<double> &b) {
+        auto p = [](double x, double y) { return utils::toStr(x, 10) + " " + utils::toStr(y, 10); };
+        return "POLYGON((" + p(b[0], b[1]) + ", " + p(b[2], b[1]) + ", " + p(b[2], b[3]) + ", " +
+               p(b[0], b[3]) + ", " + p(b[0], b[1]) + "))";
+    }
+
+    static int bindParams(Statement *q, int first, const std::vector<Param> &params) {
+        for (const auto &p : params) {
+            if (p.isText) q->bind(first++, p.text);
+            else q->bind(first++, p.number);
+        }
+        return first;
+    }
+
+   public:
+    std::string sql;
+    std::string orderBy;
+
+    // @param nearRadius half size (in degrees of latitude) of the box searched
+    //        for the entries near a location
+    SearchPredicate(Database *db, const SearchFilter &filter, double nearRadius = 0) {
+        std::vector<std::string> terms;
+
+        if (!filter.bbox.empty()) {
+            terms.push_back(intersects("GeomFromText(?, 4326)", wktPolygon(filter.bbox), filter.bbox));
+        }
+
+        if (!filter.intersects.empty()) {
+            auto q = db->query("SELECT g IS NULL, MbrMinX(g), MbrMinY(g), MbrMaxX(g), MbrMaxY(g) "
+                               "FROM (SELECT GeomFromText(?, 4326) AS g)");
+            q->bind(1, filter.intersects);
+            if (!q->fetch() || q->getInt(0) == 1)
+                throw InvalidArgsException("Invalid WKT geometry: " + filter.intersects);
+
+            const std::vector<double> mbr = {q->getDouble(1), q->getDouble(2), q->getDouble(3), q->getDouble(4)};
+            terms.push_back(intersects("GeomFromText(?, 4326)", filter.intersects, mbr));
+        }
+
+        if (!filter.captureTime.empty()) {
+            terms.push_back("e.capture_time BETWEEN ? AND ?");
+            add(filter.captureTime[0]);
+            add(filter.captureTime[1]);
+        }
+
+        if (!filter.near.empty()) {
+            const double lon = filter.near[0];
+            const double lat = filter.near[1];
+
+            // Distances are compared on a plane where a degree of longitude
+            // is as long as at the searched latitude
+            const double scale = std::max(std::cos(utils::deg2rad(lat)), 0.01);
+            const double lonRadius = nearRadius / scale;
+
+            terms.push_back(mbrSearch("point_geom", lon - lonRadius, lat - nearRadius,
+                                      lon + lonRadius, lat + nearRadius));
+
+            orderBy = "(X(e.point_geom) - ?) * (X(e.point_geom) - ?) * ? + "
+                      "(Y(e.point_geom) - ?) * (Y(e.point_geom) - ?), ";
+            for (double v : {lon, lon, scale * scale, lat, lat}) orderParams.push_back({false, v, ""});
+        }
+
+        if (!filter.text.empty()) {
+            std::vector<std::string> indexed;
+
+            for (const auto &word : utils::split(filter.text, " ")) {
+                if (word.empty()) continue;
+
+                if (db->hasFullTextIndex() && utf8Length(word) >= FULL_TEXT_MIN_LENGTH) {
+                    indexed.push_back(word);
+                } else {
+                    terms.push_back("(e.path LIKE ? ESCAPE '/' OR EXISTS (SELECT 1 FROM entries_text_meta m "
+                                    "WHERE m.path = e.path AND m.meta LIKE ? ESCAPE '/'))");
+                    add(sanitize_query_param("*" + word + "*"));
+                    add(sanitize_query_param("*" + word + "*"));
+                }
+            }
+
+            if (!indexed.empty()) {
+                terms.push_back(fullTextMatch("e.rowid"));
+                add(fullTextQuery(indexed));
+            }
+        }
+
+        if (!filter.where.empty()) {
+            expression = std::make_unique<FilterExpression>(filter.where);
+            terms.push_back(expression->sql);
+        }
+
+        for (size_t i = 0; i < terms.size(); i++) {
+            sql += (i == 0 ? "" : " AND ") + terms[i];
+        }
+    }
+
+    // Binds the parameters of sql, then the ones of orderBy
+    // @return the index of the next parameter
+    int bind(Statement *q, int first) const {
+        first = bindParams(q, first, params);
+        if (expression) first = expression->bind(q, first);
+        return bindParams(q, first, orderParams);
+    }
+};
+
+// Columns read by listings, in the order expected by entryFromRow.
+// Without details only the path, hash and type are read.
+std::string entryColumns(bool details) {
+    if (!details) return "e.path, e.hash, e.type";
+
+    return R"<<<(
+        e.path, e.hash, e.type, e.properties, e.mtime, e.size, e.depth,
+        json_extract(AsGeoJSON(e.point_geom), '$.coordinates'), json_extract(AsGeoJSON(e.polygon_geom), '$.coordinates'),
+        CASE
+            WHEN EXISTS (SELECT 1 FROM entries_meta WHERE path = e.path) THEN (
+                SELECT json_group_object(key, meta)
+                FROM (
+                    SELECT key, CASE WHEN substr(key, -1, 1) = 's'
+                                    THEN json_group_array(json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime))
+                                    ELSE json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime)
+                                END AS meta
+                    FROM entries_meta emi
+                    WHERE path = e.path
+                    GROUP BY key
+                )
+            )
+        END AS meta
+    )<<<";
+}
+
+Entry entryFromRow(Statement *q) {
+    return Entry(q->getText(0), q->getText(1), q->getInt(2), q->getText(3),
+                 q->getInt64(4), q->getInt64(5), q->getInt(6),
+                 q->getText(7), q->getText(8),
+                 q->getText(9));
+}
+
+// Entries matching a path pattern, sorted by path
+// @param filter optional, folders are not subject to it
+std::unique_ptr<Statement> matchingEntriesQuery(Database *db, const std::string &pattern,
+                                                int maxRecursionDepth, bool details,
+                                                const SearchPredicate *filter = nullptr) {
+    // 0 is ALL_DEPTHS
+    if (maxRecursionDepth < 0)
+        throw FSException("Max recursion depth cannot be negative");
+
+    const PathPredicate where("e.path", pattern, db->hasFullTextIndex() ? "e.rowid" : "");
+
+    LOGD << "Predicate: " << where.sql;
+
+    std::string sql = "SELECT " + entryColumns(details) + " FROM entries e WHERE " + where.sql;
+
+    if (maxRecursionDepth > 0)
+        sql += " AND e.depth <= " + std::to_string(maxRecursionDepth - 1);
+
+    if (filter != nullptr && !filter->sql.empty())
+        sql += " AND (e.type = " + std::to_string(Directory) + " OR (" + filter->sql + "))";
+
+    sql += " ORDER BY e.path";
+
+    auto q = db->query(sql);
+    const int next = where.bind(q.get());
+    if (filter != nullptr) filter->bind(q.get(), next);
+
+    return q;
+}
+
+void forEachMatchingEntry(Database *db, const fs::path &path, const EntryCallback &cb,
+                          int maxRecursionDepth, bool isFolder) {
+    const auto query = path.string();
+
+    LOGD << "Query: " << query;
+
+    std::string pattern = query.empty() ? "*" : query;
+    if (isFolder) pattern += "/*";
+
+    auto q = matchingEntriesQuery(db, pattern, maxRecursionDepth, true);
+
+    while (q->fetch()) {
+        if (!cb(entryFromRow(q.get()))) break;
+    }
+
+    q->reset();
+}
+
+std::vector<Entry> getMatchingEntries(Database *db, const fs::path &path,
+                                      int maxRecursionDepth, bool isFolder) {
+    std::vector<Entry> entries;
+
+    forEachMatchingEntry(db, path, [&entries](const Entry &e) {
+        entries.push_back(e);
+        return true;
+    }, maxRecursionDepth, isFolder);
+
+    return entries;
+}
+
+// Writes rows in the ddb ls / ddb search formats as they are fetched
+class EntryWriter {
+    std::ostream &out;
+    bool isJson;
+    bool first = true;
+
+   public:
+    EntryWriter(std::ostream &out, const std::string &format) : out(out), isJson(format == "json") {
+        if (isJson) out << "[";
+    }
+
+    void write(Statement *q) {
+        if (!isJson) {
+            out << q->getTextView(0) << "\n";
+            return;
+        }
+
+        json j;
+        entryFromRow(q).toJSON(j);
+        if (!first) out << ",";
+        out << j.dump();
+        first = false;
+    }
+
+    void close() {
+        if (isJson) out << "]";
+        out.flush();
+    }
+};
+
+// Streams the rows of a listing in path order. The requested entries are
+// read with one query, and the contents of each folder to expand are merged
+// in as the scan reaches them, so nothing is buffered besides the open cursors.
+// Rows are only read for all the columns when details is set.
+void listIndexRows(Database *db, const std::vector<std::string> &paths, bool recursive,
+                   int maxRecursionDepth, const SearchFilter &filter, bool details,
+                   const std::function<bool(Statement *)> &cb) {
+    if (!filter.near.empty()) throw InvalidArgsException("Listings cannot be filtered by distance");
+    filter.validate();
+    const SearchPredicate restrict(db, filter);
 
     const fs::path directory = db->rootDirectory();
     std::vector<fs::path> pathList;
@@ -288,8 +965,9 @@ void listIndex(Database* db, const std::vector<std::string>& paths, std::ostream
         pathList.emplace_back(root.isParentOf(fs::current_path()) ? io::Path(currentPath).generic() : directory.string());
     }else pathList = std::vector<fs::path>(paths.begin(), paths.end());
 
-    std::vector<Entry> baseEntries;
     bool expandFolders = recursive;
+    std::vector<PathPredicate> predicates;
+    std::string where;
 
     for (const fs::path& path : pathList) {
         io::Path relPath = io::Path(path).relativeTo(directory);
@@ -300,116 +978,332 @@ void listIndex(Database* db, const std::vector<std::string>& paths, std::ostream
         expandFolders = expandFolders || pathStr.length() > 0;
 
         const auto depth = static_cast<int>(count(pathStr.begin(), pathStr.end(), '/'));
-        std::vector<Entry> matches = getMatchingEntries(db, relPath.generic(), depth + 1);
-        baseEntries.insert(baseEntries.end(), matches.begin(), matches.end());
-    }
-
-    // Remove duplicates
-    sort(baseEntries.begin(), baseEntries.end(), [](const Entry& l, const Entry& r)
-        {
-            return l.path < r.path;
-        });
-    baseEntries.erase(unique(baseEntries.begin(), baseEntries.end(), [](const Entry& l, const Entry& r)
-        {
-            return l.path == r.path;
-        }), baseEntries.end());
+        predicates.emplace_back("e.path", pathStr.empty() ? "*" : pathStr);
 
-    // Sort by type
-    sort(baseEntries.begin(), baseEntries.end(), [](const Entry& l, const Entry& r)
-        {
-            return l.type < r.type;
-        });
+        if (!where.empty()) where += " OR ";
+        where += "(" + predicates.back().sql + " AND e.depth <= " + std::to_string(depth) + ")";
+    }
 
-    const bool isSingle = pathList.size() == baseEntries.size();
+    if (!restrict.sql.empty())
+        where = "(" + where + ") AND (e.type = " + std::to_string(Directory) + " OR (" + restrict.sql + "))";
+
+    auto bindAll = [&predicates, &restrict](Statement *q) {
+        int param = 1;
+        for (const auto &p : predicates) param = p.bind(q, param);
+        restrict.bind(q, param);
+    };
+
+    auto countQ = db->query("SELECT COUNT(*) FROM entries e WHERE " + where);
+    bindAll(countQ.get());
+    countQ->fetch();
+    const bool isSingle = pathList.size() == static_cast<size_t>(countQ->getInt64(0));
+    countQ->reset();
+
+    auto base = db->query("SELECT " + entryColumns(details) + " FROM entries e WHERE " + where + " ORDER BY e.path");
+    bindAll(base.get());
+
+    // Folder contents sort after "folder/", which can come after
+    // some of the folder's siblings (e.g. "a.txt" < "a/b.txt")
+    struct Expansion {
+        std::string key;
+        int maxDepth;
+    };
+    auto expansionOrder = [](const Expansion &l, const Expansion &r) { return l.key > r.key; };
+    std::vector<Expansion> expansions;
+
+    struct Cursor {
+        std::unique_ptr<Statement> q;
+        std::string path;
+    };
+    auto cursorOrder = [](const std::unique_ptr<Cursor> &l, const std::unique_ptr<Cursor> &r) {
+        return l->path > r->path;
+    };
+    std::vector<std::unique_ptr<Cursor>> cursors;
+
+    bool hasBase = base->fetch();
+    std::string basePath;
+    if (hasBase) basePath = base->getTextView(0);
+
+    while (hasBase || !expansions.empty() || !cursors.empty()) {
+        const bool expand = !expansions.empty() &&
+            (!hasBase || expansions.front().key <= basePath) &&
+            (cursors.empty() || expansions.front().key <= cursors.front()->path);
+
+        if (expand) {
+            std::pop_heap(expansions.begin(), expansions.end(), expansionOrder);
+            const auto e = expansions.back();
+            expansions.pop_back();
+
+            auto c = std::make_unique<Cursor>();
+            c->q = matchingEntriesQuery(db, e.key + "*", e.maxDepth, details, &restrict);
+            if (c->q->fetch()) {
+                c->path = c->q->getTextView(0);
+                cursors.push_back(std::move(c));
+                std::push_heap(cursors.begin(), cursors.end(), cursorOrder);
+            }
+        } else if (hasBase && (cursors.empty() || basePath <= cursors.front()->path)) {
+            if (base->getInt(2) != Directory || !isSingle || !expandFolders) {
+                if (!cb(base.get())) return;
+            }
 
-    std::vector<Entry> outputEntries;
+            if (base->getInt(2) == Directory && expandFolders) {
+                const int depth = static_cast<int>(count(basePath.begin(), basePath.end(), '/'));
+                expansions.push_back({basePath + "/", recursive ? maxRecursionDepth : depth + 2});
+                std::push_heap(expansions.begin(), expansions.end(), expansionOrder);
+            }
 
-    for (const Entry& entry : baseEntries) {
-        if (entry.type != Directory) outputEntries.emplace_back(Entry(entry));
-        else {
-            if (!isSingle || !expandFolders)
-                outputEntries.emplace_back(Entry(entry));
+            hasBase = base->fetch();
+            if (hasBase) basePath = base->getTextView(0);
+        } else {
+            std::pop_heap(cursors.begin(), cursors.end(), cursorOrder);
+            auto &c = cursors.back();
+            if (!cb(c->q.get())) return;
 
-            if (expandFolders) {
-                const auto depth = recursive ? maxRecursionDepth : entry.depth + 2;
-                std::vector<Entry> entries = getMatchingEntries(db, entry.path, depth, true);
-                for (const Entry& e : entries) outputEntries.emplace_back(Entry(e));
+            if (c->q->fetch()) {
+                c->path = c->q->getTextView(0);
+                std::push_heap(cursors.begin(), cursors.end(), cursorOrder);
+            } else {
+                cursors.pop_back();
             }
         }
     }
+}
 
-    // Sort by path
-    std::sort(outputEntries.begin(), outputEntries.end(), [](const Entry& l, const Entry& r)
-        {
-            return l.path < r.path;
-        });
+void listIndex(Database* db, const std::vector<std::string>& paths, std::ostream& output, const std::string& format, bool recursive, int maxRecursionDepth, const SearchFilter &filter) {
+    if (format != "json" && format != "text") throw InvalidArgsException("Invalid format " + format);
 
-    if (format == "text"){
-        for (auto& e : outputEntries){
-            output << e.path << std::endl;
-        }
-    }else if (format == "json"){
-        output << "[";
-        bool first = true;
+    EntryWriter writer(output, format);
+    listIndexRows(db, paths, recursive, maxRecursionDepth, filter, format == "json", [&writer](Statement *q) {
+        writer.write(q);
+        return true;
+    });
+    writer.close();
+}
 
-        for (auto& e : outputEntries){
+void listIndex(Database* db, const std::vector<std::string>& paths, const EntryCallback &cb, bool recursive, int maxRecursionDepth, const SearchFilter &filter) {
+    listIndexRows(db, paths, recursive, maxRecursionDepth, filter, true, [&cb](Statement *q) {
+        return cb(entryFromRow(q));
+    });
+}
 
-            json j;
-            e.toJSON(j);
-            if (!first) output << ",";
-            output << j.dump();
+// Size of the box around filter.near that contains at least
+// filter.nearCount matching entries (or the whole world)
+double nearSearchRadius(Database *db, const PathPredicate &where, const SearchFilter &filter) {
+    double radius = 0.0005;
 
-            first = false;
-        }
+    for (;;) {
+        const SearchPredicate spatial(db, filter, radius);
+        auto q = db->query("SELECT COUNT(*) FROM entries e WHERE " + where.sql + " AND " + spatial.sql);
+        spatial.bind(q.get(), where.bind(q.get()));
+        q->fetch();
 
-        output << "]";
-    }else{
-        throw InvalidArgsException("Unsupported format '" + format + "'");
+        if (q->getInt64(0) >= filter.nearCount || radius >= 360) break;
+        radius *= 4;
     }
+
+    // The nearest entries found in the box can be as far as its corners,
+    // closer ones might be just outside of it
+    return radius * std::sqrt(2.0);
 }
 
+void searchIndex(Database* db, const std::string &query, std::ostream& out, const std::string& format, const SearchFilter &filter){
+    if (format != "json" && format != "text") return;
 
-void searchIndex(Database* db, const std::string &query, std::ostream& out, const std::string& format){
-    auto entries = getMatchingEntries(db, query, 0, false);
-    std::sort(entries.begin(), entries.end(), [](const Entry& l, const Entry& r)
-        {
-            return l.path < r.path;
-        });
+    filter.validate();
+
+    const PathPredicate where("e.path", query.empty() ? "*" : query, db->hasFullTextIndex() ? "e.rowid" : "");
+    const double nearRadius = filter.near.empty() ? 0 : nearSearchRadius(db, where, filter);
+    const SearchPredicate spatial(db, filter, nearRadius);
+
+    std::string sql = "SELECT " + entryColumns(format == "json") + " FROM entries e WHERE " + where.sql;
+    if (!spatial.sql.empty()) sql += " AND " + spatial.sql;
+    sql += " ORDER BY " + spatial.orderBy + "e.path";
+    if (!filter.near.empty()) sql += " LIMIT " + std::to_string(filter.nearCount);
+
+    auto q = db->query(sql);
+    spatial.bind(q.get(), where.bind(q.get()));
 
-    if (format == "text"){
-        for (auto& e : entries) out << e.path << std::endl;
-    }else if (format == "json"){
-        out << "[";
-        bool first = true;
-        for (auto& e : entries){
-            json j;
-            e.toJSON(j);
-            if (!first) out << ",";
-            out << j.dump();
-            first = false;
+    EntryWriter writer(out, format);
+    while (q->fetch()) writer.write(q.get());
+    writer.close();
+
+    q->reset();
+}
+
+// Setting up a BatchFileReader (io_uring, buffers) is not cheap, so the
+// jobs of a run share them: a job takes a free reader or makes a new one,
+// which makes at most one per worker
+class BatchFileReaderPool {
+    std::mutex mtx;
+    std::vector<std::unique_ptr<BatchFileReader>> readers;
+
+   public:
+    std::unique_ptr<BatchFileReader> acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!readers.empty()) {
+                auto reader = std::move(readers.back());
+                readers.pop_back();
+                return reader;
+            }
         }
-        out << "]";
+        return std::make_unique<BatchFileReader>();
     }
-}
 
+    void release(std::unique_ptr<BatchFileReader> reader) {
+        std::lock_guard<std::mutex> lock(mtx);
+        readers.push_back(std::move(reader));
+    }
+};
 
 void addToIndex(Database *db, const std::vector<std::string> &paths,
-                AddCallback callback) {
+                AddCallback callback, int threads) {
     if (paths.empty()) return;  // Nothing to do
     const fs::path directory = db->rootDirectory();
-    auto pathList = getIndexPathList(directory, paths, true);
-
-    auto q = db->query("SELECT mtime,hash FROM entries WHERE path=?");
-    auto insertQ = db->query(
-        "INSERT INTO entries (path, hash, type, properties, mtime, size, depth, "
-        "point_geom, polygon_geom) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, GeomFromText(?, 4326), GeomFromText(?, "
-        "4326))");
+
+    // Before any statement, which must be finalized by the time it ends
+    BulkLoad bulkLoad(db);
+
+    auto q = db->query("SELECT mtime,hash,size,quick_hash,blake3 FROM entries WHERE path=?");
+    // New entries are inserted several rows at a time,
+    // with one statement per number of rows
+    std::vector<std::unique_ptr<Statement>> insertQs(INSERT_MAX_ROWS + 1);
+    auto insertQuery = [db, &insertQs](size_t rows) {
+        auto &insertQ = insertQs[rows];
+        if (insertQ == nullptr) {
+            std::string sql = INSERT_QUERY INSERT_QUERY_ROW;
+            for (size_t i = 1; i < rows; i++) sql += ", " INSERT_QUERY_ROW;
+            insertQ = db->query(sql + INSERT_QUERY_UPSERT);
+        }
+        return insertQ.get();
+    };
     const auto updateQ = db->query(UPDATE_QUERY);
-    db->exec("BEGIN EXCLUSIVE TRANSACTION");
+    const auto touchQ = db->query(TOUCH_QUERY);
 
-    for (auto &p : pathList) {
-        io::Path relPath = io::Path(p).relativeTo(directory);
+    // Hashing and parsing happen on the worker threads, while
+    // this thread is the only one that touches the database
+    struct ParsedEntry {
+        Entry e;
+        bool add = false;
+        bool update = false;
+        bool touch = false;
+    };
+
+    typedef std::vector<ParsedEntry> ParsedEntries;
+
+    // Used by the jobs, so it must outlive the queue
+    BatchFileReaderPool readers;
+    OrderedWorkQueue<ParsedEntries> queue(threads);
+    const size_t window = queue.concurrency() * 4;
+
+    // Brand new small files (sidecars, tiles, ...) are handed to the
+    // workers in groups, so that they can be read with a single
+    // BatchFileReader call. Everything else is a job of its own.
+    const size_t groupSize = 64;
+    std::vector<WalkEntry> smallFiles;
+
+    auto pushSmallFiles = [&queue, &smallFiles, &readers, &directory]() {
+        if (smallFiles.empty()) return;
+
+        queue.push([files = std::move(smallFiles), &readers, &directory]() {
+            ParsedEntries rs(files.size());
+
+            std::vector<std::string> filePaths;
+            filePaths.reserve(files.size());
+            for (const auto &f : files) filePaths.push_back(f.path.string());
+
+            // Hash from memory, parseEntry
+            // takes care of anything that was skipped
+            auto reader = readers.acquire();
+            reader->read(filePaths, [&rs](size_t i, const char *data, size_t size) {
+                rs[i].e.hash = Hash::dataSHA256(data, size);
+                rs[i].e.quickHash = Hash::dataQuickHash(data, size);
+            });
+            readers.release(std::move(reader));
+
+            for (size_t i = 0; i < files.size(); i++) {
+                rs[i].add = true;
+                rs[i].e.mtime = files[i].mtime;
+                parseEntry(files[i].path, directory, rs[i].e, true);
+            }
+
+            return rs;
+        });
+        smallFiles.clear();
+    };
+
+    // Writes are committed in short batches, so parsing never
+    // happens while the database is locked
+    TransactionBatch batch(db);
+
+    // Writes results until at most maxPending jobs are left
+    // @return false if the callback cancelled the operation
+    auto writeResults = [&](size_t maxPending) {
+        while (queue.pending() > maxPending) {
+            auto rs = std::make_shared<ParsedEntries>(queue.pop());
+            std::vector<size_t> added;
+
+            for (size_t i = 0; i < rs->size(); i++) {
+                const ParsedEntry &r = (*rs)[i];
+
+                if (r.touch) {
+                    batch.add([rs, i, &touchQ]() {
+                        const Entry &e = (*rs)[i].e;
+                        touchQ->bind(1, static_cast<long long>(e.mtime));
+                        touchQ->bind(2, e.quickHash);
+                        touchQ->bind(3, e.path);
+                        touchQ->execute();
+                        return true;
+                    });
+                } else if (r.add) {
+                    added.push_back(i);
+                } else if (r.update) {
+                    const bool proceed = batch.add([rs, i, &updateQ, &callback]() {
+                        const Entry &e = (*rs)[i].e;
+                        doUpdate(updateQ.get(), e);
+
+                        if (callback != nullptr)
+                            return callback(e, true);
+                        return true;
+                    });
+
+                    if (!proceed) return false;  // cancel
+                }
+            }
+
+            if (added.empty()) continue;
+
+            const bool proceed = batch.add([rs, added = std::move(added), &insertQuery, &callback]() {
+                // Entries are reported before being inserted, so that
+                // nothing past a cancelled callback is written
+                size_t count = 0;
+                bool proceed = true;
+                while (count < added.size() && proceed) {
+                    if (callback != nullptr) proceed = callback((*rs)[added[count]].e, false);
+                    count++;
+                }
+
+                for (size_t first = 0; first < count; first += INSERT_MAX_ROWS) {
+                    const size_t rows = std::min<size_t>(INSERT_MAX_ROWS, count - first);
+                    Statement *insertQ = insertQuery(rows);
+                    for (size_t k = 0; k < rows; k++)
+                        bindInsert(insertQ, static_cast<int>(k), (*rs)[added[first + k]].e);
+                    insertQ->execute();
+                }
+
+                return proceed;
+            });
+
+            if (!proceed) return false;  // cancel
+        }
+
+        return true;
+    };
+
+    // Paths are processed as the walk finds them
+    bool cancelled = false;
+    walkIndexPathList(directory, paths, true, [&](const WalkEntry &we) {
+        const fs::path &p = we.path;
 
         if (p.has_filename()) {
             const auto fileName = p.filename().generic_string();
@@ -418,54 +1312,69 @@ void addToIndex(Database *db, const std::vector<std::string> &paths,
                 LOGD << "Skipping '" << p << "'";
 
                 // Skip file
-                continue;
+                return true;
             }
         }
 
+        io::Path relPath = io::Path(p).relativeTo(directory);
         q->bind(1, relPath.generic());
 
-        bool update = false;
-        bool add = false;
-        Entry e;
-
-        if (q->fetch()) {
-
-            const auto status = checkUpdate(e, p, q->getInt64(0), q->getText(1));
+        const bool exists = q->fetch();
+        const long long dbMtime = exists ? q->getInt64(0) : 0;
+        const std::string dbHash = exists ? q->getText(1) : "";
+        const std::uintmax_t dbSize = exists ? q->getInt64(2) : 0;
+        const std::string dbQuickHash = exists ? q->getText(3) : "";
+        const std::string dbBlake3 = exists ? q->getText(4) : "";
+        const std::string relPathStr = relPath.generic();
+        q->reset();
 
-            // Entry exist, update if necessary
-            update = status != FileStatus::NotModified;
+        if (!exists && !we.directory && we.size <= BATCH_READ_MAX_FILE_SIZE) {
+            smallFiles.push_back(we);
+            if (smallFiles.size() >= groupSize) pushSmallFiles();
         } else {
-            // Brand new, add
-            add = true;
-        }
-
-        if (add || update) {
-            parseEntry(p, directory, e, true);
+            // Preserve the order of the results
+            pushSmallFiles();
+
+            queue.push([p, &directory, exists, dbMtime, dbHash, dbSize, dbQuickHash, dbBlake3, relPathStr]() {
+                ParsedEntries rs(1);
+                ParsedEntry &r = rs[0];
+
+                if (exists) {
+                    // Entry exist, update if necessary
+                    const auto status = checkUpdate(r.e, p, dbMtime, dbHash, dbSize, dbQuickHash, dbBlake3);
+                    r.update = status != FileStatus::NotModified;
+
+                    // Contents are the same, but the modified time is not
+                    // (folders are never checked and have no mtime set)
+                    r.touch = !r.update && r.e.mtime != 0 && r.e.mtime != dbMtime;
+                    r.e.path = relPathStr;
+                } else {
+                    // Brand new, add
+                    r.add = true;
+                }
 
-            if (add) {
-                insertQ->bind(1, e.path);
-                insertQ->bind(2, e.hash);
-                insertQ->bind(3, e.type);
-                insertQ->bind(4, e.properties.dump());
-                insertQ->bind(5, static_cast<long long>(e.mtime));
-                insertQ->bind(6, static_cast<long long>(e.size));
-                insertQ->bind(7, e.depth);
-                insertQ->bind(8, e.point_geom.toWkt());
-                insertQ->bind(9, e.polygon_geom.toWkt());
+                if (r.add || r.update) parseEntry(p, directory, r.e, true);
 
-                insertQ->execute();
-            } else {
-                doUpdate(updateQ.get(), e);
-            }
+                return rs;
+            });
+        }
 
-            if (callback != nullptr)
-                if (!callback(e, !add)) return;  // cancel
+        if (!writeResults(window)) {
+            cancelled = true;
+            return false;
         }
 
-        q->reset();
+        return true;
+    });
+
+    if (!cancelled) {
+        pushSmallFiles();
+        if (writeResults(0)) batch.flush();
     }
 
-    db->exec("COMMIT");
+    // Checksums are computed with the indexes in place
+    bulkLoad.end();
+    db->updateChecksums();
 }
 
 void removeFromIndex(Database *db, const std::vector<std::string> &paths, RemoveCallback callback) {
@@ -506,18 +1415,6 @@ void removeFromIndex(Database *db, const std::vector<std::string> &paths, Remove
     }
 }
 
-std::string sanitize_query_param(const std::string &str) {
-    std::string res(str);
-
-    // TAKES INTO ACCOUNT PATHS THAT CONTAINS EVERY SORT OF STUFF
-    utils::stringReplace(res, "/", "//");
-    utils::stringReplace(res, "%", "/%");
-    //utils::stringReplace(res, "_", "/_");
-    utils::stringReplace(res, "*", "%");
-
-    return res;
-}
-
 void checkDeleteBuild(Database *db, const std::string &hash){
     if (!hash.empty()){
         const auto buildFolder = db->buildDirectory() / hash;
@@ -531,31 +1428,22 @@ void checkDeleteBuild(Database *db, const std::string &hash){
 
 void checkDeleteMeta(Database *db, const std::string &path){
     if (!path.empty()){
-        auto q = db->query("DELETE FROM entries_meta WHERE path = ?");
+        auto q = db->cachedQuery("DELETE FROM entries_meta WHERE path = ?");
         q->bind(1, path);
         q->execute();
     }
 }
 
-int deleteFromIndex(Database *db, const std::string &query, bool isFolder, RemoveCallback callback) {
-
-    LOGD << "Query: " << query;
-
-    auto str = sanitize_query_param(query);
+// Removes the entries that match where
+int deleteMatching(Database *db, const PathPredicate &where, RemoveCallback callback) {
 
-    LOGD << "Sanitized: " << str;
-
-    if (isFolder) {
-        str += "//%";
-        LOGD << "Folder: " << str;
-    }
+    LOGD << "Predicate: " << where.sql;
 
     db->exec("BEGIN EXCLUSIVE TRANSACTION");
 
-    auto q = db->query(
-        "SELECT path, hash FROM entries WHERE path LIKE ? ESCAPE '/'");
+    auto q = db->query("SELECT path, hash FROM entries WHERE " + where.sql);
 
-    q->bind(1, str);
+    where.bind(q.get());
 
     int count = 0;
 
@@ -579,130 +1467,231 @@ int deleteFromIndex(Database *db, const std::string &query, bool isFolder, Remov
     q->reset();
 
     if (count > 0) {
-        q = db->query("DELETE FROM entries WHERE path LIKE ? ESCAPE '/'");
+        q = db->query("DELETE FROM entries WHERE " + where.sql);
 
-        q->bind(1, str);
+        where.bind(q.get());
         q->execute();
 
         q->reset();
     }
 
+    db->updateChecksums();
     db->exec("COMMIT");
 
     return count;
 }
 
-std::vector<Entry> getMatchingEntries(Database *db, const fs::path &path,
-                                      int maxRecursionDepth, bool isFolder) {
-    // 0 is ALL_DEPTHS
-    if (maxRecursionDepth < 0)
-        throw FSException("Max recursion depth cannot be negative");
-
-    const auto query = path.string();
+int deleteFromIndex(Database *db, const std::string &query, bool isFolder, RemoveCallback callback) {
 
     LOGD << "Query: " << query;
 
-    auto sanitized = sanitize_query_param(query);
-
-    if (sanitized.length() == 0) sanitized = "%";
+    return deleteMatching(db, PathPredicate("path", isFolder ? query + "/*" : query), callback);
+}
 
-    LOGD << "Sanitized: " << sanitized;
+int deletePathFromIndex(Database *db, const std::string &path, RemoveCallback callback) {
 
-    if (isFolder) {
-        sanitized += "//%";
+    LOGD << "Path: " << path;
 
-        LOGD << "Folder: " << sanitized;
-    }
+    return deleteMatching(db, PathPredicate::subtree("path", path), callback);
+}
 
-    std::string sql = R"<<<(
-        SELECT e.path, e.hash, e.type, e.properties, e.mtime, e.size, e.depth,
-        json_extract(AsGeoJSON(e.point_geom), '$.coordinates'), json_extract(AsGeoJSON(e.polygon_geom), '$.coordinates'),
-        CASE
-            WHEN em.id IS NULL THEN NULL
-            WHEN em.id IS NOT NULL THEN (
-                SELECT json_group_object(key, meta)
-                FROM (
-                    SELECT key, CASE WHEN substr(key, -1, 1) = 's'
-                                    THEN json_group_array(json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime))
-                                    ELSE json_object('id', emi.id, 'data', json(emi.data), 'mtime', emi.mtime)
-                                END AS meta
-                    FROM entries_meta emi
-                    WHERE path = e.path
-                    GROUP BY key
-                )
-            )
-        END AS meta
-        FROM entries e
-        LEFT JOIN entries_meta em
-        ON e.path = em.path
-        WHERE
-        e.path LIKE ? ESCAPE '/'
-    )<<<";
+double SyncStats::filesPerSecond() const {
+    return seconds > 0 ? static_cast<double>(files) / seconds : 0;
+}
 
-    if (maxRecursionDepth > 0)
-        sql += " AND e.depth <= " + std::to_string(maxRecursionDepth - 1);
+double SyncStats::bytesHashedPerSecond() const {
+    return seconds > 0 ? static_cast<double>(bytesHashed) / seconds : 0;
+}
 
-    auto q = db->query(sql);
+void SyncStats::toJSON(json &j) const {
+    j["files"] = files;
+    j["deleted"] = deleted;
+    j["updated"] = updated;
+    j["touched"] = touched;
+    j["bytesHashed"] = bytesHashed;
+    j["seconds"] = seconds;
+    j["filesPerSecond"] = filesPerSecond();
+    j["bytesHashedPerSecond"] = bytesHashedPerSecond();
+}
 
-    std::vector<Entry> entries;
+// Checks every entry of the index against the filesystem. The index is
+// read one page at a time and split in groups of files: stat calls,
+// hashing and parsing of each group run on the worker threads, while
+// this thread writes the results in batches.
+SyncStats syncIndex(Database *db, SyncCallback callback, int threads) {
+    const auto start = std::chrono::steady_clock::now();
+    const fs::path directory = db->rootDirectory();
+    BulkLoad bulkLoad(db);
+
+    struct IndexedFile {
+        std::string path;
+        long long mtime;
+        std::string hash;
+        std::uintmax_t size;
+        std::string quickHash;
+        std::string blake3;
+    };
+
+    struct CheckedGroup {
+        std::vector<IndexedFile> deleted;
+        std::vector<Entry> updated;
+        std::vector<Entry> touched;
+        std::uintmax_t bytesHashed = 0;
+    };
+
+    // Pages are read with a fresh query each time, so that we
+    // don't keep a statement open while committing batches
+    auto pageQ = db->query("SELECT path,mtime,hash,size,quick_hash,blake3 FROM entries "
+                           "WHERE path > ? ORDER BY path LIMIT " + std::to_string(SYNC_PAGE_SIZE));
+
+    // Deletes are done one group at a time, with one statement
+    // per number of paths, so that each path is bound exactly once
+    std::vector<std::unique_ptr<Statement>> deleteQs(SYNC_GROUP_SIZE + 1);
+    std::vector<std::unique_ptr<Statement>> deleteMetaQs(SYNC_GROUP_SIZE + 1);
+    auto deleteQueries = [db, &deleteQs, &deleteMetaQs](size_t paths) {
+        if (deleteQs[paths] == nullptr) {
+            std::string placeholders = "?";
+            for (size_t i = 1; i < paths; i++) placeholders += ",?";
+            deleteQs[paths] = db->query("DELETE FROM entries WHERE path IN (" + placeholders + ")");
+            deleteMetaQs[paths] = db->query("DELETE FROM entries_meta WHERE path IN (" + placeholders + ")");
+        }
+        return std::make_pair(deleteQs[paths].get(), deleteMetaQs[paths].get());
+    };
+    const auto updateQ = db->query(UPDATE_QUERY);
+    const auto touchQ = db->query(TOUCH_QUERY);
+
+    OrderedWorkQueue<CheckedGroup> queue(threads);
+    const size_t window = queue.concurrency() * 4;
+
+    SyncStats stats;
+    TransactionBatch batch(db);
+
+    // Writes results until at most maxPending jobs are left
+    // @return false if the callback cancelled the operation
+    auto writeResults = [&](size_t maxPending) {
+        while (queue.pending() > maxPending) {
+            auto r = std::make_shared<CheckedGroup>(queue.pop());
+            stats.bytesHashed += r->bytesHashed;
+
+            if (!r->deleted.empty()) {
+                const bool proceed = batch.add([r, db, &deleteQueries, &callback, &stats]() {
+                    const auto &deleted = r->deleted;
+                    const auto qs = deleteQueries(deleted.size());
+                    for (size_t i = 0; i < deleted.size(); i++) {
+                        qs.first->bind(static_cast<int>(i) + 1, deleted[i].path);
+                        qs.second->bind(static_cast<int>(i) + 1, deleted[i].path);
+                    }
+                    qs.first->execute();
+                    qs.second->execute();
 
-    q->bind(1, sanitized);
+                    for (const auto &f : deleted) {
+                        checkDeleteBuild(db, f.hash);
+                        stats.deleted++;
+                        if (callback != nullptr && !callback(f.path, true)) return false;
+                    }
+                    return true;
+                });
 
-    while (q->fetch()) {
-        Entry e(q->getText(0), q->getText(1), q->getInt(2), q->getText(3),
-                q->getInt64(4), q->getInt64(5), q->getInt(6),
-                q->getText(7), q->getText(8),
-                q->getText(9));
-        entries.push_back(e);
-    }
+                if (!proceed) return false;  // cancel
+            }
 
-    q->reset();
+            for (size_t i = 0; i < r->updated.size(); i++) {
+                const bool proceed = batch.add([r, i, &updateQ, &callback, &stats]() {
+                    const Entry &e = r->updated[i];
+                    doUpdate(updateQ.get(), e);
+                    stats.updated++;
+                    if (callback != nullptr) return callback(e.path, false);
+                    return true;
+                });
 
-    return entries;
-}
+                if (!proceed) return false;  // cancel
+            }
 
-void syncIndex(Database *db) {
-    const fs::path directory = db->rootDirectory();
+            for (size_t i = 0; i < r->touched.size(); i++) {
+                const bool proceed = batch.add([r, i, &touchQ, &stats]() {
+                    const Entry &e = r->touched[i];
+                    touchQ->bind(1, static_cast<long long>(e.mtime));
+                    touchQ->bind(2, e.quickHash);
+                    touchQ->bind(3, e.path);
+                    touchQ->execute();
+                    stats.touched++;
+                    return true;
+                });
+
+                if (!proceed) return false;  // cancel
+            }
+        }
 
-    auto q = db->query("SELECT path,mtime,hash FROM entries");
-    auto deleteQ = db->query("DELETE FROM entries WHERE path = ?");
-    const auto updateQ = db->query(UPDATE_QUERY);
+        return true;
+    };
+
+    auto finish = [db, &bulkLoad, &stats, &start]() {
+        bulkLoad.end();
+        db->updateChecksums();
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOGD << "Synced " << stats.files << " files (" << stats.filesPerSecond() << " files/s, "
+             << stats.bytesHashedPerSecond() << " bytes hashed/s)";
+        return stats;
+    };
+
+    std::string lastPath;
+    for (;;) {
+        std::vector<IndexedFile> page;
+        pageQ->bind(1, lastPath);
+        while (pageQ->fetch()) {
+            page.push_back({pageQ->getText(0), pageQ->getInt64(1), pageQ->getText(2),
+                            static_cast<std::uintmax_t>(pageQ->getInt64(3)), pageQ->getText(4),
+                            pageQ->getText(5)});
+        }
+        pageQ->reset();
 
-    db->exec("BEGIN EXCLUSIVE TRANSACTION");
+        if (page.empty()) break;
+        lastPath = page.back().path;
+        stats.files += page.size();
 
-    while (q->fetch()) {
-        io::Path relPath = fs::path(q->getText(0));
-        fs::path p = directory / relPath.get();
-        Entry e;
-        const auto mtime = q->getInt64(1);
-        const auto hash = q->getText(2);
-        const auto status = checkUpdate(e, p, mtime, hash);
+        for (size_t g = 0; g < page.size(); g += SYNC_GROUP_SIZE) {
+            const auto first = page.begin() + static_cast<std::ptrdiff_t>(g);
+            const auto last = page.begin() + static_cast<std::ptrdiff_t>(std::min(g + SYNC_GROUP_SIZE, page.size()));
+            std::vector<IndexedFile> group(std::make_move_iterator(first), std::make_move_iterator(last));
 
-        switch(status) {
+            queue.push([group = std::move(group), &directory]() {
+                CheckedGroup r;
 
-            case Deleted:
-                // Removed
-                deleteQ->bind(1, relPath.generic());
-                deleteQ->execute();
-                checkDeleteBuild(db, hash);
-                checkDeleteMeta(db, relPath.generic());
-                std::cout << "D\t" << relPath.generic() << std::endl;
-            break;
+                for (const auto &f : group) {
+                    const fs::path p = directory / io::Path(fs::path(f.path)).get();
 
-            case Modified:
+                    WalkEntry file;
+                    if (!DirectoryWalker::stat(p, file)) {
+                        r.deleted.push_back(f);
+                        continue;
+                    }
 
-                parseEntry(p, directory, e, true);
-                doUpdate(updateQ.get(), e);
-                std::cout << "U\t" << e.path << std::endl;
-            break;
+                    Entry e;
+                    const auto status = checkUpdate(e, file, f.mtime, f.hash, f.size,
+                                                    f.quickHash, f.blake3, &r.bytesHashed);
+
+                    if (status == Modified) {
+                        // Hashes computed by checkUpdate are reused
+                        parseEntry(p, directory, e, true, &r.bytesHashed);
+                        r.updated.push_back(std::move(e));
+                    } else if (e.mtime != 0 && e.mtime != f.mtime) {
+                        // Only the modified time changed (folders have no mtime set)
+                        e.path = f.path;
+                        r.touched.push_back(std::move(e));
+                    }
+                }
 
-            default:
-                ; // Do nothing
+                return r;
+            });
 
+            if (!writeResults(window)) return finish();
         }
     }
 
-    db->exec("COMMIT");
+    if (writeResults(0)) batch.flush();
+
+    return finish();
 }
 
 // Sets the modified times of files in the filesystem
@@ -812,53 +1801,34 @@ std::string initIndex(const std::string &directory, bool fromScratch) {
 
 void deleteEntry(Database* db, const std::string& path) {
 
-    auto f = db->query("DELETE FROM entries WHERE path = ?");
+    auto f = db->cachedQuery("DELETE FROM entries WHERE path = ?");
     f->bind(1, path);
     f->execute();
 
     checkDeleteMeta(db, path);
 }
 
-#define FOLDER_CONSISTENCY_QUERY "SELECT B.folder FROM ( \
-    SELECT A.path, TRIM(A.folder, '/') AS folder FROM ( \
-        SELECT path, replace(path, replace(path, rtrim(path, replace(path, '/', '')), ''), '') AS folder FROM entries WHERE type != 1) AS A \
-        WHERE length(A.folder) > 0) AS B WHERE folder NOT IN (SELECT path FROM entries WHERE type = 1)"
-
 #define CREATE_FOLDER_QUERY "INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 1, 'null', ?, 0, ?)"
 
 void addFolder(Database *db, const std::string path, const time_t mtime) {
-    const auto q = db->query(CREATE_FOLDER_QUERY);
+    const auto q = db->cachedQuery(CREATE_FOLDER_QUERY);
     q->bind(1, path);
     q->bind(2, static_cast<long long>(mtime));
     q->bind(3, ddb::io::Path(path).depth());
     q->execute();
 }
 
-void createMissingFolders(Database* db) {
-
-    const auto q = db->query(FOLDER_CONSISTENCY_QUERY);
-
-    while(q->fetch()) {
-
-        const auto folder = q->getText(0);
-
-        LOGD << "Creating missing folder '" << folder << "'";
-
-        addFolder(db, folder, time(NULL));
-
-    }
-
-}
-
 bool pathExists(Database* db, const std::string& path) {
-    auto q = db->query("SELECT COUNT(path) FROM entries WHERE path = ?");
+    auto q = db->cachedQuery("SELECT COUNT(path) FROM entries WHERE path = ?");
     q->bind(1, path);
     q->fetch();
-    return q->getInt(0) > 0;
+    const bool exists = q->getInt(0) > 0;
+    q->reset();
+    return exists;
 }
 
 bool getEntry(Database* db, const std::string& path, Entry &entry) {
-    auto q = db->query("SELECT path, hash, type, properties, mtime, size, depth, "
+    auto q = db->cachedQuery("SELECT path, hash, type, properties, mtime, size, depth, "
         "json_extract(AsGeoJSON(point_geom), '$.coordinates'), json_extract(AsGeoJSON(polygon_geom), '$.coordinates') FROM entries WHERE path = ? LIMIT 1");
 
     q->bind(1, path);
@@ -869,28 +1839,64 @@ bool getEntry(Database* db, const std::string& path, Entry &entry) {
     entry.parseFields(q->getText(0), q->getText(1), q->getInt(2), q->getText(3),
                    q->getInt64(4), q->getInt64(5), q->getInt(6),
                    q->getText(7), q->getText(8));
+    q->reset();
     return true;
 
 }
 
-std::vector<std::string> listFolderPaths(Database *db, const std::string& path) {
+// Moves a folder and everything below it with a few statements
+// over the path ranges of the source and destination
+void replaceFolderPath(Database* db, const std::string& source, const std::string& dest) {
 
-    std::vector<std::string> res;
+    LOGD << "Replacing folder '" << source << "' to '" << dest << "'";
 
-    auto q = db->query("SELECT path FROM entries WHERE path LIKE ? OR path = ?");
+    const auto contents = PathPredicate::below("path", source);
+    const std::string where = "(path = ? OR " + contents.sql + ")";
+    const int depthDelta = io::Path(dest).depth() - io::Path(source).depth();
 
-    q->bind(1, path + "/%");
-    q->bind(2, path);
+    // ? || substr(path, ?) is the new path of an entry
+    auto bindMove = [&](Statement *q, int first) {
+        q->bind(first, dest);
+        q->bind(first + 1, static_cast<int>(source.length()) + 1);
+        q->bind(first + 2, source);
+        return contents.bind(q, first + 3);
+    };
 
-    while (q->fetch()) {
+    // Whatever is already at the new paths is replaced
+    const std::string targets = "SELECT ? || substr(path, ?) FROM entries WHERE " + where;
 
-        const auto p = q->getText(0);
+    auto q = db->query("DELETE FROM entries_meta WHERE path IN (" + targets + ")");
+    bindMove(q.get(), 1);
+    q->execute();
 
-        res.push_back(p);
-    }
+    q = db->query("DELETE FROM entries WHERE path IN (" + targets + ")");
+    bindMove(q.get(), 1);
+    q->execute();
 
-    return res;
+    q = db->query("UPDATE entries SET path = ? || substr(path, ?), depth = depth + ? WHERE " + where);
+    q->bind(1, dest);
+    q->bind(2, static_cast<int>(source.length()) + 1);
+    q->bind(3, depthDelta);
+    q->bind(4, source);
+    contents.bind(q.get(), 5);
+    q->execute();
 
+    q = db->query("UPDATE entries_meta SET path = ? || substr(path, ?) WHERE " + where);
+    bindMove(q.get(), 1);
+    q->execute();
+}
+
+// Adds the folders above path that are not in the index
+void addMissingParents(Database* db, const std::string& path) {
+    const auto now = time(nullptr);
+
+    for (auto pos = path.find('/'); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        const auto folder = path.substr(0, pos);
+        if (pathExists(db, folder)) continue;
+
+        LOGD << "Creating missing folder '" << folder << "'";
+        addFolder(db, folder, now);
+    }
 }
 
 void replacePath(Database* db, const std::string& source, const std::string& dest) {
@@ -929,6 +1935,9 @@ void moveEntry(Database* db, const std::string& source, const std::string& dest)
     // Nothing to do
     if (source == dest) return;
 
+    if (dest.rfind(source + "/", 0) == 0)
+        throw InvalidArgsException("Cannot move a folder into itself");
+
     Entry sourceEntry, destEntry;
     bool sourceExists = getEntry(db, source, sourceEntry);
     bool destExists = getEntry(db, dest, destEntry);
@@ -953,7 +1962,12 @@ void moveEntry(Database* db, const std::string& source, const std::string& dest)
             throw InvalidArgsException("Cannot move a file on a directory");
     }
 
-    const fs::path directory = db->rootDirectory();
+    // Parent folders of dest are created if missing, but cannot be files
+    for (auto pos = dest.find('/'); pos != std::string::npos; pos = dest.find('/', pos + 1)) {
+        Entry parent;
+        if (getEntry(db, dest.substr(0, pos), parent) && parent.type != Directory)
+            throw InvalidArgsException("Cannot move into " + parent.path + ", it is not a directory");
+    }
 
     db->exec("BEGIN EXCLUSIVE TRANSACTION");
 
@@ -966,21 +1980,13 @@ void moveEntry(Database* db, const std::string& source, const std::string& dest)
 
     } else {
 
-        const auto paths = listFolderPaths(db, source);
-
-        for (const std::string& path : paths) {
-
-            auto newPath = dest + std::string(path).substr(source.length(), std::string::npos);
-
-            deleteEntry(db, newPath);
-            replacePath(db, path, newPath);
-
-        }
-
-        createMissingFolders(db);
+        replaceFolderPath(db, source, dest);
 
     }
 
+    addMissingParents(db, dest);
+
+    db->updateChecksums();
     db->exec("COMMIT");
 }
 
@@ -10,29 +10,114 @@
 #include "fs.h"
 #include "ddb_export.h"
 #include "registryutils.h"
+#include "walker.h"
 
 namespace ddb {
 
 typedef std::function<bool(const Entry &e, bool updated)> AddCallback;
 typedef std::function<void(const std::string& path)> RemoveCallback;
 typedef std::function<void(const std::string& path)> BuildCallback;
+typedef std::function<bool(const WalkEntry &e)> WalkCallback;
 
+// Called for every entry of a listing, in path order.
+// Returning false stops the listing.
+typedef std::function<bool(const Entry &e)> EntryCallback;
+
+// Called for every entry removed (deleted = true) or updated by a sync.
+// Returning false cancels the sync.
+typedef std::function<bool(const std::string &path, bool deleted)> SyncCallback;
+
+// Number of index entries read at a time by a sync
+#define SYNC_PAGE_SIZE 4096
+
+// Number of index entries checked by a single sync job
+#define SYNC_GROUP_SIZE 64
+
+struct SyncStats {
+    // Index entries checked
+    size_t files = 0;
+    size_t deleted = 0;
+    size_t updated = 0;
+
+    // Entries whose modified time changed, but not their contents
+    size_t touched = 0;
+
+    // Bytes read to verify and re-parse files
+    std::uintmax_t bytesHashed = 0;
+    double seconds = 0;
+
+    DDB_DLL double filesPerSecond() const;
+    DDB_DLL double bytesHashedPerSecond() const;
+    DDB_DLL void toJSON(json &j) const;
+};
+
+// Number of entries returned by a search near a location, by default
+#define SEARCH_NEAR_COUNT 10
+
+// Restricts the results of a search. Coordinates are WGS84 (longitude, latitude).
+struct SearchFilter {
+    // minx, miny, maxx, maxy: entries whose geometry intersects the box
+    std::vector<double> bbox;
+
+    // WKT geometry: entries whose geometry intersects it
+    std::string intersects;
+
+    // lon, lat: the nearCount entries whose position is closest,
+    // sorted by distance
+    std::vector<double> near;
+    int nearCount = SEARCH_NEAR_COUNT;
+
+    // from, to (inclusive): entries captured in this interval,
+    // in milliseconds since the Unix epoch
+    std::vector<double> captureTime;
+
+    // Words (case insensitive) that all appear in the path or in the tags,
+    // annotations, description or name metadata of entries
+    std::string text;
+
+    // Condition on the entry fields and properties (see FilterExpression),
+    // e.g. make = "DJI" and cameraPitch < -80
+    std::string where;
+
+    // Reads {"bbox": [...], "intersects": "WKT", "near": [...], "nearCount": N,
+    //        "captureTime": [from, to], "text": "words", "where": "expression"}
+    //        (times as milliseconds or ISO 8601 dates)
+    // @throws InvalidArgsException
+    DDB_DLL static SearchFilter fromJSON(const json &j);
+
+    // Milliseconds since the Unix epoch or an ISO 8601 date (UTC)
+    // @throws InvalidArgsException
+    DDB_DLL static double parseTime(const std::string &s);
+
+    // @throws InvalidArgsException
+    DDB_DLL void validate() const;
+};
+
+// Path of the database of the index in directory (or in one of its parents if traverseUp)
+// @throws FSException if there is none
+DDB_DLL fs::path databasePath(const std::string &directory, bool traverseUp);
 DDB_DLL std::unique_ptr<Database> open(const std::string &directory, bool traverseUp);
+DDB_DLL void walkIndexPathList(const fs::path& rootDirectory, const std::vector<std::string> &paths, bool includeDirs, const WalkCallback &cb);
 DDB_DLL std::vector<fs::path> getIndexPathList(const fs::path& rootDirectory, const std::vector<std::string> &paths, bool includeDirs);
+DDB_DLL void walkPathList(const std::vector<std::string> &paths, bool includeDirs, int maxDepth, bool includeFiles, const WalkCallback &cb);
 DDB_DLL std::vector<fs::path> getPathList(const std::vector<std::string> &paths, bool includeDirs, int maxDepth, bool includeFiles = true);
 DDB_DLL std::vector<std::string> expandPathList(const std::vector<std::string> &paths, bool recursive, int maxRecursionDepth);
 DDB_DLL std::vector<Entry> getMatchingEntries(Database* db, const fs::path& path, int maxRecursionDepth = 0, bool isFolder = false);
+DDB_DLL void forEachMatchingEntry(Database* db, const fs::path& path, const EntryCallback &cb, int maxRecursionDepth = 0, bool isFolder = false);
 DDB_DLL void checkDeleteBuild(Database *db, const std::string &hash);
 DDB_DLL void checkDeleteMeta(Database *db, const std::string &path);
 DDB_DLL int deleteFromIndex(Database* db, const std::string &query, bool isFolder = false, RemoveCallback callback = nullptr);
+DDB_DLL int deletePathFromIndex(Database* db, const std::string &path, RemoveCallback callback = nullptr);
 
 DDB_DLL void doUpdate(Statement *updateQ, const Entry &e);
 
-DDB_DLL void listIndex(Database* db, const std::vector<std::string> &paths, std::ostream& out, const std::string& format, bool recursive = false, int maxRecursionDepth = 0);
-DDB_DLL void searchIndex(Database* db, const std::string &query, std::ostream& out, const std::string& format);
-DDB_DLL void addToIndex(Database *db, const std::vector<std::string> &paths, AddCallback callback = nullptr);
+// Entries are filtered with everything but filter.near, folders are always listed
+DDB_DLL void listIndex(Database* db, const std::vector<std::string> &paths, std::ostream& out, const std::string& format, bool recursive = false, int maxRecursionDepth = 0, const SearchFilter &filter = SearchFilter());
+DDB_DLL void listIndex(Database* db, const std::vector<std::string> &paths, const EntryCallback &cb, bool recursive = false, int maxRecursionDepth = 0, const SearchFilter &filter = SearchFilter());
+DDB_DLL void searchIndex(Database* db, const std::string &query, std::ostream& out, const std::string& format, const SearchFilter &filter = SearchFilter());
+DDB_DLL void addToIndex(Database *db, const std::vector<std::string> &paths, AddCallback callback = nullptr, int threads = 0);
 DDB_DLL void removeFromIndex(Database *db, const std::vector<std::string> &paths, RemoveCallback callback = nullptr);
-DDB_DLL void syncIndex(Database *db);
+DDB_DLL SyncStats syncIndex(Database *db, SyncCallback callback = nullptr, int threads = 0);
 DDB_DLL void syncLocalMTimes(Database *db, const std::vector<std::string> &files = {});
 DDB_DLL void moveEntry(Database* db, const std::string& source, const std::string& dest);
 DDB_DLL bool getEntry(Database* db, const std::string& path, Entry &entry);
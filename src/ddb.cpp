@@ -5,8 +5,10 @@
 #include "ddb.h"
 
 #include "gdal_inc.h"
+#include <exiv2/exiv2.hpp>
 #include <passwordmanager.h>
 
+#include "connectionpool.h"
 #include "database.h"
 #include "dbops.h"
 #include "delta.h"
@@ -87,6 +89,10 @@ void DDBRegisterProcess(bool verbose) {
     net::Initialize();
     GDALAllRegister();
 
+    // Exiv2's XMP parser must be initialized once before
+    // files are parsed from multiple threads
+    Exiv2::XmpParser::initialize();
+
     // Black magic to catch segfaults/fpes and throw
     // C++ exceptions instead
     segvcatch::init_segv(&handleSegv);
@@ -118,7 +124,7 @@ void DDBSetLastError(const char* err) {
 }
 
 DDBErr DDBAdd(const char* ddbPath, const char** paths, int numPaths,
-              char** output, bool recursive) {
+              char** output, bool recursive, int threads) {
     DDB_C_BEGIN
 
     if (ddbPath == nullptr) throw InvalidArgsException("No directory provided");
@@ -137,7 +143,7 @@ DDBErr DDBAdd(const char* ddbPath, const char** paths, int numPaths,
                    e.toJSON(j);
                    outJson.push_back(j);
                    return true;
-               });
+               }, threads);
 
     utils::copyToPtr(outJson.dump(), output);
     DDB_C_END
@@ -186,7 +192,7 @@ DDBErr DDBGet(const char *ddbPath, const char *path, char **output){
     DDB_C_BEGIN
     if (ddbPath == nullptr) throw InvalidArgsException("No ddb path provided");
     if (path == nullptr) throw InvalidArgsException("No path provided");
-    const auto db = ddb::open(std::string(ddbPath), false);
+    const auto db = ConnectionPool::instance().acquire(std::string(ddbPath), false);
 
     auto entries = ddb::getMatchingEntries(db.get(), std::string(path));
     std::string entryJson;
@@ -218,7 +224,7 @@ DDBErr DDBList(const char* ddbPath, const char** paths, int numPaths,
 
     if (output == nullptr) throw InvalidArgsException("No output provided");
 
-    const auto db = ddb::open(std::string(ddbPath), true);
+    const auto db = ConnectionPool::instance().acquire(std::string(ddbPath), true);
     const std::vector<std::string> pathList(paths, paths + numPaths);
 
     std::ostringstream ss;
@@ -229,7 +235,7 @@ DDBErr DDBList(const char* ddbPath, const char** paths, int numPaths,
     DDB_C_END
 }
 
-DDBErr DDBSearch(const char *ddbPath, const char *query, char **output, const char *format){
+DDBErr DDBSearch(const char *ddbPath, const char *query, char **output, const char *format, const char *filterJson){
     DDB_C_BEGIN
 
     if (ddbPath == nullptr) throw InvalidArgsException("No ddb path provided");
@@ -238,10 +244,19 @@ DDBErr DDBSearch(const char *ddbPath, const char *query, char **output, const ch
 
     if (output == nullptr) throw InvalidArgsException("No output provided");
 
-    const auto db = ddb::open(std::string(ddbPath), false);
+    SearchFilter filter;
+    if (filterJson != nullptr && strlen(filterJson) > 0) {
+        try {
+            filter = SearchFilter::fromJSON(json::parse(filterJson));
+        } catch (const json::parse_error &e) {
+            throw InvalidArgsException(std::string("Invalid filter JSON: ") + e.what());
+        }
+    }
+
+    const auto db = ConnectionPool::instance().acquire(std::string(ddbPath), false);
 
     std::ostringstream ss;
-    searchIndex(db.get(), query, ss, format);
+    searchIndex(db.get(), query, ss, format, filter);
 
     utils::copyToPtr(ss.str(), output);
 
@@ -335,6 +350,26 @@ DDB_DLL DDBErr DDBStatus(const char* ddbPath, char** output) {
     DDB_C_END
 }
 
+DDBErr DDBSync(const char* ddbPath, char** output, int threads) {
+    DDB_C_BEGIN
+
+    if (ddbPath == nullptr) throw InvalidArgsException("No directory provided");
+    if (output == nullptr) throw InvalidArgsException("No output provided");
+
+    const auto db = ddb::open(std::string(ddbPath), true);
+
+    json j = {{"deleted", json::array()}, {"updated", json::array()}};
+    const auto stats = syncIndex(db.get(), [&j](const std::string &path, bool deleted) {
+        j[deleted ? "deleted" : "updated"].push_back(path);
+        return true;
+    }, threads);
+    stats.toJSON(j["stats"]);
+
+    utils::copyToPtr(j.dump(), output);
+
+    DDB_C_END
+}
+
 // @deprecated
 DDBErr DDBChattr(const char* ddbPath, const char* attrsJson, char** output) {
     DDB_C_BEGIN
@@ -514,7 +549,7 @@ DDB_DLL DDBErr DDBGetStamp(const char* ddbPath, char** output) {
     if (ddbPath == nullptr) throw InvalidArgsException("No ddb path provided");
     if (output == nullptr) throw InvalidArgsException("No output provided");
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ConnectionPool::instance().acquire(std::string(ddbPath), true);
     utils::copyToPtr(ddb->getStamp().dump(), output);
 
     DDB_C_END
@@ -660,7 +695,7 @@ DDB_DLL DDBErr DDBMetaGet(const char *ddbPath, const char *path, const char *key
 
     const auto ddbPathStr = std::string(ddbPath);
 
-    const auto ddb = ddb::open(ddbPathStr, true);
+    const auto ddb = ConnectionPool::instance().acquire(ddbPathStr, true);
     auto json = ddb->getMetaManager()->get(std::string(key), std::string(path), ddbPathStr);
 
     utils::copyToPtr(json.dump(), output);
@@ -691,7 +726,7 @@ DDB_DLL DDBErr DDBMetaList(const char *ddbPath, const char *path, char **output)
 
     const auto ddbPathStr = std::string(ddbPath);
 
-    const auto ddb = ddb::open(ddbPathStr, true);
+    const auto ddb = ConnectionPool::instance().acquire(ddbPathStr, true);
     auto json = ddb->getMetaManager()->list(std::string(path), ddbPathStr);
 
     utils::copyToPtr(json.dump(), output);
@@ -712,7 +747,7 @@ DDB_DLL DDBErr DDBMetaDump(const char *ddbPath, const char *ids, char **output){
         throw InvalidArgsException(e.what());
     }
 
-    const auto ddb = ddb::open(std::string(ddbPath), true);
+    const auto ddb = ConnectionPool::instance().acquire(std::string(ddbPath), true);
     auto json = ddb->getMetaManager()->dump(jIds);
 
     utils::copyToPtr(json.dump(), output);
@@ -13,6 +13,7 @@ extern "C" {
 
 #define DDB_LOG_ENV "DDB_LOG"
 #define DDB_DEBUG_ENV "DDB_DEBUG"
+#define DDB_CHANGE_DETECTION_ENV "DDB_CHANGE_DETECTION"
 
 #define DDB_FOLDER ".ddb"
 
@@ -56,7 +57,7 @@ DDB_DLL DDBErr DDBInit(const char *directory, char **outPath);
  * @param output pointer to C-string where to store output
  * @param recursive whether to recursively add folders
  * @return DDBERR_NONE on success, an error otherwise */
-DDB_DLL DDBErr DDBAdd(const char *ddbPath, const char **paths, int numPaths, char** output, bool recursive = false);
+DDB_DLL DDBErr DDBAdd(const char *ddbPath, const char **paths, int numPaths, char** output, bool recursive = false, int threads = 0);
 
 /** Remove one or more files to a DroneDB database
  * @param ddbPath path to a DroneDB database (parent of ".ddb")
@@ -102,8 +103,13 @@ DDB_DLL DDBErr DDBList(const char *ddbPath, const char **paths, int numPaths, ch
  * @param query search string
  * @param output pointer to C-string where to store result
  * @param format output format. One of: ["text", "json"]
+ * @param filterJson optional JSON object restricting the results:
+ *        {"bbox": [minx, miny, maxx, maxy], "intersects": "WKT",
+ *         "near": [lon, lat], "nearCount": 10, "captureTime": [from, to],
+ *         "text": "words", "where": "make = 'DJI' and cameraPitch < -80"}
+ *        (WGS84, times as milliseconds since the Unix epoch or ISO 8601 dates)
  * @return DDBERR_NONE on success, an error otherwise */
-DDB_DLL DDBErr DDBSearch(const char *ddbPath, const char *query, char **output, const char *format);
+DDB_DLL DDBErr DDBSearch(const char *ddbPath, const char *query, char **output, const char *format, const char *filterJson = nullptr);
 
 /** Append password to database
  * @param ddbPath path to a DroneDB database (parent of ".ddb")
@@ -128,6 +134,14 @@ DDB_DLL DDBErr DDBClearPasswords(const char* ddbPath);
  * @return DDBERR_NONE on success, an error otherwise */
 DDB_DLL DDBErr DDBStatus(const char* ddbPath, char **output);
 
+/** Update the index with changes from the filesystem
+ * @param ddbPath path to a DroneDB database (parent of ".ddb")
+ * @param output pointer to C-string where to store result (JSON). Output contains the
+ *        deleted and updated paths, plus the sync statistics (files checked, throughput)
+ * @param threads number of threads used to check and parse files (0 = one per CPU)
+ * @return DDBERR_NONE on success, an error otherwise */
+DDB_DLL DDBErr DDBSync(const char* ddbPath, char **output, int threads = 0);
+
 /** @deprecated: Changes database attributes
  * @param ddbPath path to a DroneDB database (parent of ".ddb")
  * @param attrsJson array of object attributes as a JSON string
@@ -60,12 +60,54 @@ void from_json(const json &j, Delta &d){
     }
 }
 
+// Folders whose checksums differ between two indexes. The entries of
+// the other folders are the same on both sides, so no delta has them.
+static std::vector<std::string> changedFolders(Database* sourceDb, Database* targetDb) {
+    std::vector<std::string> changed;
+    std::vector<std::string> pending = {""};
+
+    while (!pending.empty()) {
+        const std::string folder = pending.back();
+        pending.pop_back();
+
+        if (sourceDb->getChecksum(folder) == targetDb->getChecksum(folder)) continue;
+        changed.push_back(folder);
+
+        auto children = sourceDb->getChildChecksums(folder);
+        for (const auto &c : targetDb->getChildChecksums(folder)) children.insert(c);
+        for (const auto &c : children) pending.push_back(c.first);
+    }
+
+    return changed;
+}
+
+// Stamp with the entries of some folders only (and all the metadata)
+static json folderStamp(Database* db, const std::vector<std::string> &folders) {
+    json j;
+
+    j["entries"] = json::array();
+    auto q = db->query("SELECT path, hash FROM entries WHERE rtrim(path, replace(path, '/', '')) = ?");
+    for (const auto &folder : folders) {
+        q->bind(1, folder);
+        while (q->fetch()) j["entries"].push_back(json::object({{q->getText(0), q->getText(1)}}));
+        q->reset();
+    }
+
+    j["meta"] = json::array();
+    q = db->query("SELECT id FROM entries_meta ORDER BY id ASC");
+    while (q->fetch()) j["meta"].push_back(q->getText(0));
+
+    return j;
+}
+
 Delta getDelta(Database* sourceDb, Database* targetDb) {
-    return getDelta(sourceDb->getStamp(), targetDb->getStamp());
+    const auto folders = changedFolders(sourceDb, targetDb);
+    return getDelta(folderStamp(sourceDb, folders), folderStamp(targetDb, folders));
 }
 
 void delta(Database* sourceDb, Database* targetDb, std::ostream& output, const std::string& format) {
-    delta(sourceDb->getStamp(), targetDb->getStamp(), output, format);
+    const auto folders = changedFolders(sourceDb, targetDb);
+    delta(folderStamp(sourceDb, folders), folderStamp(targetDb, folders), output, format);
 }
 
 void delta(const json &sourceDbStamp, const json &targetDbStamp, std::ostream& output, const std::string& format){
@@ -110,33 +152,49 @@ Delta getDelta(const json &sourceDbStamp,
                   return l.path < r.path;
               });
 
-    for (const SimpleEntry& entry : source) {
-        const auto inDestWithSameHashAndPath =
-            std::find_if(destination.begin(), destination.end(),
-                         [&entry](const SimpleEntry& e) {
-                             return e.hash == entry.hash &&
-                                    e.path == entry.path;
-                         }) != destination.end();
-
-        if (inDestWithSameHashAndPath) {
-            LOGD << "SKIP -> " << entry.toString();
-            continue;
+    // Walk both lists in path order, comparing the entries that share a path
+    // (there is at most one on each side, unless a stamp repeats paths)
+    size_t i = 0, j = 0;
+    while (i < source.size() || j < destination.size()) {
+        const std::string &path = j == destination.size() ||
+                                  (i < source.size() && source[i].path < destination[j].path) ?
+                                  source[i].path : destination[j].path;
+
+        size_t sourceEnd = i, destinationEnd = j;
+        while (sourceEnd < source.size() && source[sourceEnd].path == path) sourceEnd++;
+        while (destinationEnd < destination.size() && destination[destinationEnd].path == path) destinationEnd++;
+
+        for (size_t s = i; s < sourceEnd; s++) {
+            const SimpleEntry& entry = source[s];
+            bool inDestWithSameHashAndPath = false;
+            for (size_t d = j; d < destinationEnd && !inDestWithSameHashAndPath; d++) {
+                inDestWithSameHashAndPath = destination[d].hash == entry.hash;
+            }
+
+            if (inDestWithSameHashAndPath) {
+                LOGD << "SKIP -> " << entry.toString();
+                continue;
+            }
+
+            LOGD << "ADD  -> " << entry.toString();
+            adds.emplace_back(AddAction(entry.path, entry.hash));
         }
 
-        LOGD << "ADD  -> " << entry.toString();
-        adds.emplace_back(AddAction(entry.path, entry.hash));
-    }
-
-    for (const SimpleEntry& entry : destination) {
-        const auto notInSourceWithSamePath = std::find_if(
-            source.begin(), source.end(), [&entry](const SimpleEntry& e) {
-                return e.path == entry.path && e.isDirectory() == entry.isDirectory();
-            });
-
-        if (notInSourceWithSamePath == source.end()) {
-            LOGD << "DEL  -> " << entry.toString();
-            removes.emplace_back(RemoveAction(entry.path, entry.hash));
+        for (size_t d = j; d < destinationEnd; d++) {
+            const SimpleEntry& entry = destination[d];
+            bool inSourceWithSamePath = false;
+            for (size_t s = i; s < sourceEnd && !inSourceWithSamePath; s++) {
+                inSourceWithSamePath = source[s].isDirectory() == entry.isDirectory();
+            }
+
+            if (!inSourceWithSamePath) {
+                LOGD << "DEL  -> " << entry.toString();
+                removes.emplace_back(RemoveAction(entry.path, entry.hash));
+            }
         }
+
+        i = sourceEnd;
+        j = destinationEnd;
     }
 
     // Sort removes by path descending
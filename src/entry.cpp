@@ -7,6 +7,8 @@
 
 #include <ddb.h>
 
+#include "fileprobe.h"
+#include "status.h"
 #include "mio.h"
 #include "pointcloud.h"
 #include "ply.h"
@@ -14,7 +16,8 @@
 
 namespace ddb {
 
-void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entry, bool withHash) {
+void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entry, bool withHash,
+                std::uintmax_t *bytesHashed) {
     entry.type = EntryType::Undefined;
 
     try {
@@ -46,21 +49,51 @@ void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entr
             LOGD << "Cannot check " << path.string() << " .ddb presence: " << e.what();
         }
     } else {
-        if (entry.hash == "" && withHash) entry.hash = Hash::fileSHA256(path.string());
         entry.size = p.getSize();
-        entry.type = fingerprint(p.get());
+
+        if (withHash) {
+            // Large files also get a BLAKE3 hash, so that later checks
+            // can verify them using all cores
+            const bool large = entry.size >= BLAKE3_MIN_FILE_SIZE;
+
+            // Hashes that are already known are not read again. The quick hash
+            // comes with a full read, or else costs another one that is only
+            // worth it if change detection uses quick hashes
+            std::uintmax_t read = 0;
+            std::string *quickHash = entry.quickHash == "" ? &entry.quickHash : nullptr;
+
+            if (entry.hash == "" && large && entry.blake3 == "") {
+                Hash::fileSHA256AndBLAKE3(path.string(), entry.hash, entry.blake3, 0, quickHash);
+                read += entry.size;
+            } else {
+                if (entry.hash == "") {
+                    entry.hash = Hash::fileSHA256(path.string(), quickHash);
+                    read += entry.size;
+                } else if (large && entry.blake3 == "") {
+                    entry.blake3 = Hash::fileBLAKE3(path.string(), 0, quickHash);
+                    read += entry.size;
+                }
+            }
+
+            if (entry.quickHash == "" && getChangeDetection() == CDQuick) {
+                entry.quickHash = Hash::fileQuickHash(path.string());
+                read += std::min<std::uintmax_t>(entry.size, 2 * QUICK_HASH_CHUNK_SIZE);
+            }
+
+            if (bytesHashed != nullptr) *bytesHashed += read;
+        }
+
+        // Containers opened during fingerprinting are reused below
+        FileProbe probe(path);
+        entry.type = fingerprint(probe);
 
         bool pano = entry.type == EntryType::Panorama || entry.type == EntryType::GeoPanorama;
         bool image = entry.type == EntryType::Image || entry.type == EntryType::GeoImage || pano;
         bool video = entry.type == EntryType::Video || entry.type == EntryType::GeoVideo;
 
-        if (image || video) {
+        if ((image || video) && probe.getExivImage() != nullptr) {
             try{
-                auto exivImage = Exiv2::ImageFactory::open(path.string());
-                if (!exivImage.get()) throw new IndexException("Cannot open " + path.string());
-
-                exivImage->readMetadata();
-                ExifParser e(exivImage.get());
+                ExifParser e(probe.getExivImage());
 
                 if (e.hasTags()) {
                     SensorSize sensorSize;
@@ -109,8 +142,12 @@ void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entr
                         if (image && !pano){
                             double relAltitude = 0.0;
 
-                            if (e.extractRelAltitude(relAltitude) && sensorSize.width > 0.0 && focal.length > 0.0) {
-                                calculateFootprint(sensorSize, geo, focal, cameraOri, relAltitude, entry.polygon_geom);
+                            if (e.extractRelAltitude(relAltitude)) {
+                                entry.properties["relativeAltitude"] = relAltitude;
+
+                                if (sensorSize.width > 0.0 && focal.length > 0.0) {
+                                    calculateFootprint(sensorSize, geo, focal, cameraOri, relAltitude, entry.polygon_geom);
+                                }
                             }
                         }
                     }
@@ -135,8 +172,7 @@ void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entr
                 LOGD << "Cannot read EXIF data: " << path.string();
             }
         }else if (entry.type == EntryType::GeoRaster){
-            GDALDatasetH  hDataset;
-            hDataset = GDALOpen( path.string().c_str(), GA_ReadOnly );
+            GDALDatasetH hDataset = probe.getGDALDataset();
             if (!hDataset)
                 throw GDALException("Cannot open " + path.string() + " for reading");
 
@@ -201,8 +237,6 @@ void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entr
                 b["colorInterp"] = GDALGetColorInterpretationName(GDALGetRasterColorInterpretation(hBand));
                 entry.properties["bands"].push_back(b);
             }
-
-            GDALClose(hDataset);
         }else if (entry.type == EntryType::PointCloud){
             PointCloudInfo info;
             if (getPointCloudInfo(path.string(), info)){
@@ -406,7 +440,13 @@ void parseDroneDBEntry(const fs::path &ddbPath, Entry &entry){
 }
 
 EntryType fingerprint(const fs::path &path){
+    FileProbe probe(path);
+    return fingerprint(probe);
+}
+
+EntryType fingerprint(FileProbe &probe){
     EntryType type = EntryType::Generic;
+    const fs::path &path = probe.getPath();
     io::Path p(path);
 
     if (p.checkExtension({"md"}))
@@ -419,7 +459,8 @@ EntryType fingerprint(const fs::path &path){
 
     if (p.checkExtension({"ply"})){
         // Could be a mesh or a point cloud
-        return identifyPly(path);
+        std::istringstream header(probe.getHeader());
+        return identifyPly(header);
     }
 
     if (p.checkExtension({"obj"}))
@@ -434,14 +475,12 @@ EntryType fingerprint(const fs::path &path){
     bool georaster = false;
 
     if (tif){
-        GDALDatasetH  hDataset;
-        hDataset = GDALOpen( p.string().c_str(), GA_ReadOnly );
+        GDALDatasetH hDataset = probe.getGDALDataset();
         if( hDataset != NULL ){
             const char *proj = GDALGetProjectionRef(hDataset);
             if (proj != NULL){
                 georaster = std::string(proj) != "";
             }
-            GDALClose(hDataset);
         }else{
             LOGD << "Cannot open " << p.string().c_str() << " for georaster test";
         }
@@ -454,11 +493,10 @@ EntryType fingerprint(const fs::path &path){
         type = image ? EntryType::Image : EntryType::Video;
 
         try{
-            auto image = Exiv2::ImageFactory::open(path.string());
-            if (!image.get()) throw new IndexException("Cannot open " + path.string());
+            auto image = probe.getExivImage();
+            if (image == nullptr) return type;
 
-            image->readMetadata();
-            ExifParser e(image.get());
+            ExifParser e(image);
 
             if (type == EntryType::Image){
                 // Panorama?
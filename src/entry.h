@@ -19,9 +19,13 @@
 
 namespace ddb {
 
+class FileProbe;
+
 struct Entry {
     std::string path = "";
     std::string hash = "";
+    std::string quickHash = "";
+    std::string blake3 = "";
     EntryType type = EntryType::Undefined;
     json properties;
     time_t mtime = 0;
@@ -136,8 +140,10 @@ struct Entry {
  * @param rootDirectory root directory from which to compute relative path
  * @param entry reference to output Entry object
  * @param withHash whether to compute the hash of the file (slow)
+ * @param bytesHashed if set, incremented by the number of bytes read to compute hashes
  */
-DDB_DLL void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entry, bool wishHash = true);
+DDB_DLL void parseEntry(const fs::path &path, const fs::path &rootDirectory, Entry &entry, bool wishHash = true,
+                        std::uintmax_t *bytesHashed = nullptr);
 DDB_DLL Geographic2D getRasterCoordinate(OGRCoordinateTransformationH hTransform, double *geotransform, double x, double y);
 DDB_DLL void calculateFootprint(const SensorSize &sensorSize, const GeoLocation &geo, const Focal &focal, const CameraOrientation &cameraOri, double relAltitude, BasicGeometry &geom);
 DDB_DLL void parseDroneDBEntry(const fs::path &ddbPath, Entry &entry);
@@ -145,6 +151,7 @@ DDB_DLL void parseDroneDBEntry(const fs::path &ddbPath, Entry &entry);
 /** Identify whether a file is an Image, GeoImage, Georaster or something else
  * as quickly as possible. Does not fingerprint for other types. */
 DDB_DLL EntryType fingerprint(const fs::path &path);
+DDB_DLL EntryType fingerprint(FileProbe &probe);
 
 }
 
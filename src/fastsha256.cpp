@@ -0,0 +1,341 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "fastsha256.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DDB_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define DDB_SHA256_ARM
+#include <arm_neon.h>
+#ifdef __linux__
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace ddb {
+
+namespace {
+
+typedef void (*CompressFunc)(uint32_t state[8], const uint8_t *data, size_t blocks);
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t loadBE32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void compressPortable(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    uint32_t w[64];
+
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) w[i] = loadBE32(data + 4 * i);
+        for (int i = 16; i < 64; i++) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; i++) {
+            const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            const uint32_t ch = (e & f) ^ (~e & g);
+            const uint32_t t1 = h + s1 + ch + K[i] + w[i];
+            const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            const uint32_t t2 = s0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += FastSHA256::BlockSize;
+    }
+}
+
+#ifdef DDB_SHA256_X86
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void compressShaNi(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Rearrange the state from ABCD EFGH into ABEF CDGH
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (blocks--) {
+        const __m128i abefSave = state0;
+        const __m128i cdghSave = state1;
+
+        // Message schedule, 4 words at a time
+        __m128i w[4];
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC unroll 16
+#endif
+        for (int i = 0; i < 16; i++) {
+            __m128i msg;
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), mask);
+            } else {
+                const __m128i w4 = w[i % 4], w3 = w[(i + 1) % 4], w2 = w[(i + 2) % 4], w1 = w[(i + 3) % 4];
+                w[i % 4] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(_mm_sha256msg1_epu32(w4, w3), _mm_alignr_epi8(w1, w2, 4)), w1);
+            }
+
+            msg = _mm_add_epi32(w[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(&K[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+
+        data += FastSHA256::BlockSize;
+    }
+
+    // Back to ABCD EFGH
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+}
+
+bool cpuHasShaNi() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    const bool ssse3 = (ecx & (1u << 9)) != 0;
+    const bool sse41 = (ecx & (1u << 19)) != 0;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    const bool sha = (ebx & (1u << 29)) != 0;
+
+    return ssse3 && sse41 && sha;
+}
+
+#endif
+
+#ifdef DDB_SHA256_ARM
+
+void compressArmV8(uint32_t state[8], const uint8_t *data, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    while (blocks--) {
+        const uint32x4_t abcdSave = state0;
+        const uint32x4_t efghSave = state1;
+
+        uint32x4_t w[4];
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+            } else {
+                const uint32x4_t w4 = w[i % 4], w3 = w[(i + 1) % 4], w2 = w[(i + 2) % 4], w1 = w[(i + 3) % 4];
+                w[i % 4] = vsha256su1q_u32(vsha256su0q_u32(w4, w3), w2, w1);
+            }
+
+            const uint32x4_t msg = vaddq_u32(w[i % 4], vld1q_u32(&K[4 * i]));
+            const uint32x4_t prev = state0;
+            state0 = vsha256hq_u32(state0, state1, msg);
+            state1 = vsha256h2q_u32(state1, prev, msg);
+        }
+
+        state0 = vaddq_u32(state0, abcdSave);
+        state1 = vaddq_u32(state1, efghSave);
+
+        data += FastSHA256::BlockSize;
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+bool cpuHasArmV8Sha2() {
+#if defined(__linux__) && defined(HWCAP_SHA2)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    // Built for a target that guarantees the crypto extensions
+    return true;
+#endif
+}
+
+#endif
+
+struct Backend {
+    CompressFunc compress;
+    const char *name;
+    bool (*supported)();
+};
+
+bool alwaysSupported() { return true; }
+
+// In order of preference
+const Backend backends[] = {
+#ifdef DDB_SHA256_X86
+    {compressShaNi, "sha-ni", cpuHasShaNi},
+#endif
+#ifdef DDB_SHA256_ARM
+    {compressArmV8, "armv8", cpuHasArmV8Sha2},
+#endif
+    {compressPortable, "portable", alwaysSupported}};
+
+const Backend *detectBackend() {
+    for (const auto &b : backends) {
+        if (b.supported()) return &b;
+    }
+    return &backends[sizeof(backends) / sizeof(backends[0]) - 1];
+}
+
+std::atomic<const Backend *> currentBackend(nullptr);
+
+const Backend &backendInstance() {
+    const Backend *b = currentBackend.load(std::memory_order_relaxed);
+    if (b == nullptr) {
+        b = detectBackend();
+        currentBackend.store(b, std::memory_order_relaxed);
+    }
+    return *b;
+}
+
+}  // namespace
+
+FastSHA256::FastSHA256() { reset(); }
+
+void FastSHA256::reset() {
+    state[0] = 0x6a09e667;
+    state[1] = 0xbb67ae85;
+    state[2] = 0x3c6ef372;
+    state[3] = 0xa54ff53a;
+    state[4] = 0x510e527f;
+    state[5] = 0x9b05688c;
+    state[6] = 0x1f83d9ab;
+    state[7] = 0x5be0cd19;
+    bufferSize = 0;
+    numBytes = 0;
+}
+
+void FastSHA256::add(const void *data, size_t len) {
+    const CompressFunc compress = backendInstance().compress;
+    const uint8_t *current = static_cast<const uint8_t *>(data);
+    numBytes += len;
+
+    // Complete a partially filled block first
+    if (bufferSize > 0) {
+        const size_t n = std::min(len, BlockSize - bufferSize);
+        std::memcpy(buffer + bufferSize, current, n);
+        bufferSize += n;
+        current += n;
+        len -= n;
+
+        if (bufferSize < BlockSize) return;
+
+        compress(state, buffer, 1);
+        bufferSize = 0;
+    }
+
+    // Process full blocks straight from the input
+    const size_t blocks = len / BlockSize;
+    if (blocks > 0) {
+        compress(state, current, blocks);
+        current += blocks * BlockSize;
+        len -= blocks * BlockSize;
+    }
+
+    std::memcpy(buffer, current, len);
+    bufferSize = len;
+}
+
+void FastSHA256::getHash(unsigned char out[HashBytes]) const {
+    uint32_t finalState[8];
+    std::memcpy(finalState, state, sizeof(state));
+
+    // Padding: 0x80, zeros, then the message length in bits (big endian)
+    uint8_t tail[2 * BlockSize] = {0};
+    std::memcpy(tail, buffer, bufferSize);
+    tail[bufferSize] = 0x80;
+
+    const size_t tailSize = bufferSize + 9 <= BlockSize ? BlockSize : 2 * BlockSize;
+    const uint64_t numBits = numBytes * 8;
+    for (int i = 0; i < 8; i++) tail[tailSize - 1 - i] = static_cast<uint8_t>(numBits >> (8 * i));
+
+    backendInstance().compress(finalState, tail, tailSize / BlockSize);
+
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = static_cast<uint8_t>(finalState[i] >> 24);
+        out[4 * i + 1] = static_cast<uint8_t>(finalState[i] >> 16);
+        out[4 * i + 2] = static_cast<uint8_t>(finalState[i] >> 8);
+        out[4 * i + 3] = static_cast<uint8_t>(finalState[i]);
+    }
+}
+
+std::string FastSHA256::getHash() const {
+    unsigned char raw[HashBytes];
+    getHash(raw);
+
+    static const char dec2hex[16 + 1] = "0123456789abcdef";
+    std::string result;
+    result.reserve(2 * HashBytes);
+    for (int i = 0; i < HashBytes; i++) {
+        result += dec2hex[(raw[i] >> 4) & 15];
+        result += dec2hex[raw[i] & 15];
+    }
+
+    return result;
+}
+
+const char *FastSHA256::backend() { return backendInstance().name; }
+
+bool FastSHA256::setBackend(const std::string &name) {
+    for (const auto &b : backends) {
+        if (name == b.name && b.supported()) {
+            currentBackend.store(&b, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace ddb
@@ -0,0 +1,48 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef FASTSHA256_H
+#define FASTSHA256_H
+
+#include <stdint.h>
+#include <string>
+#include "ddb_export.h"
+
+namespace ddb {
+
+// Streaming SHA256 that picks the fastest compression function
+// supported by the CPU at runtime (SHA-NI on x86-64, the ARMv8 crypto
+// extensions on AArch64, or a portable implementation).
+// Digests are identical to those of vendor/hash-library.
+class FastSHA256 {
+   public:
+    enum { BlockSize = 64, HashBytes = 32 };
+
+    DDB_DLL FastSHA256();
+
+    DDB_DLL void add(const void *data, size_t numBytes);
+
+    // @return the hash of the data added so far as 64 hex characters
+    DDB_DLL std::string getHash() const;
+    DDB_DLL void getHash(unsigned char buffer[HashBytes]) const;
+
+    DDB_DLL void reset();
+
+    // @return the name of the compression function in use
+    // ("sha-ni", "armv8" or "portable")
+    DDB_DLL static const char *backend();
+
+    // Forces the use of a specific compression function (mostly for testing)
+    // @return false if the backend is unknown or not supported by this CPU
+    DDB_DLL static bool setBackend(const std::string &name);
+
+   private:
+    uint32_t state[8];
+    uint8_t buffer[BlockSize];
+    size_t bufferSize;
+    uint64_t numBytes;
+};
+
+}  // namespace ddb
+
+#endif  // FASTSHA256_H
@@ -0,0 +1,74 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "fileprobe.h"
+
+#include <fstream>
+
+#include "exceptions.h"
+#include "logger.h"
+
+namespace ddb {
+
+FileProbe::FileProbe(const fs::path &path)
+    : path(path),
+      exivOpened(false),
+      gdalDataset(nullptr),
+      gdalOpened(false),
+      headerRead(false) {}
+
+FileProbe::~FileProbe() {
+    if (gdalDataset != nullptr) GDALClose(gdalDataset);
+}
+
+const fs::path &FileProbe::getPath() const { return path; }
+
+Exiv2::Image *FileProbe::getExivImage() {
+    if (!exivOpened) {
+        exivOpened = true;
+
+        try {
+            exivImage = Exiv2::ImageFactory::open(path.string());
+            if (exivImage.get()) {
+                exivImage->readMetadata();
+            } else {
+                LOGD << "Cannot open " << path.string() << " with Exiv2";
+            }
+        } catch (Exiv2::AnyError &) {
+            LOGD << "Cannot read EXIF data: " << path.string();
+            exivImage.reset();
+        }
+    }
+
+    return exivImage.get();
+}
+
+GDALDatasetH FileProbe::getGDALDataset() {
+    if (!gdalOpened) {
+        gdalOpened = true;
+
+        gdalDataset = GDALOpen(path.string().c_str(), GA_ReadOnly);
+        if (gdalDataset == nullptr) {
+            LOGD << "Cannot open " << path.string() << " with GDAL";
+        }
+    }
+
+    return gdalDataset;
+}
+
+const std::string &FileProbe::getHeader() {
+    if (!headerRead) {
+        headerRead = true;
+
+        std::ifstream in(path.string(), std::ios::binary);
+        if (!in.is_open()) throw FSException("Cannot open " + path.string());
+
+        header.resize(PROBE_HEADER_SIZE);
+        in.read(&header[0], PROBE_HEADER_SIZE);
+        header.resize(static_cast<size_t>(in.gcount()));
+    }
+
+    return header;
+}
+
+}  // namespace ddb
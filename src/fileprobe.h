@@ -0,0 +1,58 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef FILEPROBE_H
+#define FILEPROBE_H
+
+#include <exiv2/exiv2.hpp>
+#include <string>
+#include "gdal_inc.h"
+#include "fs.h"
+#include "ddb_export.h"
+
+#define PROBE_HEADER_SIZE 65536
+
+namespace ddb {
+
+// Opens the containers of a file (Exiv2 image, GDAL dataset, header bytes)
+// lazily and at most once, so that type detection and property extraction
+// can share them instead of reading the same file multiple times.
+// A probe is meant to be used by a single thread.
+class FileProbe {
+    typedef decltype(Exiv2::ImageFactory::open(std::string())) ExivImagePtr;
+
+    fs::path path;
+
+    ExivImagePtr exivImage;
+    bool exivOpened;
+
+    GDALDatasetH gdalDataset;
+    bool gdalOpened;
+
+    std::string header;
+    bool headerRead;
+
+   public:
+    DDB_DLL explicit FileProbe(const fs::path &path);
+    DDB_DLL ~FileProbe();
+
+    FileProbe(const FileProbe &) = delete;
+    FileProbe &operator=(const FileProbe &) = delete;
+
+    DDB_DLL const fs::path &getPath() const;
+
+    // @return the Exiv2 image with its metadata already read,
+    // or nullptr if the file cannot be read by Exiv2
+    DDB_DLL Exiv2::Image *getExivImage();
+
+    // @return a read-only GDAL dataset owned by the probe,
+    // or nullptr if the file cannot be opened by GDAL
+    DDB_DLL GDALDatasetH getGDALDataset();
+
+    // @return up to the first PROBE_HEADER_SIZE bytes of the file
+    DDB_DLL const std::string &getHeader();
+};
+
+}  // namespace ddb
+
+#endif  // FILEPROBE_H
@@ -0,0 +1,244 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "filterexpression.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <map>
+
+#include "exceptions.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace ddb {
+
+static std::string lower(std::string s) {
+    utils::toLower(s);
+    return s;
+}
+
+FilterExpression::FilterExpression(const std::string &expr) {
+    tokenize(expr);
+
+    sql = parseOr();
+    if (tokens[cur].kind != Token::End) fail("unexpected \"" + tokens[cur].text + "\"");
+
+    LOGD << "Filter: " << sql;
+}
+
+int FilterExpression::bind(Statement *q, int first) const {
+    for (const auto &p : params) {
+        if (p.isText) q->bind(first++, p.text);
+        else q->bind(first++, p.number);
+    }
+    return first;
+}
+
+std::string FilterExpression::column(const std::string &field) {
+    static const std::map<std::string, std::string> fields = {
+        {"path", "e.path"},
+        {"hash", "e.hash"},
+        {"type", "e.type"},
+        {"size", "e.size"},
+        {"mtime", "e.mtime"},
+        {"depth", "e.depth"},
+        {"captureTime", "e.capture_time"},
+        {"longitude", "X(e.point_geom)"},
+        {"latitude", "Y(e.point_geom)"},
+        {"altitude", "Z(e.point_geom)"}
+    };
+
+    const auto f = fields.find(field);
+    if (f != fields.end()) return f->second;
+
+    std::string key = field;
+    if (key.rfind("properties.", 0) == 0) key = key.substr(11);
+
+    // The key is part of the SQL (a bound path would not match
+    // the expression indexes), so only plain names are allowed
+    for (const auto &part : utils::split(key, ".")) {
+        if (part.empty() || std::isdigit(static_cast<unsigned char>(part[0])))
+            throw InvalidArgsException("Invalid filter field: " + field);
+
+        for (const char c : part) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+                throw InvalidArgsException("Invalid filter field: " + field);
+        }
+    }
+    if (key.empty() || key.back() == '.') throw InvalidArgsException("Invalid filter field: " + field);
+
+    return "json_extract(e.properties, '$." + key + "')";
+}
+
+void FilterExpression::tokenize(const std::string &expr) {
+    size_t i = 0;
+
+    while (i < expr.size()) {
+        const char c = expr[i];
+        const char next = i + 1 < expr.size() ? expr[i + 1] : '\0';
+
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            const size_t start = i;
+            while (i < expr.size() && (std::isalnum(static_cast<unsigned char>(expr[i])) || expr[i] == '_' || expr[i] == '.')) i++;
+            tokens.push_back({Token::Identifier, expr.substr(start, i - start), 0, start});
+        } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+                   ((c == '-' || c == '+' || c == '.') && (std::isdigit(static_cast<unsigned char>(next)) || next == '.'))) {
+            char *end = nullptr;
+            const double v = std::strtod(expr.c_str() + i, &end);
+            const size_t len = end - (expr.c_str() + i);
+            if (len == 0) throw InvalidArgsException("Invalid filter expression: invalid number at position " + std::to_string(i));
+            tokens.push_back({Token::Number, expr.substr(i, len), v, i});
+            i += len;
+        } else if (c == '"' || c == '\'') {
+            const size_t start = i++;
+            std::string s;
+            while (i < expr.size() && expr[i] != c) {
+                if (expr[i] == '\\' && i + 1 < expr.size()) i++;
+                s += expr[i++];
+            }
+            if (i >= expr.size()) throw InvalidArgsException("Invalid filter expression: unterminated string at position " + std::to_string(start));
+            i++;
+            tokens.push_back({Token::String, s, 0, start});
+        } else {
+            // Two character operators first
+            const std::string two = expr.substr(i, 2);
+            if (two == "<=" || two == ">=" || two == "!=" || two == "<>" || two == "==") {
+                tokens.push_back({Token::Symbol, two, 0, i});
+                i += 2;
+            } else if (std::string("=<>(),").find(c) != std::string::npos) {
+                tokens.push_back({Token::Symbol, std::string(1, c), 0, i});
+                i++;
+            } else {
+                throw InvalidArgsException("Invalid filter expression: unexpected \"" + std::string(1, c) +
+                                           "\" at position " + std::to_string(i));
+            }
+        }
+    }
+
+    tokens.push_back({Token::End, "end of expression", 0, expr.size()});
+}
+
+// Consumes the next token if it is the given keyword (case insensitive) or symbol
+bool FilterExpression::accept(const std::string &keyword) {
+    const Token &t = tokens[cur];
+    if (t.kind == Token::Symbol && t.text == keyword) {
+        cur++;
+        return true;
+    }
+
+    if (t.kind == Token::Identifier && lower(t.text) == keyword) {
+        cur++;
+        return true;
+    }
+
+    return false;
+}
+
+void FilterExpression::expect(const std::string &keyword) {
+    if (!accept(keyword)) fail("expected \"" + keyword + "\" but found \"" + tokens[cur].text + "\"");
+}
+
+void FilterExpression::fail(const std::string &message) const {
+    throw InvalidArgsException("Invalid filter expression: " + message +
+                               " at position " + std::to_string(tokens[cur].pos));
+}
+
+std::string FilterExpression::parseOr() {
+    std::string res = parseAnd();
+    while (accept("or")) res = "(" + res + " OR " + parseAnd() + ")";
+    return res;
+}
+
+std::string FilterExpression::parseAnd() {
+    std::string res = parseNot();
+    while (accept("and")) res = "(" + res + " AND " + parseNot() + ")";
+    return res;
+}
+
+std::string FilterExpression::parseNot() {
+    if (accept("not")) return "NOT " + parseNot();
+    return parseCondition();
+}
+
+std::string FilterExpression::parseCondition() {
+    if (accept("(")) {
+        const std::string res = parseOr();
+        expect(")");
+        return res;
+    }
+
+    const Token &t = tokens[cur];
+    if (t.kind != Token::Identifier) fail("expected a field name but found \"" + t.text + "\"");
+    const std::string field = t.text;
+    const std::string col = column(field);
+    cur++;
+
+    if (accept("is")) {
+        const bool negate = accept("not");
+        expect("null");
+        return "(" + col + (negate ? " IS NOT NULL)" : " IS NULL)");
+    }
+
+    const std::string negate = accept("not") ? "NOT " : "";
+
+    if (accept("between")) {
+        const std::string from = parseValue(field);
+        expect("and");
+        return "(" + col + " " + negate + "BETWEEN " + from + " AND " + parseValue(field) + ")";
+    }
+
+    if (accept("in")) {
+        expect("(");
+        std::string values = parseValue(field);
+        while (accept(",")) values += ", " + parseValue(field);
+        expect(")");
+        return "(" + col + " " + negate + "IN (" + values + "))";
+    }
+
+    if (accept("like")) {
+        if (tokens[cur].kind != Token::String) fail("expected a string after like");
+        return "(" + col + " " + negate + "LIKE " + parseValue(field) + ")";
+    }
+
+    if (!negate.empty()) fail("expected between, in or like after not");
+
+    for (const std::string op : {"=", "==", "!=", "<>", "<", "<=", ">", ">="}) {
+        if (accept(op)) {
+            const std::string sqlOp = op == "==" ? "=" : (op == "<>" ? "!=" : op);
+            return "(" + col + " " + sqlOp + " " + parseValue(field) + ")";
+        }
+    }
+
+    fail("expected an operator but found \"" + tokens[cur].text + "\"");
+}
+
+// Adds a parameter for the next value
+// @return its placeholder
+std::string FilterExpression::parseValue(const std::string &field) {
+    const Token &t = tokens[cur];
+
+    if (t.kind == Token::Number) {
+        params.push_back({false, t.number, ""});
+    } else if (t.kind == Token::String) {
+        double millis;
+        if (field == "captureTime") {
+            if (!utils::iso8601ToMillis(t.text, millis)) fail("invalid date \"" + t.text + "\"");
+            params.push_back({false, millis, ""});
+        } else {
+            params.push_back({true, 0, t.text});
+        }
+    } else if (t.kind == Token::Identifier && (lower(t.text) == "true" || lower(t.text) == "false")) {
+        // JSON booleans are extracted as 1 and 0
+        params.push_back({false, lower(t.text) == "true" ? 1.0 : 0.0, ""});
+    } else {
+        fail("expected a value but found \"" + t.text + "\"");
+    }
+
+    cur++;
+    return "?";
+}
+
+}  // namespace ddb
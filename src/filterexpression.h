@@ -0,0 +1,78 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef FILTEREXPRESSION_H
+#define FILTEREXPRESSION_H
+
+#include <string>
+#include <vector>
+#include "statement.h"
+#include "ddb_export.h"
+
+namespace ddb {
+
+// A condition on index entries, e.g.
+//
+//   make = "DJI" and model = "FC6310" and relativeAltitude > 100
+//   and cameraYaw between -20 and 20
+//
+// compiled to SQL over the entries table (aliased as e). Fields are
+// path, hash, type, size, mtime, depth, captureTime, longitude, latitude,
+// altitude or any key of the entry properties ("properties.key" if it
+// clashes with a field, "a.b" for nested keys). Supported operators are
+// = != < <= > >=, between .. and .., in (..), like, is [not] null,
+// and, or, not and parentheses. Values are numbers, 'strings', "strings",
+// true and false; captureTime can be compared to ISO 8601 dates.
+//
+// The hot property keys (see database.cpp) have expression indexes,
+// which SQLite uses for the terms that name them.
+//
+// relativeAltitude is stored when images are parsed. Entries indexed
+// before it was have no value, so terms on it do not match them until
+// they are added again or change.
+class FilterExpression {
+    struct Token {
+        enum Kind { End, Identifier, Number, String, Symbol } kind;
+        std::string text;
+        double number;
+        size_t pos;
+    };
+
+    struct Param {
+        bool isText;
+        double number;
+        std::string text;
+    };
+
+    std::vector<Token> tokens;
+    size_t cur = 0;
+    std::vector<Param> params;
+
+    void tokenize(const std::string &expr);
+    bool accept(const std::string &keyword);
+    void expect(const std::string &keyword);
+    [[noreturn]] void fail(const std::string &message) const;
+
+    std::string parseOr();
+    std::string parseAnd();
+    std::string parseNot();
+    std::string parseCondition();
+    std::string parseValue(const std::string &field);
+
+   public:
+    // @throws InvalidArgsException if the expression is not valid
+    DDB_DLL explicit FilterExpression(const std::string &expr);
+
+    std::string sql;
+
+    // @return the index of the next parameter
+    DDB_DLL int bind(Statement *q, int first) const;
+
+    // SQL expression that reads a field
+    // @throws InvalidArgsException if the name is not valid
+    DDB_DLL static std::string column(const std::string &field);
+};
+
+}  // namespace ddb
+
+#endif  // FILTEREXPRESSION_H
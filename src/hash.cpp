@@ -1,40 +1,247 @@
 /* This Source Code Form is subject to the terms of the Mozilla Public
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 #include "hash.h"
 #include "exceptions.h"
+#include "fastsha256.h"
+#include "blake3hash.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace ddb;
 
-std::string Hash::fileSHA256(const std::string &path) {
+namespace {
+
+#ifndef WIN32
+// Closes a file descriptor when going out of scope
+struct FdCloser {
+    int fd;
+    ~FdCloser() { close(fd); }
+};
+#endif
+
+// Reads a file sequentially in large aligned chunks. On POSIX systems the kernel
+// is told that access is sequential, and large files are dropped from the page
+// cache once read, so that hashing large datasets does not evict everything
+// else from memory.
+void readFileChunks(const std::string &path, const std::function<void(const char *, size_t)> &onChunk) {
+    const size_t BufferSize = 4 * 1024 * 1024;
+
+#ifndef WIN32
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw FSException("Cannot open " + path + " for hashing");
+    }
+    FdCloser closer{fd};
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // Small files don't need (and shouldn't pay for) a large buffer
+    size_t bufferSize = BufferSize;
+    bool dropCache = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= 0) {
+        const size_t fileBufferSize = (static_cast<size_t>(st.st_size) / 4096 + 1) * 4096;
+        bufferSize = std::min(BufferSize, fileBufferSize);
+        dropCache = static_cast<unsigned long long>(st.st_size) >= HASH_DROP_CACHE_MIN_FILE_SIZE;
+    }
+
+    void *mem = nullptr;
+    if (posix_memalign(&mem, 4096, bufferSize) != 0) throw AppException("Cannot allocate hashing buffer");
+    std::unique_ptr<char, decltype(&free)> buffer(static_cast<char *>(mem), &free);
+
+    for (;;) {
+        const ssize_t numBytesRead = read(fd, buffer.get(), bufferSize);
+        if (numBytesRead < 0) {
+            if (errno == EINTR) continue;
+            throw FSException("Cannot read " + path + " for hashing");
+        }
+        if (numBytesRead == 0) break;
+
+        onChunk(buffer.get(), static_cast<size_t>(numBytesRead));
+    }
+
+#ifdef POSIX_FADV_DONTNEED
+    if (dropCache) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    (void)dropCache;
+#endif
+#else
     std::ifstream f(path, std::ios::binary);
     if (!f.is_open()) {
         throw FSException("Cannot open " + path + " for hashing");
     }
 
-    const size_t BufferSize = 144*7*1024;
-    char* buffer = new char[BufferSize];
-    SHA256 digestSha2;
+    std::vector<char> buffer(BufferSize);
 
     while (f) {
-        f.read(buffer, BufferSize);
-        size_t numBytesRead = size_t(f.gcount());
-        digestSha2.add(buffer, numBytesRead);
+        f.read(buffer.data(), BufferSize);
+        onChunk(buffer.data(), size_t(f.gcount()));
+    }
+#endif
+}
+
+// Keeps the head and the tail of data read sequentially,
+// to compute its quick hash without reading it again
+class QuickHashChunks {
+    std::string head;
+    std::string tail;
+    uint64_t size = 0;
+
+   public:
+    void add(const char *data, size_t len) {
+        size += len;
+
+        if (head.size() < QUICK_HASH_CHUNK_SIZE) {
+            const size_t take = std::min<size_t>(len, QUICK_HASH_CHUNK_SIZE - head.size());
+            head.append(data, take);
+        }
+
+        if (len >= QUICK_HASH_CHUNK_SIZE) {
+            tail.assign(data + len - QUICK_HASH_CHUNK_SIZE, QUICK_HASH_CHUNK_SIZE);
+        } else {
+            tail.append(data, len);
+            if (tail.size() > QUICK_HASH_CHUNK_SIZE) tail.erase(0, tail.size() - QUICK_HASH_CHUNK_SIZE);
+        }
     }
 
-    f.close();
-    delete[] buffer;
+    // Same as Hash::fileQuickHash
+    std::string getHash() const {
+        const std::string sizeStr = std::to_string(size);
+
+        FastSHA256 digestSha2;
+        digestSha2.add(sizeStr.c_str(), sizeStr.length());
+        digestSha2.add(head.data(), head.size());
+
+        // Tail (without overlapping the head)
+        if (size > QUICK_HASH_CHUNK_SIZE) {
+            const uint64_t tailStart = std::max<uint64_t>(QUICK_HASH_CHUNK_SIZE, size - QUICK_HASH_CHUNK_SIZE);
+            const size_t tailLen = static_cast<size_t>(size - tailStart);
+            digestSha2.add(tail.data() + tail.size() - tailLen, tailLen);
+        }
+
+        return digestSha2.getHash();
+    }
+};
+
+}  // namespace
+
+std::string Hash::fileSHA256(const std::string &path, std::string *quickHash) {
+    FastSHA256 digestSha2;
+    QuickHashChunks quick;
+
+    readFileChunks(path, [&digestSha2, &quick, quickHash](const char *data, size_t size) {
+        digestSha2.add(data, size);
+        if (quickHash != nullptr) quick.add(data, size);
+    });
+
+    if (quickHash != nullptr) *quickHash = quick.getHash();
+    return digestSha2.getHash();
+}
+
+std::string Hash::fileBLAKE3(const std::string &path, int threads, std::string *quickHash) {
+    Blake3Hash digestBlake3(threads);
+    QuickHashChunks quick;
+
+    readFileChunks(path, [&digestBlake3, &quick, quickHash](const char *data, size_t size) {
+        digestBlake3.add(data, size);
+        if (quickHash != nullptr) quick.add(data, size);
+    });
+
+    if (quickHash != nullptr) *quickHash = quick.getHash();
+    return digestBlake3.getHash();
+}
+
+void Hash::fileSHA256AndBLAKE3(const std::string &path, std::string &sha256, std::string &blake3, int threads,
+                               std::string *quickHash) {
+    FastSHA256 digestSha2;
+    Blake3Hash digestBlake3(threads);
+    QuickHashChunks quick;
+
+    readFileChunks(path, [&digestSha2, &digestBlake3, &quick, quickHash](const char *data, size_t size) {
+        digestBlake3.add(data, size);
+        digestSha2.add(data, size);
+        if (quickHash != nullptr) quick.add(data, size);
+    });
+
+    if (quickHash != nullptr) *quickHash = quick.getHash();
+    sha256 = digestSha2.getHash();
+    blake3 = digestBlake3.getHash();
+}
+
+std::string Hash::fileQuickHash(const std::string &path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f.is_open()) {
+        throw FSException("Cannot open " + path + " for hashing");
+    }
+
+    const auto size = static_cast<uint64_t>(f.tellg());
+    const std::string sizeStr = std::to_string(size);
+
+    FastSHA256 digestSha2;
+    digestSha2.add(sizeStr.c_str(), sizeStr.length());
+
+    std::vector<char> buffer(QUICK_HASH_CHUNK_SIZE);
+
+    // Head
+    f.seekg(0);
+    f.read(buffer.data(), QUICK_HASH_CHUNK_SIZE);
+    digestSha2.add(buffer.data(), size_t(f.gcount()));
+
+    // Tail (without overlapping the head)
+    if (size > QUICK_HASH_CHUNK_SIZE) {
+        const uint64_t tailStart = std::max<uint64_t>(QUICK_HASH_CHUNK_SIZE, size - QUICK_HASH_CHUNK_SIZE);
+        f.seekg(static_cast<std::streamoff>(tailStart));
+        f.read(buffer.data(), static_cast<std::streamsize>(size - tailStart));
+        digestSha2.add(buffer.data(), size_t(f.gcount()));
+    }
 
     return digestSha2.getHash();
 }
 
 std::string Hash::strSHA256(const std::string &str){
-    SHA256 digestSha2;
+    FastSHA256 digestSha2;
     digestSha2.add(str.c_str(), str.length());
     return digestSha2.getHash();
 }
 
+std::string Hash::dataSHA256(const char *data, size_t size) {
+    FastSHA256 digestSha2;
+    digestSha2.add(data, size);
+    return digestSha2.getHash();
+}
+
+std::string Hash::dataQuickHash(const char *data, size_t size) {
+    const std::string sizeStr = std::to_string(size);
+
+    FastSHA256 digestSha2;
+    digestSha2.add(sizeStr.c_str(), sizeStr.length());
+
+    const size_t headSize = std::min<size_t>(QUICK_HASH_CHUNK_SIZE, size);
+    digestSha2.add(data, headSize);
+
+    if (size > QUICK_HASH_CHUNK_SIZE) {
+        const size_t tailStart = std::max<size_t>(QUICK_HASH_CHUNK_SIZE, size - QUICK_HASH_CHUNK_SIZE);
+        digestSha2.add(data + tailStart, size - tailStart);
+    }
+
+    return digestSha2.getHash();
+}
+
 std::string Hash::strCRC64(const std::string &str){
     return Hash::strCRC64(str.c_str(), str.length());
 }
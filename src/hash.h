@@ -10,6 +10,18 @@
 #include "ddb_export.h"
 #include "../vendor/hash-library/sha256.h"
 
+// Number of bytes read from the beginning and from the end
+// of a file to compute its quick hash
+#define QUICK_HASH_CHUNK_SIZE (1024 * 1024)
+
+// Files at least this large also get a BLAKE3 digest, which
+// can be verified using all cores instead of one
+#define BLAKE3_MIN_FILE_SIZE (256ULL * 1024 * 1024)
+
+// Files at least this large are dropped from the page cache once hashed,
+// smaller ones are left there for the parsers that read them next
+#define HASH_DROP_CACHE_MIN_FILE_SIZE (64ULL * 1024 * 1024)
+
 static const uint64_t crc64_table[256] = {
     uint64_t(0x0000000000000000), uint64_t(0x7ad870c830358979),
     uint64_t(0xf5b0e190606b12f2), uint64_t(0x8f689158505e9b8b),
@@ -143,9 +155,27 @@ static const uint64_t crc64_table[256] = {
 
 class Hash{
 public:
-    DDB_DLL static std::string fileSHA256(const std::string &path);
+    // @param quickHash if set, receives the fileQuickHash of the file,
+    //        taken from the data read for the full hash
+    DDB_DLL static std::string fileSHA256(const std::string &path, std::string *quickHash = nullptr);
+
+    // SHA256 of the file size plus its first and last QUICK_HASH_CHUNK_SIZE bytes.
+    // Cheap to compute for large files, but does not detect changes in the middle.
+    DDB_DLL static std::string fileQuickHash(const std::string &path);
     DDB_DLL static std::string strSHA256(const std::string &str);
 
+    // Same as fileSHA256 and fileQuickHash, for file contents already in memory
+    DDB_DLL static std::string dataSHA256(const char *data, size_t size);
+    DDB_DLL static std::string dataQuickHash(const char *data, size_t size);
+
+    // BLAKE3 of the file, hashed with multiple threads (0 = one per CPU,
+    // or one per idle CPU when called from a work queue job)
+    DDB_DLL static std::string fileBLAKE3(const std::string &path, int threads = 0, std::string *quickHash = nullptr);
+
+    // Computes both digests reading the file only once
+    DDB_DLL static void fileSHA256AndBLAKE3(const std::string &path, std::string &sha256, std::string &blake3, int threads = 0,
+                                            std::string *quickHash = nullptr);
+
     DDB_DLL static std::string strCRC64(const std::string &str);
     DDB_DLL static std::string strCRC64(const char *str, uint64_t size);
 };
@@ -11,14 +11,6 @@ namespace ddb {
 void info(const std::vector<std::string> &input, std::ostream &output,
           const std::string &format, bool recursive, int maxRecursionDepth, const std::string &geometry,
           bool withHash, bool stopOnError){
-    std::vector<fs::path> filePaths;
-
-    if (recursive){
-        filePaths = getPathList(input, true, maxRecursionDepth);
-    }else{
-        filePaths = std::vector<fs::path>(input.begin(), input.end());
-    }
-
     if (format == "json"){
         output << "[";
     }else if (format == "geojson"){
@@ -32,7 +24,7 @@ void info(const std::vector<std::string> &input, std::ostream &output,
 
     bool first = true;
 
-    for (auto &fp : filePaths){
+    auto parse = [&](const fs::path &fp){
         LOGD << "Parsing entry " << fp.string();
 
         try{
@@ -65,6 +57,16 @@ void info(const std::vector<std::string> &input, std::ostream &output,
             LOGD << "Cannot parse " << fp.string() << ", skipping: " << e.what();
             if (stopOnError) throw e;
         }
+    };
+
+    if (recursive){
+        // Entries are printed as the walk finds them
+        walkPathList(input, true, maxRecursionDepth, true, [&parse](const WalkEntry &we){
+            parse(we.path);
+            return true;
+        });
+    }else{
+        for (const auto &fp : input) parse(fp);
     }
 
     if (format == "json"){
@@ -15,9 +15,11 @@ std::string MetaManager::entryPath(const std::string &path, const std::string &c
 
     std::string relPath = p.relativeTo(db->rootDirectory()).generic();
 
-    const auto q = db->query("SELECT 1 FROM entries WHERE path = ?");
+    const auto q = db->cachedQuery("SELECT 1 FROM entries WHERE path = ?");
     q->bind(1, relPath);
-    if (!q->fetch()) throw InvalidArgsException("Path " + relPath + " not available in index");
+    const bool exists = q->fetch();
+    q->reset();
+    if (!exists) throw InvalidArgsException("Path " + relPath + " not available in index");
 
     return relPath;
 }
@@ -96,6 +98,7 @@ json MetaManager::add(const std::string &key, const std::string &data, const std
     q->execute();
 
     auto result = getMetaJson("SELECT id, data, mtime FROM entries_meta WHERE rowid = last_insert_rowid()");
+    db->updateChecksums();
 
     return result;
 }
@@ -119,7 +122,11 @@ json MetaManager::set(const std::string &key, const std::string &data, const std
     iq->bind(3, eData);
     iq->bind(4, eMtime);
     iq->execute();
-    return getMetaJson("SELECT id, data, mtime FROM entries_meta WHERE rowid = last_insert_rowid()");
+
+    auto result = getMetaJson("SELECT id, data, mtime FROM entries_meta WHERE rowid = last_insert_rowid()");
+    db->updateChecksums();
+
+    return result;
 }
 
 json MetaManager::remove(const std::string &id){
@@ -129,6 +136,7 @@ json MetaManager::remove(const std::string &id){
     q->execute();
     json j;
     j["removed"] = db->changes();
+    db->updateChecksums();
     return j;
 }
 
@@ -162,6 +170,7 @@ json MetaManager::unset(const std::string &key, const std::string &path, const s
 
     json j;
     j["removed"] = db->changes();
+    db->updateChecksums();
     return j;
 }
 
@@ -223,11 +232,17 @@ json MetaManager::dump(const json &ids){
 json MetaManager::restore(const json &metaDump){
     if (!metaDump.is_array()) throw InvalidArgsException("metaDump must be an array");
 
+    BulkLoad bulkLoad(db);
     db->exec("BEGIN EXCLUSIVE TRANSACTION");
 
-    const auto q = db->query("INSERT OR REPLACE INTO entries_meta(id, path, key, data, mtime) VALUES (?, ?, ?, ?, ?)");
+    const auto q = db->query("INSERT INTO entries_meta(id, path, key, data, mtime) VALUES (?, ?, ?, ?, ?)");
     const auto singularDupQ = db->query("SELECT id,mtime FROM entries_meta WHERE path = ? AND key = ?");
 
+    // A row with the same id is deleted first rather than replaced: REPLACE
+    // does not fire the delete triggers, which keep the folder checksums and
+    // the text index of the row's old path up to date
+    const auto deleteQ = db->query("DELETE FROM entries_meta WHERE id = ?");
+
     int i = 0;
     for (auto &meta : metaDump){
         // Quick validation
@@ -267,6 +282,9 @@ json MetaManager::restore(const json &metaDump){
             if (newerMetaExists) continue; // Do not add ours
         }
 
+        deleteQ->bind(1, meta["id"].get<std::string>());
+        deleteQ->execute();
+
         q->bind(1, meta["id"].get<std::string>());
         q->bind(2, path);
         q->bind(3, key);
@@ -276,7 +294,10 @@ json MetaManager::restore(const json &metaDump){
         i++;
     }
 
+    db->updateChecksums();
     db->exec("COMMIT");
+    bulkLoad.end();
+
     json j;
     j["restored"] = i;
     return j;
@@ -294,6 +315,7 @@ DDB_DLL json MetaManager::bulkRemove(const std::vector<std::string> &ids){
         i++;
     }
 
+    db->updateChecksums();
     db->exec("COMMIT");
 
     json j;
@@ -13,6 +13,10 @@ DDB_DLL bool getPlyInfo(const fs::path &plyFile, PlyInfo &info){
     std::ifstream in(plyFile.string());
     if (!in.is_open()) throw FSException("Cannot open " + plyFile.string());
 
+    return getPlyInfo(in, info);
+}
+
+bool getPlyInfo(std::istream &in, PlyInfo &info){
     int i = 0;
     std::string line;
 
@@ -57,8 +61,15 @@ DDB_DLL bool getPlyInfo(const fs::path &plyFile, PlyInfo &info){
 }
 
 EntryType identifyPly(const fs::path &plyFile){
+    std::ifstream in(plyFile.string());
+    if (!in.is_open()) throw FSException("Cannot open " + plyFile.string());
+
+    return identifyPly(in);
+}
+
+EntryType identifyPly(std::istream &in){
     PlyInfo info;
-    if (getPlyInfo(plyFile, info)){
+    if (getPlyInfo(in, info)){
         if (info.isMesh){
             // We do not support textured PLY models
             // (nexus has trouble building some of them?)
@@ -6,6 +6,7 @@
 
 #include <vector>
 #include <string>
+#include <istream>
 #include "fs.h"
 #include "entry_types.h"
 #include "ddb_export.h"
@@ -20,7 +21,9 @@ struct PlyInfo{
 };
 
 DDB_DLL EntryType identifyPly(const fs::path &plyFile);
+DDB_DLL EntryType identifyPly(std::istream &in);
 DDB_DLL bool getPlyInfo(const fs::path &plyFile, PlyInfo &info);
+DDB_DLL bool getPlyInfo(std::istream &in, PlyInfo &info);
 
 }
 #endif // PLY_H
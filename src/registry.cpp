@@ -337,6 +337,7 @@ void ensureParentFolderExists(const fs::path &folder) {
 
 std::vector<Conflict> applyDelta(const Delta &d, const fs::path &sourcePath, Database *destination, const MergeStrategy mergeStrategy, const json &sourceMetaDump, std::ostream& out) {
     std::vector<Conflict> conflicts;
+    BulkLoad bulkLoad(destination);
 
     // File operations
     if (d.adds.size() > 0 || d.removes.size() > 0){
@@ -473,6 +474,8 @@ std::vector<Conflict> applyDelta(const Delta &d, const fs::path &sourcePath, Dat
         destination->getMetaManager()->bulkRemove(d.metaRemoves);
     }
 
+    bulkLoad.end();
+
     return conflicts;
 }
 
@@ -585,7 +588,7 @@ std::unordered_map<std::string, bool> computeDeltaLocals(Delta d, Database *db,
     // validating that they are indeed the same
     // This function creates hard links only if hlDestFolder is set
     // Otherwise it just returns the map of valid local hashes
-    const auto q = db->query("SELECT path,mtime FROM entries WHERE hash = ?");
+    const auto q = db->query("SELECT path,mtime,blake3 FROM entries WHERE hash = ?");
     std::unordered_map<std::string, bool> localMap;
 
     std::unordered_map<std::string, bool> addsMap;
@@ -607,8 +610,14 @@ std::unordered_map<std::string, bool> computeDeltaLocals(Delta d, Database *db,
             if (p.getModifiedTime() == eMtime){
                 valid = true;
             }else{
-                // Actually compute hash
-                valid = Hash::fileSHA256(p.get().string()) == add.hash;
+                // Actually compute hash (large files have a BLAKE3
+                // hash that can be verified using all cores)
+                const std::string eBlake3 = q->getText(2);
+                if (!eBlake3.empty()){
+                    valid = Hash::fileBLAKE3(p.get().string()) == eBlake3;
+                }else{
+                    valid = Hash::fileSHA256(p.get().string()) == add.hash;
+                }
             }
 
             if (valid){
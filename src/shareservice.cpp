@@ -24,8 +24,12 @@ std::string ShareService::share(const std::vector<std::string> &input,
                                 const ShareCallback &cb) {
     if (input.empty()) throw InvalidArgsException("No files to share");
 
-    std::vector<fs::path> filePaths =
-        getPathList(input, false, recursive ? 0 : 1);
+    // The walk gives us the file sizes, no need to stat again
+    std::vector<WalkEntry> fileEntries;
+    walkPathList(input, false, recursive ? 0 : 1, true, [&fileEntries](const WalkEntry &e) {
+        fileEntries.push_back(e);
+        return true;
+    });
 
     // Parse tag to find registry URL
     TagComponents tc = RegistryUtils::parseTag(tag);
@@ -72,13 +76,14 @@ std::string ShareService::share(const std::vector<std::string> &input,
     auto lastProgressUpdate = std::chrono::system_clock::now();
     auto t100ms = std::chrono::milliseconds(100);
 
-    for (auto &fp : filePaths) {
-        gTotalBytes += io::Path(fp).getSize();
+    for (auto &fe : fileEntries) {
+        gTotalBytes += fe.size;
     }
 
-    for (auto &fp : filePaths) {
+    for (auto &fe : fileEntries) {
+        const fs::path &fp = fe.path;
         auto p = io::Path(fp);
-        auto fileSize = p.getSize();
+        auto fileSize = fe.size;
         auto fileName = fp.filename().string();
 
         LOGD << "Current Path = " << fp;
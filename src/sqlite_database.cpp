@@ -14,10 +14,17 @@ namespace ddb{
 
 SqliteDatabase::SqliteDatabase() : db(nullptr) {}
 
-SqliteDatabase &SqliteDatabase::open(const std::string &file) {
+SqliteDatabase &SqliteDatabase::open(const std::string &file, bool readOnly) {
     if (db != nullptr) throw DBException("Can't open database " + file + ", one is already open (" + openFile + ")");
-    LOGD << "Opening connection to " << file;
-    if( sqlite3_open(file.c_str(), &db) != SQLITE_OK ) throw DBException("Can't open database: " + file);
+    LOGD << "Opening " << (readOnly ? "read-only " : "") << "connection to " << file;
+
+    const int flags = readOnly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if( sqlite3_open_v2(file.c_str(), &db, flags, nullptr) != SQLITE_OK ) {
+        // A handle is returned even on failure
+        sqlite3_close(db);
+        db = nullptr;
+        throw DBException("Can't open database: " + file);
+    }
 
     this->openFile = file;
     this->afterOpen();
@@ -30,6 +37,10 @@ void SqliteDatabase::afterOpen(){
 }
 
 SqliteDatabase &SqliteDatabase::close() {
+    // Statements must be finalized before closing
+    statementCacheIndex.clear();
+    statementCache.clear();
+
     if (db != nullptr) {
         LOGD << "Closing connection to " << openFile;
         sqlite3_close(db);
@@ -41,7 +52,8 @@ SqliteDatabase &SqliteDatabase::close() {
 
 SqliteDatabase &SqliteDatabase::reopen(){
     if (openFile.empty() || db == nullptr) throw DBException("Cannot reopen unopened database");
-    return this->close().open(openFile);
+    const bool readOnly = this->isReadOnly();
+    return this->close().open(openFile, readOnly);
 }
 
 SqliteDatabase &SqliteDatabase::exec(const std::string &sql) {
@@ -68,6 +80,29 @@ bool SqliteDatabase::tableExists(const std::string &table){
     return false;
 }
 
+bool SqliteDatabase::indexExists(const std::string &index){
+    auto q = query("SELECT count(*) FROM sqlite_master WHERE type='index' AND name=?");
+    q->bind(1, index);
+
+    if (q->fetch()){
+        return q->getInt(0) == 1;
+    }
+
+    return false;
+}
+
+bool SqliteDatabase::columnExists(const std::string &table, const std::string &column){
+    auto q = query("SELECT count(*) FROM pragma_table_info(?) WHERE name=?");
+    q->bind(1, table);
+    q->bind(2, column);
+
+    if (q->fetch()){
+        return q->getInt(0) == 1;
+    }
+
+    return false;
+}
+
 std::string SqliteDatabase::getOpenFile() const{
     return openFile;
 }
@@ -78,6 +113,51 @@ int SqliteDatabase::changes(){
     return sqlite3_changes(db);
 }
 
+int SqliteDatabase::totalChanges(){
+    return sqlite3_total_changes(db);
+}
+
+bool SqliteDatabase::inTransaction(){
+    return sqlite3_get_autocommit(db) == 0;
+}
+
+bool SqliteDatabase::isReadOnly(){
+    return sqlite3_db_readonly(db, "main") == 1;
+}
+
+bool SqliteDatabase::hasActiveStatements(){
+    for (sqlite3_stmt *s = sqlite3_next_stmt(db, nullptr); s != nullptr; s = sqlite3_next_stmt(db, s)){
+        if (sqlite3_stmt_busy(s)) return true;
+    }
+
+    return false;
+}
+
+long long SqliteDatabase::dataVersion(){
+    auto q = cachedQuery("PRAGMA data_version");
+    const long long version = q->fetch() ? q->getInt64(0) : 0;
+    q->reset();
+    return version;
+}
+
+int SqliteDatabase::getUserVersion(){
+    auto q = cachedQuery("PRAGMA user_version");
+    const int version = q->fetch() ? q->getInt(0) : 0;
+    q->reset();
+    return version;
+}
+
+void SqliteDatabase::setUserVersion(int version){
+    this->exec("PRAGMA user_version=" + std::to_string(version) + ";");
+}
+
+long long SqliteDatabase::schemaVersion(){
+    auto q = cachedQuery("PRAGMA schema_version");
+    const long long version = q->fetch() ? q->getInt64(0) : 0;
+    q->reset();
+    return version;
+}
+
 void SqliteDatabase::setJournalMode(const std::string &mode){
     this->exec("PRAGMA journal_mode=" + mode + ";");
 }
@@ -115,6 +195,34 @@ std::unique_ptr<Statement> SqliteDatabase::query(const std::string &query) const
     return std::make_unique<Statement>(db, query);
 }
 
+Statement *SqliteDatabase::cachedQuery(const std::string &query) const{
+    const auto it = statementCacheIndex.find(query);
+    if (it != statementCacheIndex.end()){
+        statementCache.splice(statementCache.begin(), statementCache, it->second);
+        Statement *q = it->second->second.get();
+
+        // If its last use failed, SQLite reports
+        // the error again on the first reset
+        try{
+            q->reset();
+        }catch(const SQLException &){
+            q->reset();
+        }
+
+        return q;
+    }
+
+    statementCache.emplace_front(query, std::make_unique<Statement>(db, query, true));
+    statementCacheIndex[query] = statementCache.begin();
+
+    if (statementCache.size() > STATEMENT_CACHE_SIZE){
+        statementCacheIndex.erase(statementCache.back().first);
+        statementCache.pop_back();
+    }
+
+    return statementCache.front().second.get();
+}
+
 SqliteDatabase::~SqliteDatabase() {
     this->close();
 }
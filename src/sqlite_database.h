@@ -10,8 +10,10 @@
 #include <spatialite/gaiageo.h>
 #include <spatialite.h>
 
+#include <list>
 #include <string>
 #include <memory>
+#include <unordered_map>
 
 #include "statement.h"
 #include "fs.h"
@@ -19,26 +21,57 @@
 
 namespace ddb{
 
+// Number of prepared statements kept by a connection for cachedQuery
+#define STATEMENT_CACHE_SIZE 64
+
 class SqliteDatabase {
+    typedef std::list<std::pair<std::string, std::unique_ptr<Statement>>> StatementList;
+
+    // Most recently used first
+    mutable StatementList statementCache;
+    mutable std::unordered_map<std::string, StatementList::iterator> statementCacheIndex;
   protected:
     sqlite3 *db;
     std::string openFile;
   public:
     DDB_DLL SqliteDatabase();
-    DDB_DLL SqliteDatabase &open(const std::string &file);
+    // @param readOnly open the file with SQLITE_OPEN_READONLY, any write fails
+    DDB_DLL SqliteDatabase &open(const std::string &file, bool readOnly = false);
     DDB_DLL virtual void afterOpen();
     DDB_DLL SqliteDatabase &close();
     DDB_DLL SqliteDatabase &reopen();
     DDB_DLL SqliteDatabase &exec(const std::string &sql);
     DDB_DLL bool tableExists(const std::string &table);
+    DDB_DLL bool indexExists(const std::string &index);
+    DDB_DLL bool columnExists(const std::string &table, const std::string &column);
     DDB_DLL std::string getOpenFile() const;
     DDB_DLL int changes();
+    DDB_DLL int totalChanges();
+    DDB_DLL bool inTransaction();
+    DDB_DLL bool isReadOnly();
+
+    // Whether a statement is in the middle of a query (not reset or done)
+    DDB_DLL bool hasActiveStatements();
+
+    // PRAGMA data_version, which changes when other connections commit
+    DDB_DLL long long dataVersion();
+    DDB_DLL long long schemaVersion();
+
+    // PRAGMA user_version, which SQLite leaves to applications
+    DDB_DLL int getUserVersion();
+    DDB_DLL void setUserVersion(int version);
     DDB_DLL void setJournalMode(const std::string &mode);
     DDB_DLL void setWritableSchema(bool enabled);
     DDB_DLL bool renameColumnIfExists(const std::string &table, const std::string &columnDefBefore, const std::string &columnDefAfter);
 
     DDB_DLL std::unique_ptr<Statement> query(const std::string &query) const;
 
+    // A statement prepared once per connection and reused, for the queries
+    // that run many times. It's reset when handed out, callers should reset
+    // it when they are done (execute() does) and must not use it after
+    // asking for STATEMENT_CACHE_SIZE other queries or closing the database.
+    DDB_DLL Statement *cachedQuery(const std::string &query) const;
+
     DDB_DLL ~SqliteDatabase();
 };
 
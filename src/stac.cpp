@@ -5,6 +5,7 @@
 #include "logger.h"
 #include "exceptions.h"
 #include "mio.h"
+#include "utils.h"
 #include "curl_inc.h"
 #include "ddb.h"
 #include "thumbs.h"
@@ -47,7 +48,8 @@ json generateStac(const std::string &ddbPath,
                                 ELSE NULL
                            END AS geom,
                            AsWKT(Extent(GUnion(polygon_geom, ConvexHull(point_geom)))) AS bbox,
-                           type
+                           type,
+                           capture_time
                     FROM entries WHERE path = ?
                 )<<<");
         q->bind(1, entry);
@@ -64,6 +66,10 @@ json generateStac(const std::string &ddbPath,
                 throw AppException(std::string("Invalid entry JSON: ") + e.what());
             }
 
+            if (!q->getText(5).empty() && j["properties"].is_object()){
+                j["properties"]["datetime"] = utils::millisToIso8601(q->getDouble(5));
+            }
+
             const auto bbox = wktBboxCoordinates(q->getText(3));
             if (bbox.size() > 0){
                 j["bbox"] = json::array({bbox});
@@ -7,9 +7,10 @@
 
 using namespace ddb;
 
-Statement::Statement(sqlite3 *db, const std::string &query)
+Statement::Statement(sqlite3 *db, const std::string &query, bool persistent)
     : db(db), query(query), hasRow(false), done(false) {
-    if (sqlite3_prepare_v2(db, query.c_str(), static_cast<int>(query.length()), &stmt, nullptr) != SQLITE_OK) {
+    if (sqlite3_prepare_v3(db, query.c_str(), static_cast<int>(query.length()),
+                           persistent ? SQLITE_PREPARE_PERSISTENT : 0, &stmt, nullptr) != SQLITE_OK) {
         throw SQLException("Cannot prepare SQL statement: " + query + ": " + std::string(sqlite3_errmsg(db)));
     }
 }
@@ -45,6 +46,24 @@ Statement &Statement::bind(int paramNum, long long value) {
     return *this;
 }
 
+Statement &Statement::bind(int paramNum, double value) {
+    assert(stmt != nullptr && db != nullptr);
+    bindCheck(sqlite3_bind_double(stmt, paramNum, value));
+    return *this;
+}
+
+Statement &Statement::bind(int paramNum, const void *data, int size) {
+    assert(stmt != nullptr && db != nullptr);
+    bindCheck(sqlite3_bind_blob(stmt, paramNum, data, size, SQLITE_TRANSIENT));
+    return *this;
+}
+
+Statement &Statement::bindNull(int paramNum) {
+    assert(stmt != nullptr && db != nullptr);
+    bindCheck(sqlite3_bind_null(stmt, paramNum));
+    return *this;
+}
+
 Statement &Statement::step() {
     assert(stmt != nullptr);
 
@@ -95,6 +114,18 @@ const void* Statement::getBlob(int columnId){
     return sqlite3_column_blob(stmt, columnId);
 }
 
+int Statement::getBytes(int columnId){
+    assert(stmt != nullptr);
+    return sqlite3_column_bytes(stmt, columnId);
+}
+
+std::string_view Statement::getTextView(int columnId){
+    assert(stmt != nullptr);
+    const auto res = reinterpret_cast<const char*>(sqlite3_column_text(stmt, columnId));
+    if (res == nullptr) return std::string_view();
+    return std::string_view(res, static_cast<size_t>(sqlite3_column_bytes(stmt, columnId)));
+}
+
 double Statement::getDouble(int columnId){
     assert(stmt != nullptr);
     return sqlite3_column_double(stmt, columnId);
@@ -7,6 +7,7 @@
 
 #include <sqlite3.h>
 #include <string>
+#include <string_view>
 #include "logger.h"
 #include "ddb_export.h"
 
@@ -22,12 +23,18 @@ class Statement {
     void bindCheck(int ret);
     Statement &step();
   public:
-    DDB_DLL Statement(sqlite3 *db, const std::string &query);
+    // @param persistent hint SQLite that the statement will be reused many times
+    DDB_DLL Statement(sqlite3 *db, const std::string &query, bool persistent = false);
     DDB_DLL ~Statement();
 
     DDB_DLL Statement &bind(int paramNum, const std::string &value);
     DDB_DLL Statement &bind(int paramNum, int value);
     DDB_DLL Statement &bind(int paramNum, long long value);
+    DDB_DLL Statement &bind(int paramNum, double value);
+
+    // Binds a blob (the data is copied)
+    DDB_DLL Statement &bind(int paramNum, const void *data, int size);
+    DDB_DLL Statement &bindNull(int paramNum);
 
     DDB_DLL bool fetch();
 
@@ -37,6 +44,13 @@ class Statement {
     DDB_DLL double getDouble(int columnId);
     DDB_DLL const void *getBlob(int columnId);
 
+    // Size in bytes of a text or blob column (call after getBlob)
+    DDB_DLL int getBytes(int columnId);
+
+    // Text of a column without copying it, valid until
+    // the next fetch() or reset()
+    DDB_DLL std::string_view getTextView(int columnId);
+
     DDB_DLL int getColumnsCount() const;
     // TODO: more
 
@@ -5,74 +5,186 @@
 #include "dbops.h"
 #include "status.h"
 
+#include <algorithm>
+#include <deque>
 
 #include <ddb.h>
 #include <mio.h>
 
 #include "exceptions.h"
+#include "walker.h"
+#include "workqueue.h"
 
 namespace ddb
 {
 
-	void statusIndex(Database* db, const FileStatusCallback& cb)
+namespace {
+
+	// Returns the entries below a directory in the (binary) order of their
+	// relative paths, which is also the order of the index's primary key.
+	// Directories are listed one at a time, only when the walk reaches them.
+	// Note that "a.txt" comes before "a/b" ('.' < '/'), so a directory's
+	// contents are sorted among its siblings as "name/".
+	class SortedTreeListing
 	{
+		struct Item {
+			std::string key;
+			WalkEntry entry;
+			bool contents;
+		};
 
-        const fs::path directory = db->rootDirectory();
+		struct Level {
+			std::string prefix;
+			std::vector<Item> items;
+			size_t pos = 0;
+		};
 
-		auto q = db->query("SELECT path,mtime,hash FROM entries");
+		std::vector<Level> stack;
 
-		std::set<std::string> checkedPaths;
+		void push(const fs::path &dir, std::string prefix)
+		{
+			Level level;
+			level.prefix = std::move(prefix);
+
+			for (auto &e : DirectoryWalker::list(dir)) {
+				std::string name = e.path.filename().generic_string();
+				if (name == DDB_FOLDER) continue;
+
+				if (e.directory && !e.symlink) {
+					WalkEntry contents;
+					contents.path = e.path;
+					level.items.push_back({name + "/", std::move(contents), true});
+				}
+				level.items.push_back({std::move(name), std::move(e), false});
+			}
+
+			std::sort(level.items.begin(), level.items.end(), [](const Item &a, const Item &b) {
+				return a.key < b.key;
+			});
+
+			stack.push_back(std::move(level));
+		}
 
-		while (q->fetch())
+	public:
+		explicit SortedTreeListing(const fs::path &root)
 		{
-			io::Path relPath = fs::path(q->getText(0));
-			auto p = directory / relPath.get(); // TODO: does this work on Windows?
-			Entry e;
+			push(root, "");
+		}
 
-			auto path = p.generic_string();
+		// @return false when there are no more entries
+		bool next(WalkEntry &e, std::string &relPath)
+		{
+			while (!stack.empty()) {
+				Level &level = stack.back();
+				if (level.pos == level.items.size()) {
+					stack.pop_back();
+					continue;
+				}
+
+				Item &item = level.items[level.pos++];
+				std::string rel = level.prefix + item.key;
+
+				if (item.contents) {
+					const fs::path dir = item.entry.path;
+					push(dir, std::move(rel));
+					continue;
+				}
+
+				e = std::move(item.entry);
+				relPath = std::move(rel);
+				return true;
+			}
+
+			return false;
+		}
+	};
 
-			checkedPaths.insert(path);
+	struct StatusResult {
+		FileStatus status;
+		std::string path;
 
-        	const auto status = checkUpdate(e, p, q->getInt64(1), q->getText(2));
+		// The status comes from the work queue
+		bool queued;
+	};
 
-        	cb(status, relPath.generic());
+} // namespace
+
+	void statusIndex(Database* db, const FileStatusCallback& cb, int threads)
+	{
+
+        const fs::path directory = db->rootDirectory();
+
+        // Both sides are sorted by path, so a single merge pass
+        // finds the status of every file
+		auto q = db->query("SELECT path,mtime,hash,size,quick_hash,blake3 FROM entries ORDER BY path");
+		SortedTreeListing listing(directory);
+
+		// Files that need to be hashed are checked on the work queue,
+		// everything else is decided right away. Results are reported
+		// in path order, as soon as all the ones before them are known.
+		OrderedWorkQueue<FileStatus> checks(threads);
+		const size_t maxQueued = checks.concurrency() * 4;
+		std::deque<StatusResult> results;
+
+		auto report = [&](size_t maxPending) {
+			while (!results.empty()) {
+				StatusResult &r = results.front();
+				if (r.queued) {
+					if (checks.pending() <= maxPending) break;
+					r.status = checks.pop();
+				}
+				cb(r.status, r.path);
+				results.pop_front();
+			}
+		};
+
+		WalkEntry file;
+		std::string filePath;
+		bool hasEntry = q->fetch();
+		bool hasFile = listing.next(file, filePath);
+
+		while (hasEntry || hasFile)
+		{
+			const std::string entryPath = hasEntry ? q->getText(0) : "";
+			const int cmp = !hasEntry ? 1 : (!hasFile ? -1 : entryPath.compare(filePath));
+
+			if (cmp > 0) {
+				results.push_back({NotIndexed, filePath, false});
+				hasFile = listing.next(file, filePath);
+			} else if (cmp < 0) {
+				// Not in the listing: deleted, unless the listing
+				// doesn't reach it (e.g. it's behind a symlink)
+				Entry e;
+				const auto status = checkUpdate(e, directory / entryPath, q->getInt64(1), q->getText(2),
+				                                q->getInt64(3), q->getText(4), q->getText(5));
+				results.push_back({status, entryPath, false});
+				hasEntry = q->fetch();
+			} else {
+				const long long dbMtime = q->getInt64(1);
+				const auto dbSize = static_cast<std::uintmax_t>(q->getInt64(3));
+
+				if (checkUpdateNeedsHash(file, dbMtime, dbSize)) {
+					checks.push([file, dbMtime, dbSize, dbHash = q->getText(2),
+					             dbQuickHash = q->getText(4), dbBlake3 = q->getText(5)]() {
+						Entry e;
+						return checkUpdate(e, file, dbMtime, dbHash, dbSize, dbQuickHash, dbBlake3);
+					});
+					results.push_back({NotModified, entryPath, true});
+				} else {
+					Entry e;
+					const auto status = checkUpdate(e, file, dbMtime, q->getText(2), dbSize,
+					                                q->getText(4), q->getText(5));
+					results.push_back({status, entryPath, false});
+				}
+
+				hasEntry = q->fetch();
+				hasFile = listing.next(file, filePath);
+			}
+
+			report(maxQueued);
 		}
 
-        try{
-            for (auto i = fs::recursive_directory_iterator(directory);
-                i != fs::recursive_directory_iterator();
-                ++i) {
-
-                auto path = i->path();
-                auto p = path.generic_string();
-
-                // Skips already checked folders
-                if (checkedPaths.count(p) == 1)
-                    continue;
-
-                if (p == directory.generic_string())
-                {
-                    LOGD << "Skipping parent folder";
-                    continue;
-                }
-
-                // Skip .ddb
-                if (path.filename() == DDB_FOLDER)
-                    i.disable_recursion_pending();
-
-                if (p.find(DDB_FOLDER) != std::string::npos)
-                {
-                    LOGD << "Skipping ddb folder";
-                    continue;
-                }
-
-                cb(NotIndexed, io::Path(p).relativeTo(directory).generic());
-
-            }
-        }catch(const fs::filesystem_error &e){
-            throw FSException(e.what());
-        }
-		
+		report(0);
 	}
 
 } // namespace ddb
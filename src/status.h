@@ -17,11 +17,41 @@ namespace ddb {
                 NotModified
         };
 
-	DDB_DLL FileStatus checkUpdate(Entry &e, const fs::path &p, long long dbMtime, const std::string &dbHash);
+	// How to decide whether a file whose modified time has changed
+	// (but not its size) was actually modified
+	enum ChangeDetection {
+		// Compare the full SHA256 hash
+		CDStrict,
+		// Compare the quick hash (size + first and last MiB),
+		// falling back to SHA256 for entries without one.
+		// Faster, but edits in the middle of a file go unnoticed
+		CDQuick
+	};
+
+	// Defaults to the value of the DDB_CHANGE_DETECTION environment
+	// variable ("strict" or "quick"), or strict if not set
+	DDB_DLL ChangeDetection getChangeDetection();
+	DDB_DLL void setChangeDetection(ChangeDetection mode);
+
+	DDB_DLL FileStatus checkUpdate(Entry &e, const fs::path &p, long long dbMtime, const std::string &dbHash,
+	                               std::uintmax_t dbSize, const std::string &dbQuickHash,
+	                               const std::string &dbBlake3 = "");
+
+	// Same as above, for a file whose stat data is already known
+	// @param bytesHashed if set, incremented by the number of bytes read to compute hashes
+	DDB_DLL FileStatus checkUpdate(Entry &e, const WalkEntry &file, long long dbMtime, const std::string &dbHash,
+	                               std::uintmax_t dbSize, const std::string &dbQuickHash,
+	                               const std::string &dbBlake3 = "", std::uintmax_t *bytesHashed = nullptr);
+
+	// Whether checkUpdate needs to hash the file to decide
+	DDB_DLL bool checkUpdateNeedsHash(const WalkEntry &file, long long dbMtime, std::uintmax_t dbSize);
 	
 	typedef std::function<void(const FileStatus status, const std::string& file)> FileStatusCallback;
 
-	DDB_DLL void statusIndex(Database* db, const FileStatusCallback& cb);
+	// Compares the index with the filesystem. Results are reported
+	// in path order, as soon as they are known
+	// @param threads number of threads hashing files whose modified time has changed (0 = auto)
+	DDB_DLL void statusIndex(Database* db, const FileStatusCallback& cb, int threads = 0);
 
 }
 
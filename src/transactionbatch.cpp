@@ -0,0 +1,62 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "transactionbatch.h"
+
+#include "logger.h"
+
+namespace ddb {
+
+TransactionBatch::TransactionBatch(SqliteDatabase *db, int maxRows, int maxMillis)
+    : db(db),
+      maxRows(maxRows > 0 ? static_cast<size_t>(maxRows) : 1),
+      maxTime(maxMillis),
+      cancelled(false) {}
+
+bool TransactionBatch::add(const BatchWrite &write) {
+    if (cancelled) return false;
+
+    if (writes.empty()) firstWrite = std::chrono::steady_clock::now();
+    writes.push_back(write);
+
+    if (writes.size() >= maxRows ||
+        std::chrono::steady_clock::now() - firstWrite >= maxTime) {
+        return flush();
+    }
+
+    return true;
+}
+
+bool TransactionBatch::flush() {
+    if (cancelled) return false;
+    if (writes.empty()) return true;
+
+    LOGD << "Committing batch of " << writes.size() << " writes";
+
+    db->exec("BEGIN IMMEDIATE TRANSACTION");
+
+    try {
+        for (auto &write : writes) {
+            if (!write()) {
+                cancelled = true;
+                break;
+            }
+        }
+    } catch (...) {
+        writes.clear();
+        db->exec("ROLLBACK");
+        throw;
+    }
+
+    writes.clear();
+    db->exec("COMMIT");
+
+    return !cancelled;
+}
+
+bool TransactionBatch::isCancelled() const { return cancelled; }
+
+size_t TransactionBatch::pending() const { return writes.size(); }
+
+}  // namespace ddb
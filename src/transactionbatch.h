@@ -0,0 +1,55 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef TRANSACTIONBATCH_H
+#define TRANSACTIONBATCH_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "sqlite_database.h"
+#include "ddb_export.h"
+
+#define DDB_BATCH_MAX_ROWS 1000
+#define DDB_BATCH_MAX_MILLIS 1000
+
+namespace ddb {
+
+// A write to be executed within a batch. Returning false
+// cancels all the writes that follow it.
+typedef std::function<bool()> BatchWrite;
+
+// Queues writes and executes them in short transactions, committed
+// every maxRows writes or after maxMillis milliseconds have passed since
+// the first queued write, whichever comes first. The database is
+// locked only while the queued writes execute, so readers on other connections
+// are not starved and an interrupted run leaves all previous batches committed.
+class TransactionBatch {
+    SqliteDatabase *db;
+    size_t maxRows;
+    std::chrono::milliseconds maxTime;
+
+    std::vector<BatchWrite> writes;
+    std::chrono::steady_clock::time_point firstWrite;
+    bool cancelled;
+
+   public:
+    DDB_DLL TransactionBatch(SqliteDatabase *db, int maxRows = DDB_BATCH_MAX_ROWS,
+                             int maxMillis = DDB_BATCH_MAX_MILLIS);
+
+    // Queues a write, flushing the batch if it's due.
+    // @return false if the batch was cancelled
+    DDB_DLL bool add(const BatchWrite &write);
+
+    // Executes and commits all queued writes.
+    // @return false if the batch was cancelled
+    DDB_DLL bool flush();
+
+    DDB_DLL bool isCancelled() const;
+    DDB_DLL size_t pending() const;
+};
+
+}  // namespace ddb
+
+#endif  // TRANSACTIONBATCH_H
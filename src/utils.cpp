@@ -6,6 +6,8 @@
 
 #include <random>
 
+#include "cctz/time_zone.h"
+
 namespace ddb::utils
 {
 
@@ -89,6 +91,26 @@ time_t currentUnixTimestamp() {
         .count();
 }
 
+std::string millisToIso8601(double millis) {
+    using namespace std::chrono;
+    const time_point<system_clock, milliseconds> tp(milliseconds(static_cast<long long>(std::llround(millis))));
+    return cctz::format("%Y-%m-%dT%H:%M:%E3SZ", tp, cctz::utc_time_zone());
+}
+
+bool iso8601ToMillis(const std::string &s, double &millis) {
+    using namespace std::chrono;
+    time_point<system_clock, microseconds> tp;
+
+    for (const char *fmt : {"%Y-%m-%dT%H:%M:%E*SZ", "%Y-%m-%dT%H:%M:%E*S", "%Y-%m-%d"}) {
+        if (cctz::parse(fmt, s, cctz::utc_time_zone(), &tp)) {
+            millis = static_cast<double>(duration_cast<microseconds>(tp.time_since_epoch()).count()) / 1000.0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void stringReplace(std::string& str, const std::string& from,
                     const std::string& to) {
     if (from.empty()) return;
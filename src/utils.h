@@ -140,6 +140,14 @@ DDB_DLL std::string getPass(const std::string &prompt = "Password: ");
 
 time_t currentUnixTimestamp();
 
+// Milliseconds since the Unix epoch --> "2021-05-01T10:00:00.123Z"
+DDB_DLL std::string millisToIso8601(double millis);
+
+// "2021-05-01T10:00:00[.123][Z]" (UTC) or "2021-05-01"
+// --> milliseconds since the Unix epoch
+// @return false if s is not a valid date
+DDB_DLL bool iso8601ToMillis(const std::string &s, double &millis);
+
 // https://stackoverflow.com/questions/3418231/replace-part-of-a-string-with-another-string
 void stringReplace(std::string& str, const std::string& from, const std::string& to);
 
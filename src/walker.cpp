@@ -0,0 +1,278 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "walker.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "ddb.h"
+#include "exceptions.h"
+#include "logger.h"
+#include "mio.h"
+
+#ifndef WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <windows.h>
+#endif
+
+// Maximum number of entries waiting for the consumer, past which
+// only the directory that comes next in the output is read
+#define WALKER_MAX_QUEUED 8192
+
+namespace ddb {
+
+DirectoryWalker::DirectoryWalker(const fs::path &root, int maxDepth, int threads, bool skipSystemFiles)
+    : maxDepth(maxDepth), skipSystemFiles(skipSystemFiles) {
+    if (threads <= 0) {
+        // Walking is mostly waiting on the filesystem
+        // (especially on network shares), so we allow more
+        // threads than cores, within reason
+        const int hw = static_cast<int>(std::thread::hardware_concurrency());
+        threads = std::max(4, std::min(16, hw));
+    }
+
+    dirs.push_back({root, 0, queuedDirs++});
+
+    workers.reserve(threads);
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&DirectoryWalker::work, this);
+}
+
+DirectoryWalker::~DirectoryWalker() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    workCv.notify_all();
+    for (auto &w : workers) w.join();
+}
+
+bool DirectoryWalker::next(WalkEntry &e) {
+    std::unique_lock<std::mutex> lock(mtx);
+
+    for (;;) {
+        if (error) std::rethrow_exception(error);
+
+        if (!out.empty()) {
+            e = std::move(out.front());
+            out.pop_front();
+            if (--buffered == WALKER_MAX_QUEUED / 2) workCv.notify_all();
+            return true;
+        }
+
+        // Directories are returned in the order they were queued,
+        // and their subdirectories queued when they are returned,
+        // so that the output does not depend on the timing of the reads
+        const auto it = listings.find(nextSeq);
+        if (it != listings.end()) {
+            for (auto &entry : it->second.entries) out.push_back(std::move(entry));
+            for (auto &d : it->second.subdirs) {
+                d.seq = queuedDirs++;
+                dirs.push_back(std::move(d));
+            }
+            listings.erase(it);
+            nextSeq++;
+            workCv.notify_all();
+            continue;
+        }
+
+        if (complete()) return false;
+        outCv.wait(lock);
+    }
+}
+
+// Whether a worker can read the next queued directory
+bool DirectoryWalker::canRead() const {
+    return !dirs.empty() && (buffered < WALKER_MAX_QUEUED || dirs.front().seq == nextSeq);
+}
+
+bool DirectoryWalker::complete() const {
+    return dirs.empty() && busy == 0 && listings.empty() && out.empty();
+}
+
+bool DirectoryWalker::shouldDescend(int depth) const {
+    return maxDepth == 0 || (maxDepth > 0 && depth < maxDepth - 1);
+}
+
+void DirectoryWalker::work() {
+    for (;;) {
+        PendingDir dir;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            workCv.wait(lock, [this] {
+                return stopping || canRead() || complete();
+            });
+
+            if (stopping || !canRead()) return;
+
+            dir = std::move(dirs.front());
+            dirs.pop_front();
+            busy++;
+        }
+
+        try {
+            readDirectory(dir);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!error) error = std::current_exception();
+            stopping = true;
+        }
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            busy--;
+            done = stopping || complete();
+        }
+
+        if (done) workCv.notify_all();
+        outCv.notify_all();
+    }
+}
+
+bool DirectoryWalker::stat(const fs::path &path, WalkEntry &e) {
+    e.path = path;
+    e.depth = 0;
+
+#ifndef WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+    e.directory = S_ISDIR(st.st_mode);
+    e.size = e.directory ? 0 : static_cast<std::uintmax_t>(st.st_size);
+    e.mtime = st.st_mtime;
+#else
+    std::error_code ec;
+    const auto status = fs::status(path, ec);
+    if (ec || !fs::exists(status)) return false;
+    e.directory = fs::is_directory(status);
+    e.size = e.directory ? 0 : fs::file_size(path, ec);
+    e.mtime = io::Path(path).getModifiedTime();
+#endif
+
+    return true;
+}
+
+namespace {
+
+#ifndef WIN32
+
+struct DirCloser {
+    DIR *d;
+    ~DirCloser() { closedir(d); }
+};
+
+// Calls onEntry for every entry of dir (depth is left to the caller)
+// until it returns false
+void readEntries(const fs::path &dir, bool /* skipSystemFiles */,
+                 const std::function<bool(WalkEntry &e)> &onEntry) {
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        throw FSException("Cannot read directory " + dir.string() + ": " + std::strerror(errno));
+    }
+    DirCloser closer{d};
+    const int dfd = dirfd(d);
+
+    for (;;) {
+        errno = 0;
+        const struct dirent *ent = readdir(d);
+        if (ent == nullptr) {
+            if (errno != 0)
+                throw FSException("Cannot read directory " + dir.string() + ": " + std::strerror(errno));
+            break;
+        }
+
+        const char *name = ent->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) continue;
+
+        // Stat relative to the directory, which avoids
+        // resolving the full path for every entry
+        struct stat st;
+        if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            LOGD << "Cannot stat " << (dir / name).string() << ", skipping: " << std::strerror(errno);
+            continue;
+        }
+
+        const bool link = S_ISLNK(st.st_mode);
+        if (link) {
+            struct stat target;
+            if (fstatat(dfd, name, &target, 0) == 0) st = target;
+        }
+
+        WalkEntry e;
+        e.path = dir / name;
+        e.directory = S_ISDIR(st.st_mode);
+        e.size = e.directory ? 0 : static_cast<std::uintmax_t>(st.st_size);
+        e.mtime = st.st_mtime;
+        e.symlink = link;
+
+        if (!onEntry(e)) return;
+    }
+}
+
+#else
+
+void readEntries(const fs::path &dir, bool skipSystemFiles,
+                 const std::function<bool(WalkEntry &e)> &onEntry) {
+    try {
+        for (const auto &de : fs::directory_iterator(dir)) {
+            const fs::path rp = de.path();
+
+            if (skipSystemFiles) {
+                const DWORD attrs = GetFileAttributesW(rp.wstring().c_str());
+                if (attrs & FILE_ATTRIBUTE_HIDDEN || attrs & FILE_ATTRIBUTE_SYSTEM) continue;
+            }
+
+            WalkEntry e;
+            if (!DirectoryWalker::stat(rp, e)) continue;
+            e.symlink = de.is_symlink();
+
+            if (!onEntry(e)) return;
+        }
+    } catch (const fs::filesystem_error &e) {
+        throw FSException(e.what());
+    }
+}
+
+#endif
+
+}  // namespace
+
+void DirectoryWalker::readDirectory(const PendingDir &dir) {
+    Listing listing;
+    readEntries(dir.path, skipSystemFiles, [&listing](WalkEntry &e) {
+        listing.entries.push_back(std::move(e));
+        return true;
+    });
+
+    std::sort(listing.entries.begin(), listing.entries.end(), [](const WalkEntry &a, const WalkEntry &b) {
+        return a.path.native() < b.path.native();
+    });
+
+    for (auto &e : listing.entries) {
+        e.depth = dir.depth;
+
+        if (e.directory && !e.symlink && shouldDescend(dir.depth) && e.path.filename() != DDB_FOLDER) {
+            listing.subdirs.push_back({e.path, dir.depth + 1, 0});
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    buffered += listing.entries.size();
+    listings.emplace(dir.seq, std::move(listing));
+}
+
+std::vector<WalkEntry> DirectoryWalker::list(const fs::path &dir, bool skipSystemFiles) {
+    std::vector<WalkEntry> entries;
+    readEntries(dir, skipSystemFiles, [&entries](WalkEntry &e) {
+        entries.push_back(std::move(e));
+        return true;
+    });
+    return entries;
+}
+
+}  // namespace ddb
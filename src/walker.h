@@ -0,0 +1,110 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "fs.h"
+#include "ddb_export.h"
+
+namespace ddb {
+
+struct WalkEntry {
+    fs::path path;
+    bool directory = false;
+    std::uintmax_t size = 0;
+    time_t mtime = 0;
+
+    // Symbolic links report their target, but are never descended into
+    bool symlink = false;
+
+    // 0 for the children of the walk root (same as recursive_directory_iterator)
+    int depth = 0;
+};
+
+// Walks a directory tree with multiple threads and streams the entries
+// back to the caller as soon as their directory has been read. Each
+// directory is read once and entries come with their stat data, so
+// consumers don't need to query the filesystem again.
+// The order is always the same: directories are returned one after the
+// other, breadth first, each with its entries sorted by name. A directory
+// is always returned before any of its children.
+// .ddb folders are returned, but never descended into.
+class DirectoryWalker {
+   public:
+    // @param maxDepth 0 = no limit, N > 0 = at most N levels, -1 = same as 1
+    // @param threads number of threads reading directories (0 = auto)
+    // @param skipSystemFiles skip hidden and system files (Windows only)
+    DDB_DLL explicit DirectoryWalker(const fs::path &root, int maxDepth = 0, int threads = 0,
+                                     bool skipSystemFiles = false);
+    DDB_DLL ~DirectoryWalker();
+
+    DirectoryWalker(const DirectoryWalker &) = delete;
+    DirectoryWalker &operator=(const DirectoryWalker &) = delete;
+
+    // Blocks until the next entry is available
+    // @return false when the walk is complete
+    // @throws FSException if a directory cannot be read
+    DDB_DLL bool next(WalkEntry &e);
+
+    // Fills a WalkEntry for a single path (follows symlinks)
+    // @return false if path does not exist
+    DDB_DLL static bool stat(const fs::path &path, WalkEntry &e);
+
+    // Reads the entries of a single directory (in no particular order)
+    // @throws FSException if the directory cannot be read
+    DDB_DLL static std::vector<WalkEntry> list(const fs::path &dir, bool skipSystemFiles = false);
+
+   private:
+    struct PendingDir {
+        fs::path path;
+        int depth;
+        // Position of the directory in the output
+        size_t seq;
+    };
+
+    // Entries of a directory that was read, sorted
+    struct Listing {
+        std::vector<WalkEntry> entries;
+        std::vector<PendingDir> subdirs;
+    };
+
+    void work();
+    void readDirectory(const PendingDir &dir);
+    bool canRead() const;
+    bool complete() const;
+    bool shouldDescend(int depth) const;
+
+    int maxDepth;
+    bool skipSystemFiles;
+
+    std::mutex mtx;
+    std::condition_variable workCv;
+    std::condition_variable outCv;
+
+    std::deque<PendingDir> dirs;
+    // Read directories waiting for the ones before them, by seq
+    std::map<size_t, Listing> listings;
+    std::deque<WalkEntry> out;
+    size_t nextSeq = 0;
+    size_t queuedDirs = 0;
+    // Entries in listings and out
+    size_t buffered = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    std::vector<std::thread> workers;
+};
+
+}  // namespace ddb
+
+#endif  // WALKER_H
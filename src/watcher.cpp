@@ -0,0 +1,329 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#include "watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "ddb.h"
+#include "entry_types.h"
+#include "exceptions.h"
+#include "logger.h"
+#include "mio.h"
+#include "walker.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_MASK                                                              \
+    (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |          \
+     IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+#endif
+
+namespace ddb {
+
+#ifdef __linux__
+
+DatasetWatcher::DatasetWatcher(Database *db, int quietMillis, int threads)
+    : db(db), root(db->rootDirectory()), quiet(quietMillis), threads(threads) {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+        throw FSException(std::string("Cannot initialize inotify: ") + std::strerror(errno));
+
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stopFd < 0) {
+        close(inotifyFd);
+        throw FSException(std::string("Cannot create eventfd: ") + std::strerror(errno));
+    }
+
+    try {
+        watchTree("");
+    } catch (...) {
+        close(inotifyFd);
+        close(stopFd);
+        throw;
+    }
+}
+
+DatasetWatcher::~DatasetWatcher() {
+    close(inotifyFd);
+    close(stopFd);
+}
+
+void DatasetWatcher::run(const WatchCallback &cb) {
+    for (;;) {
+        if (overflow && !rescan(cb)) return;
+
+        // Sleep until the oldest pending path becomes quiet
+        int timeout = -1;
+        if (!pending.empty()) {
+            Clock::time_point oldest = Clock::time_point::max();
+            for (const auto &p : pending) oldest = std::min(oldest, p.second.lastEvent);
+
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(oldest + quiet - Clock::now());
+            timeout = static_cast<int>(std::max<long long>(0, wait.count() + 1));
+        }
+
+        pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+        if (poll(fds, 2, timeout) < 0) {
+            if (errno == EINTR) continue;
+            throw FSException(std::string("Cannot poll inotify: ") + std::strerror(errno));
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t value;
+            if (read(stopFd, &value, sizeof(value)) < 0) {
+                LOGD << "Cannot read stop event";
+            }
+            return;
+        }
+
+        if (fds[0].revents & POLLIN) readEvents();
+        if (!indexQuietPaths(cb)) return;
+    }
+}
+
+void DatasetWatcher::stop() {
+    const uint64_t value = 1;
+    if (write(stopFd, &value, sizeof(value)) < 0) {
+        LOGD << "Cannot signal watcher stop";
+    }
+}
+
+void DatasetWatcher::watchDirectory(const std::string &relDir) {
+    const fs::path dir = relDir.empty() ? root : root / relDir;
+    const int wd = inotify_add_watch(inotifyFd, dir.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC)
+            throw FSException("Too many inotify watches, increase fs.inotify.max_user_watches");
+
+        // Probably gone already
+        LOGD << "Cannot watch " << dir.string() << ": " << std::strerror(errno);
+        return;
+    }
+
+    watches[wd] = relDir;
+}
+
+void DatasetWatcher::watchTree(const std::string &relDir) {
+    watchDirectory(relDir);
+
+    DirectoryWalker walker(relDir.empty() ? root : root / relDir);
+    WalkEntry e;
+    while (walker.next(e)) {
+        if (!e.directory || e.symlink || e.path.filename() == DDB_FOLDER) continue;
+        watchDirectory(e.path.lexically_relative(root).generic_string());
+    }
+}
+
+void DatasetWatcher::unwatchTree(const std::string &relDir) {
+    const std::string prefix = relDir + "/";
+
+    for (auto it = watches.begin(); it != watches.end();) {
+        if (it->second == relDir || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DatasetWatcher::touch(const std::string &relPath, bool newDirectory) {
+    PendingPath &p = pending[relPath];
+    p.lastEvent = Clock::now();
+    p.newDirectory = p.newDirectory || newDirectory;
+
+    // It changed, so it gets its tries again
+    p.failures = 0;
+}
+
+void DatasetWatcher::retry(const std::string &relPath, int failures) {
+    if (failures >= WATCH_MAX_FAILURES) {
+        LOGD << "Cannot index " << relPath << " after " << failures << " tries, skipping it until it changes";
+        return;
+    }
+
+    PendingPath &p = pending[relPath];
+    p.lastEvent = Clock::now();
+    p.failures = failures;
+}
+
+void DatasetWatcher::readEvents() {
+    alignas(inotify_event) char buf[64 * 1024];
+
+    for (;;) {
+        const ssize_t len = read(inotifyFd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR) continue;
+            throw FSException(std::string("Cannot read inotify events: ") + std::strerror(errno));
+        }
+        if (len == 0) return;
+
+        for (char *ptr = buf; ptr < buf + len;) {
+            const auto *ev = reinterpret_cast<const inotify_event *>(ptr);
+            ptr += sizeof(inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                LOGD << "inotify queue overflow, a full rescan will follow";
+                overflow = true;
+                continue;
+            }
+
+            if (ev->mask & IN_IGNORED) {
+                watches.erase(ev->wd);
+                continue;
+            }
+
+            // Events about the watched directory itself are not interesting,
+            // its parent reports what happens to it
+            const auto w = watches.find(ev->wd);
+            if (w == watches.end() || ev->len == 0) continue;
+
+            const std::string name = ev->name;
+            if (w->second.empty() && name == DDB_FOLDER) continue;
+            const std::string relPath = w->second.empty() ? name : w->second + "/" + name;
+
+            if (ev->mask & IN_ISDIR) {
+                if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    // Whatever was created before the watch
+                    // is picked up when the directory is indexed
+                    try {
+                        watchTree(relPath);
+                    } catch (const FSException &e) {
+                        LOGD << "Cannot watch " << relPath << ": " << e.what();
+                    }
+                    touch(relPath, true);
+                } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    unwatchTree(relPath);
+                    touch(relPath, false);
+                }
+            } else {
+                touch(relPath, false);
+            }
+        }
+    }
+}
+
+// Indexes the paths that have been quiet for long enough
+// @return false if the callback asked to stop
+bool DatasetWatcher::indexQuietPaths(const WatchCallback &cb) {
+    const auto now = Clock::now();
+
+    std::vector<std::string> removed;
+    std::vector<std::string> added;
+    std::vector<int> addedFailures;
+
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (now - it->second.lastEvent < quiet) {
+            ++it;
+            continue;
+        }
+
+        WalkEntry e;
+        if (!DirectoryWalker::stat(root / it->first, e)) {
+            removed.push_back(it->first);
+        } else if (!e.directory || it->second.newDirectory) {
+            added.push_back(e.path.string());
+            addedFailures.push_back(it->second.failures);
+        }
+
+        it = pending.erase(it);
+    }
+
+    bool proceed = true;
+    auto onRemove = [&cb, &proceed](const std::string &path) {
+        if (proceed && cb != nullptr) proceed = cb(path, WatchDeleted);
+    };
+
+    for (const auto &relPath : removed) {
+        // Files that came and went before being indexed
+        if (!pathExists(db, relPath)) continue;
+
+        // Names are literal here, a '*' is not a wildcard
+        deletePathFromIndex(db, relPath, onRemove);
+        if (!proceed) return false;
+    }
+
+    if (!added.empty()) {
+        auto onAdd = [&cb, &proceed](const Entry &e, bool updated) {
+            if (cb != nullptr) proceed = cb(e.path, updated ? WatchUpdated : WatchAdded);
+            return proceed;
+        };
+
+        try {
+            addToIndex(db, added, onAdd, threads);
+        } catch (const FSException &e) {
+            // Something changed while we were indexing, or a file cannot be
+            // read. Files are added one at a time, so that the others still
+            // are, and those that fail are tried again later.
+            LOGD << "Cannot index changes, adding files one at a time: " << e.what();
+
+            for (size_t i = 0; i < added.size() && proceed; i++) {
+                try {
+                    addToIndex(db, {added[i]}, onAdd, threads);
+                } catch (const FSException &e) {
+                    LOGD << "Cannot index " << added[i] << ": " << e.what();
+                    retry(io::Path(added[i]).relativeTo(root).generic(), addedFailures[i] + 1);
+                }
+            }
+        }
+    }
+
+    return proceed;
+}
+
+// Events were lost, so we go back to a full sync
+// @return false if the callback asked to stop
+bool DatasetWatcher::rescan(const WatchCallback &cb) {
+    overflow = false;
+    pending.clear();
+
+    for (const auto &w : watches) inotify_rm_watch(inotifyFd, w.first);
+    watches.clear();
+    watchTree("");
+
+    bool proceed = true;
+    syncIndex(db, [&cb, &proceed](const std::string &path, bool deleted) {
+        if (cb != nullptr) proceed = cb(path, deleted ? WatchDeleted : WatchUpdated);
+        return proceed;
+    }, threads);
+    if (!proceed) return false;
+
+    std::vector<std::string> paths;
+    for (const auto &e : DirectoryWalker::list(root)) {
+        if (e.path.filename() != DDB_FOLDER) paths.push_back(e.path.string());
+    }
+
+    if (!paths.empty()) {
+        addToIndex(db, paths, [&cb, &proceed](const Entry &e, bool updated) {
+            if (cb != nullptr) proceed = cb(e.path, updated ? WatchUpdated : WatchAdded);
+            return proceed;
+        }, threads);
+    }
+
+    return proceed;
+}
+
+#else
+
+DatasetWatcher::DatasetWatcher(Database *db, int quietMillis, int threads)
+    : db(db), root(db->rootDirectory()), quiet(quietMillis), threads(threads) {
+    throw NotImplementedException("Watching a dataset is only supported on Linux");
+}
+
+DatasetWatcher::~DatasetWatcher() {}
+
+void DatasetWatcher::run(const WatchCallback &) {}
+
+void DatasetWatcher::stop() {}
+
+#endif
+
+}  // namespace ddb
@@ -0,0 +1,93 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include "dbops.h"
+#include "ddb_export.h"
+
+// A path is indexed once nothing happened to it for this long
+#define WATCH_QUIET_MILLIS 2000
+
+// A file that cannot be indexed this many times in a row is left
+// alone until it changes again
+#define WATCH_MAX_FAILURES 3
+
+namespace ddb {
+
+enum WatchAction {
+    WatchAdded,
+    WatchUpdated,
+    WatchDeleted
+};
+
+// Called for every index change made by a watcher.
+// Returning false stops the watcher.
+typedef std::function<bool(const std::string &path, WatchAction action)> WatchCallback;
+
+// Keeps the index of a dataset up to date as files change, using inotify
+// (Linux only). Bursts of events are coalesced: a path is hashed and indexed
+// only once it has been quiet (no longer being written) for quietMillis.
+// Only touched paths are looked at, except when the kernel's event queue
+// overflows, in which case the whole dataset is synced again.
+class DatasetWatcher {
+   public:
+    // @param threads number of threads used to hash and parse files (0 = one per CPU)
+    // @throws NotImplementedException on platforms other than Linux
+    DDB_DLL DatasetWatcher(Database *db, int quietMillis = WATCH_QUIET_MILLIS, int threads = 0);
+    DDB_DLL ~DatasetWatcher();
+
+    DatasetWatcher(const DatasetWatcher &) = delete;
+    DatasetWatcher &operator=(const DatasetWatcher &) = delete;
+
+    // Processes events until stop() is called or the callback returns false
+    DDB_DLL void run(const WatchCallback &cb = nullptr);
+
+    // Makes run() return (can be called from any thread)
+    DDB_DLL void stop();
+
+   private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct PendingPath {
+        Clock::time_point lastEvent;
+
+        // Directory created or moved into the dataset
+        bool newDirectory = false;
+
+        // Times in a row it could not be indexed
+        int failures = 0;
+    };
+
+    void watchTree(const std::string &relDir);
+    void watchDirectory(const std::string &relDir);
+    void unwatchTree(const std::string &relDir);
+    void readEvents();
+    void touch(const std::string &relPath, bool newDirectory);
+    void retry(const std::string &relPath, int failures);
+    bool indexQuietPaths(const WatchCallback &cb);
+    bool rescan(const WatchCallback &cb);
+
+    Database *db;
+    fs::path root;
+    std::chrono::milliseconds quiet;
+    int threads;
+
+    int inotifyFd = -1;
+    int stopFd = -1;
+    bool overflow = false;
+
+    // Watch descriptor --> directory, relative to the root
+    std::unordered_map<int, std::string> watches;
+    std::map<std::string, PendingPath> pending;
+};
+
+}  // namespace ddb
+
+#endif  // WATCHER_H
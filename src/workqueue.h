@@ -0,0 +1,128 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ddb {
+
+namespace detail {
+inline bool &workerThreadFlag() {
+    static thread_local bool worker = false;
+    return worker;
+}
+
+inline std::atomic<int> &busyWorkerCount() {
+    static std::atomic<int> busy(0);
+    return busy;
+}
+}  // namespace detail
+
+// Whether the calling thread is a worker of an OrderedWorkQueue
+inline bool isWorkerThread() { return detail::workerThreadFlag(); }
+
+// Number of OrderedWorkQueue workers, across all queues, that are running
+// a job. Jobs that can split their work use it to leave the cores that
+// other jobs keep busy alone.
+inline int busyWorkerThreads() { return detail::busyWorkerCount().load(); }
+
+// Runs jobs on a pool of worker threads and hands results back
+// in the same order in which the jobs were pushed. Exceptions thrown
+// by a job are rethrown by the corresponding pop() call.
+// When created with a single thread, jobs run inline on push().
+template <typename T>
+class OrderedWorkQueue {
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<T()>> tasks;
+    std::deque<std::future<T>> results;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void work() {
+        detail::workerThreadFlag() = true;
+
+        for (;;) {
+            std::packaged_task<T()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            detail::busyWorkerCount()++;
+            task();
+            detail::busyWorkerCount()--;
+        }
+    }
+
+   public:
+    // threads <= 0 means one worker per hardware thread
+    explicit OrderedWorkQueue(int threads = 0) {
+        if (threads <= 0)
+            threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads > 1) {
+            workers.reserve(threads);
+            for (int i = 0; i < threads; i++)
+                workers.emplace_back(&OrderedWorkQueue::work, this);
+        }
+    }
+
+    ~OrderedWorkQueue() {
+        {
+            // Jobs that have not started yet are dropped
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            tasks.clear();
+        }
+        cv.notify_all();
+        for (auto &w : workers) w.join();
+    }
+
+    OrderedWorkQueue(const OrderedWorkQueue &) = delete;
+    OrderedWorkQueue &operator=(const OrderedWorkQueue &) = delete;
+
+    void push(std::function<T()> job) {
+        std::packaged_task<T()> task(std::move(job));
+        results.push_back(task.get_future());
+
+        if (workers.empty()) {
+            task();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tasks.push_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    // Blocks until the oldest pushed job has completed and returns its result
+    T pop() {
+        auto f = std::move(results.front());
+        results.pop_front();
+        return f.get();
+    }
+
+    // Number of pushed jobs whose results have not been popped yet
+    size_t pending() const { return results.size(); }
+
+    // Number of jobs that can usefully be in flight at the same time
+    size_t concurrency() const { return workers.empty() ? 1 : workers.size(); }
+};
+
+}  // namespace ddb
+
+#endif  // WORKQUEUE_H
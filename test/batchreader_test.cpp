@@ -0,0 +1,129 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <chrono>
+#include <fstream>
+#include "gtest/gtest.h"
+#include "batchreader.h"
+#include "exceptions.h"
+#include "hash.h"
+#include "logger.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace {
+
+using namespace ddb;
+
+void writeFile(const fs::path &p, const std::string &contents) {
+    std::ofstream f(p.string(), std::ios::binary);
+    f << contents;
+}
+
+TEST(batchFileReader, readsSmallFiles) {
+    TestArea ta(TEST_NAME, true);
+    const auto folder = ta.getFolder();
+
+    std::vector<std::string> paths;
+    std::vector<std::string> contents;
+    for (int i = 0; i < 100; i++) {
+        const auto p = folder / ("file" + std::to_string(i) + ".txt");
+        contents.push_back(std::string(static_cast<size_t>(i * 9), static_cast<char>('a' + i % 26)));
+        writeFile(p, contents.back());
+        paths.push_back(p.string());
+    }
+
+    // Exactly at the limit, over the limit, a directory and a missing file
+    writeFile(folder / "limit.bin", std::string(1000, 'x'));
+    writeFile(folder / "large.bin", std::string(1001, 'x'));
+    fs::create_directory(folder / "dir");
+    paths.push_back((folder / "limit.bin").string());
+    paths.push_back((folder / "large.bin").string());
+    paths.push_back((folder / "dir").string());
+    paths.push_back((folder / "missing.txt").string());
+
+    for (bool useIoUring : {true, false}) {
+        BatchFileReader reader(8, 1000, useIoUring);
+        std::vector<std::string> read(paths.size());
+
+        const auto done = reader.read(paths, [&read](size_t index, const char *data, size_t size) {
+            read[index] = std::string(data, size);
+        });
+
+        ASSERT_EQ(done.size(), paths.size());
+        for (size_t i = 0; i < contents.size(); i++) {
+            EXPECT_TRUE(done[i]);
+            EXPECT_EQ(read[i], contents[i]);
+        }
+        EXPECT_TRUE(done[100]);
+        EXPECT_EQ(read[100].size(), 1000);
+        EXPECT_FALSE(done[101]);
+        EXPECT_FALSE(done[102]);
+        EXPECT_FALSE(done[103]);
+    }
+}
+
+TEST(batchFileReader, callbackThrows) {
+    TestArea ta(TEST_NAME, true);
+    const auto folder = ta.getFolder();
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 50; i++) {
+        const auto p = folder / ("file" + std::to_string(i) + ".txt");
+        writeFile(p, "hello");
+        paths.push_back(p.string());
+    }
+
+    BatchFileReader reader;
+    EXPECT_THROW(reader.read(paths, [](size_t, const char *, size_t) {
+        throw AppException("stop");
+    }), AppException);
+
+    // The reader is still usable
+    int count = 0;
+    reader.read(paths, [&count](size_t, const char *, size_t) { count++; });
+    EXPECT_EQ(count, 50);
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(batchFileReader, DISABLED_benchmark) {
+    TestArea ta(TEST_NAME, true);
+    const auto folder = ta.getFolder();
+    const int numFiles = 200000;
+
+    std::vector<std::string> paths;
+    paths.reserve(numFiles);
+    for (int i = 0; i < numFiles; i++) {
+        const auto dir = folder / std::to_string(i / 1000);
+        if (i % 1000 == 0) fs::create_directories(dir);
+        const auto p = dir / (std::to_string(i) + ".json");
+        writeFile(p, std::string(static_cast<size_t>(200 + i % 4000), 'x'));
+        paths.push_back(p.string());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &p : paths) Hash::fileSHA256(p);
+    const auto blockingMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    auto timeReader = [&paths](BatchFileReader &reader) {
+        const auto start = std::chrono::steady_clock::now();
+        reader.read(paths, [](size_t, const char *data, size_t size) {
+            Hash::dataSHA256(data, size);
+        });
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    BatchFileReader blockingReader(BATCH_READ_DEPTH, BATCH_READ_MAX_FILE_SIZE, false);
+    const auto sequentialMs = timeReader(blockingReader);
+
+    BatchFileReader reader;
+    const auto batchedMs = timeReader(reader);
+
+    std::cout << "Hashed " << numFiles << " files: " << blockingMs << " ms (fileSHA256), "
+              << sequentialMs << " ms (BatchFileReader, blocking), "
+              << batchedMs << " ms (BatchFileReader, " << (reader.usingIoUring() ? "io_uring" : "blocking") << ")"
+              << std::endl;
+}
+
+}
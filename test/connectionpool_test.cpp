@@ -0,0 +1,113 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include "gtest/gtest.h"
+#include "connectionpool.h"
+#include "dbops.h"
+#include "exceptions.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace {
+
+using namespace ddb;
+
+int countEntries(Database *db) {
+    auto q = db->query("SELECT COUNT(*) FROM entries");
+    q->fetch();
+    return q->getInt(0);
+}
+
+TEST(connectionPool, reuse) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    auto &pool = ConnectionPool::instance();
+    pool.clear();
+
+    {
+        const auto a = pool.acquire(testFolder.string());
+        const auto b = pool.acquire(testFolder.string());
+        EXPECT_NE(a, b);
+        EXPECT_TRUE(a->isReadOnly());
+        EXPECT_THROW(a->exec("INSERT INTO passwords (salt, hash) VALUES ('a', 'b')"), SQLException);
+    }
+    EXPECT_EQ(pool.idleCount(), 2);
+
+    Database *pooled;
+    {
+        const auto db = pool.acquire((testFolder / "sub").string(), true);
+        pooled = db.get();
+        EXPECT_EQ(countEntries(db.get()), 0);
+    }
+    EXPECT_EQ(pool.idleCount(), 2);
+
+    // Rows written by other connections are visible
+    {
+        auto writer = ddb::open(testFolder.string(), false);
+        writer->exec("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES ('a.txt', 2, '{}', 0, 0, 0)");
+    }
+
+    {
+        const auto db = pool.acquire(testFolder.string());
+        EXPECT_EQ(db.get(), pooled);
+        EXPECT_EQ(countEntries(db.get()), 1);
+
+        // A query left running keeps the connection out of the pool
+        auto q = db->cachedQuery("SELECT path FROM entries");
+        EXPECT_TRUE(q->fetch());
+    }
+    EXPECT_EQ(pool.idleCount(), 1);
+
+    EXPECT_THROW(pool.acquire(ta.getFolder("none").string()), FSException);
+
+    pool.clear();
+    EXPECT_EQ(pool.idleCount(), 0);
+}
+
+TEST(connectionPool, concurrentReads) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    {
+        auto db = ddb::open(testFolder.string(), false);
+        auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 2, '{}', 0, 0, 0)");
+        for (int i = 0; i < 100; i++) {
+            q->bind(1, "f" + std::to_string(i) + ".txt");
+            q->execute();
+        }
+    }
+
+    auto &pool = ConnectionPool::instance();
+    pool.clear();
+
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 50; i++) {
+                try {
+                    const auto db = pool.acquire(testFolder.string());
+                    std::ostringstream out;
+                    searchIndex(db.get(), "f1*", out, "text");
+                    if (out.str().find("f19.txt") == std::string::npos) failures++;
+                } catch (const AppException &) {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (auto &t : threads) t.join();
+
+    EXPECT_EQ(failures, 0);
+    EXPECT_LE(pool.idleCount(), 8);
+    pool.clear();
+}
+
+}  // namespace
@@ -3,11 +3,21 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 #include "gtest/gtest.h"
+#include "connectionpool.h"
 #include "dbops.h"
+#include "delta.h"
+#include "mio.h"
+#include "status.h"
 #include "exceptions.h"
 #include "test.h"
 #include "testarea.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <set>
+
 namespace {
 
 using namespace ddb;
@@ -36,6 +46,19 @@ TEST(getIndexPathList, includeDirs) {
     );
 }
 
+TEST(getIndexPathList, nestedInputs) {
+    // Inputs inside another input folder are only listed once
+    auto pathList = ddb::getIndexPathList("data", {
+        (fs::path("data") / "folderA").string(),
+        (fs::path("data") / "folderA" / "test.txt").string(),
+        (fs::path("data") / "folderA" / "folderB").string()}, true);
+    EXPECT_EQ(pathList.size(), 4);
+    EXPECT_EQ(pathList[0], fs::path("data") / "folderA");
+    EXPECT_EQ(pathList[1], fs::path("data") / "folderA" / "folderB");
+    EXPECT_EQ(std::count(pathList.begin(), pathList.end(), fs::path("data") / "folderA" / "test.txt"), 1);
+    EXPECT_EQ(std::count(pathList.begin(), pathList.end(), fs::path("data") / "folderA" / "folderB" / "test.txt"), 1);
+}
+
 TEST(getIndexPathList, dontIncludeDirs) {
     auto pathList = ddb::getIndexPathList("data", {(fs::path("data") / "folderA" / "test.txt").string()}, false);
     EXPECT_EQ(pathList.size(), 1);
@@ -796,4 +819,959 @@ TEST(moveEntry, badParameters2) {
 
 }
 
+TEST(moveEntry, folderIntoNewParents) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    for (const auto &p : {"a/b.txt", "a/c/d.txt", "a.txt"}) {
+        fs::create_directories((testFolder / p).parent_path());
+        std::ofstream((testFolder / p).string()) << p;
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+    addToIndex(db.get(), {(testFolder / "a").string(), (testFolder / "a.txt").string()});
+    db->exec("INSERT INTO entries_meta (path, key, data, mtime) VALUES ('a/c/d.txt', 'tag', '\"x\"', 0)");
+
+    moveEntry(db.get(), "a", "x/y/a");
+
+    EXPECT_EQ(countEntries(db.get(), "a"), 0);
+    EXPECT_EQ(countEntries(db.get(), "a/c/d.txt"), 0);
+    EXPECT_EQ(countEntries(db.get(), "a.txt"), 1);
+
+    Entry e;
+    ASSERT_TRUE(getEntry(db.get(), "x", e));
+    EXPECT_EQ(e.type, Directory);
+    ASSERT_TRUE(getEntry(db.get(), "x/y", e));
+    EXPECT_EQ(e.type, Directory);
+    EXPECT_EQ(e.depth, 1);
+    ASSERT_TRUE(getEntry(db.get(), "x/y/a/c/d.txt", e));
+    EXPECT_EQ(e.depth, 4);
+
+    auto q = db->query("SELECT path FROM entries_meta");
+    ASSERT_TRUE(q->fetch());
+    EXPECT_EQ(q->getText(0), "x/y/a/c/d.txt");
+
+    // Files cannot become folders
+    ASSERT_THROW(moveEntry(db.get(), "x/y/a", "a.txt/a"), InvalidArgsException);
+}
+
+TEST(moveEntry, literalFolderNames) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    auto db = ddb::open(testFolder.string(), false);
+
+    // '*' is not valid in Windows file names, so the folders only live in the index
+    for (const auto &p : {"a*", "a*/x.txt", "ab", "ab/y.txt", "a", "a/z.txt"}) {
+        auto q = db->query("INSERT INTO entries (path, hash, type, mtime, size, depth) VALUES (?, '', ?, 0, 0, ?)");
+        const std::string path = p;
+        q->bind(1, path);
+        q->bind(2, path.find('.') == std::string::npos ? Directory : Generic);
+        q->bind(3, io::Path(path).depth());
+        q->execute();
+    }
+
+    moveEntry(db.get(), "a*", "m");
+
+    EXPECT_EQ(countEntries(db.get(), "m/x.txt"), 1);
+    EXPECT_EQ(countEntries(db.get(), "a*/x.txt"), 0);
+    EXPECT_EQ(countEntries(db.get(), "ab/y.txt"), 1);
+    EXPECT_EQ(countEntries(db.get(), "a/z.txt"), 1);
+    EXPECT_EQ(countEntries(db.get()), 6);
+
+    // Folders cannot be moved into themselves
+    ASSERT_THROW(moveEntry(db.get(), "ab", "ab/c"), InvalidArgsException);
+    EXPECT_EQ(countEntries(db.get(), "ab/y.txt"), 1);
+}
+
+TEST(addToIndex, multiThreaded) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 50; i++) {
+        const auto p = testFolder / ("file" + std::to_string(i) + ".txt");
+        std::ofstream f(p.string());
+        f << "content " << i;
+        paths.push_back(p.string());
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+
+    std::vector<std::string> added;
+    addToIndex(db.get(), paths, [&added](const Entry &e, bool updated){
+        EXPECT_FALSE(updated);
+        added.push_back(e.path);
+        return true;
+    }, 4);
+
+    // Callbacks are invoked in the same order as the input paths
+    ASSERT_EQ(added.size(), paths.size());
+    for (size_t i = 0; i < paths.size(); i++)
+        EXPECT_EQ(added[i], fs::path(paths[i]).filename().string());
+
+    EXPECT_EQ(countEntries(db.get()), 50);
+}
+
+TEST(addToIndex, duplicatePaths) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    const auto folder = testFolder / "dir";
+    fs::create_directories(folder / "sub");
+    for (const auto &name : {"a.txt", "b.txt", "sub/c.txt"}) {
+        std::ofstream f((folder / name).string());
+        f << name;
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+
+    // The same files given directly, walked and spelled differently
+    addToIndex(db.get(), {folder.string(), (folder / "a.txt").string(), (folder / "a.txt").string(),
+                          (folder / "sub" / ".." / "b.txt").string(), (folder / "sub" / "c.txt").string()},
+               nullptr, 4);
+
+    EXPECT_EQ(countEntries(db.get()), 5);
+    EXPECT_EQ(countEntries(db.get(), "dir/a.txt"), 1);
+    EXPECT_EQ(countEntries(db.get(), "dir/sub/c.txt"), 1);
+}
+
+TEST(addToIndex, largeFile) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    // Large enough to get a BLAKE3 hash, which the lone job in
+    // flight computes with the idle workers' cores
+    const auto p = testFolder / "large.bin";
+    {
+        std::ofstream f(p.string(), std::ios::binary);
+        f << "header";
+    }
+    fs::resize_file(p, BLAKE3_MIN_FILE_SIZE + 12345);
+
+    auto db = ddb::open(testFolder.string(), false);
+    addToIndex(db.get(), {p.string()}, nullptr, 4);
+
+    auto q = db->query("SELECT blake3, hash FROM entries WHERE path = 'large.bin'");
+    ASSERT_TRUE(q->fetch());
+    EXPECT_EQ(q->getText(0), Hash::fileBLAKE3(p.string(), 1));
+    EXPECT_EQ(q->getText(1), Hash::fileSHA256(p.string()));
+}
+
+TEST(addToIndex, cancel) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 20; i++) {
+        const auto p = testFolder / ("file" + std::to_string(i) + ".txt");
+        std::ofstream f(p.string());
+        f << "content " << i;
+        paths.push_back(p.string());
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+
+    int calls = 0;
+    addToIndex(db.get(), paths, [&calls](const Entry &, bool){
+        return ++calls < 5;
+    }, 4);
+
+    EXPECT_EQ(calls, 5);
+
+    // Entries reported before cancelling are committed
+    EXPECT_EQ(countEntries(db.get()), 5);
+}
+
+TEST(checkUpdate, tiers) {
+    TestArea ta(TEST_NAME, true);
+    const auto file = ta.getFolder() / "file.txt";
+    {
+        std::ofstream f(file.string());
+        f << "hello world";
+    }
+
+    const auto mtime = static_cast<long long>(io::Path(file).getModifiedTime());
+    const auto hash = Hash::fileSHA256(file.string());
+    const auto quickHash = Hash::fileQuickHash(file.string());
+
+    // Strict is the default, the quick hash is opt-in
+    EXPECT_EQ(getChangeDetection(), CDStrict);
+    setChangeDetection(CDQuick);
+
+    // Same size and modified time
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime, hash, 11, quickHash), NotModified);
+        EXPECT_TRUE(e.hash.empty());
+    }
+
+    // Size changed, no hashing needed
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime, hash, 12, quickHash), Modified);
+        EXPECT_TRUE(e.hash.empty());
+        EXPECT_TRUE(e.quickHash.empty());
+    }
+
+    // Touched file, quick hash matches
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime - 10, hash, 11, quickHash), NotModified);
+        EXPECT_TRUE(e.hash.empty());
+        EXPECT_EQ(e.quickHash, quickHash);
+        EXPECT_EQ(e.mtime, mtime);
+    }
+
+    // Touched file, quick hash differs
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime - 10, hash, 11, "abc"), Modified);
+    }
+
+    // No quick hash stored, falls back to SHA256
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime - 10, hash, 11, ""), NotModified);
+        EXPECT_EQ(e.hash, hash);
+        EXPECT_EQ(e.quickHash, quickHash);
+    }
+
+    // Strict mode ignores the quick hash
+    setChangeDetection(CDStrict);
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime - 10, "abc", 11, quickHash), Modified);
+        EXPECT_EQ(e.hash, hash);
+    }
+
+    // A stored BLAKE3 hash is verified instead of SHA256
+    const auto blake3 = Hash::fileBLAKE3(file.string());
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime - 10, "abc", 11, quickHash, blake3), NotModified);
+        EXPECT_TRUE(e.hash.empty());
+        EXPECT_EQ(e.blake3, blake3);
+    }
+    {
+        Entry e;
+        EXPECT_EQ(checkUpdate(e, file, mtime - 10, hash, 11, quickHash, "abc"), Modified);
+        EXPECT_TRUE(e.hash.empty());
+    }
+}
+
+TEST(getMatchingEntries, pathRanges) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    std::vector<std::string> paths;
+    for (const auto &p : {"pics/a_1.jpg", "pics/a_2.png", "pics/aX1.jpg", "pics2/b.jpg",
+                          "pics.txt", "100%.txt", "1000.txt"}) {
+        fs::create_directories((testFolder / p).parent_path());
+        std::ofstream((testFolder / p).string()) << p;
+        paths.push_back((testFolder / p).string());
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+    addToIndex(db.get(), paths);
+
+    auto match = [&db](const std::string &query, bool isFolder = false) {
+        std::vector<std::string> res;
+        for (const auto &e : getMatchingEntries(db.get(), query, 0, isFolder)) res.push_back(e.path);
+        std::sort(res.begin(), res.end());
+        return res;
+    };
+
+    typedef std::vector<std::string> Paths;
+    EXPECT_EQ(match("pics", true), Paths({"pics/a_1.jpg", "pics/a_2.png", "pics/aX1.jpg"}));
+    EXPECT_EQ(match("pics*"), Paths({"pics", "pics.txt", "pics/a_1.jpg", "pics/a_2.png",
+                                     "pics/aX1.jpg", "pics2", "pics2/b.jpg"}));
+    EXPECT_EQ(match("pics/a_*.jpg"), Paths({"pics/a_1.jpg"}));
+    EXPECT_EQ(match("100%.txt"), Paths({"100%.txt"}));
+    EXPECT_EQ(match("*.txt"), Paths({"100%.txt", "1000.txt", "pics.txt"}));
+    EXPECT_EQ(match("").size(), 9);
+
+    // Patterns ignore the case of ASCII letters, as LIKE does
+    EXPECT_EQ(match("PICS", true), Paths({"pics/a_1.jpg", "pics/a_2.png", "pics/aX1.jpg"}));
+    EXPECT_EQ(match("Pics/A*.JPG"), Paths({"pics/a_1.jpg", "pics/aX1.jpg"}));
+    EXPECT_EQ(match("pics/ax*"), Paths({"pics/aX1.jpg"}));
+    EXPECT_EQ(match("PICS.TXT"), Paths({"pics.txt"}));
+
+    EXPECT_EQ(deleteFromIndex(db.get(), "pics", true), 3);
+    EXPECT_EQ(match("pics*"), Paths({"pics", "pics.txt", "pics2", "pics2/b.jpg"}));
+}
+
+TEST(listIndex, streamsInPathOrder) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    for (const auto &p : {"a/b.txt", "a/c/d.txt", "a.txt", "a-b.txt", "b/e.txt"}) {
+        fs::create_directories((testFolder / p).parent_path());
+        std::ofstream((testFolder / p).string()) << p;
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+    addToIndex(db.get(), {(testFolder / "a").string(), (testFolder / "a.txt").string(),
+                          (testFolder / "a-b.txt").string(), (testFolder / "b").string()});
+
+    typedef std::vector<std::string> Paths;
+    auto list = [&db, &testFolder](const Paths &paths, bool recursive, int maxDepth = 0) {
+        Paths inputs;
+        for (const auto &p : paths) inputs.push_back((testFolder / p).string());
+
+        Paths res;
+        listIndex(db.get(), inputs, [&res](const Entry &e) {
+            res.push_back(e.path);
+            return true;
+        }, recursive, maxDepth);
+        return res;
+    };
+
+    // Folder contents come after siblings that sort before "a/"
+    EXPECT_EQ(list({""}, true), Paths({"a", "a-b.txt", "a.txt", "a/b.txt", "a/c", "a/c/d.txt", "b", "b/e.txt"}));
+    EXPECT_EQ(list({""}, true, 2), Paths({"a", "a-b.txt", "a.txt", "a/b.txt", "a/c", "b", "b/e.txt"}));
+    EXPECT_EQ(list({"a"}, false), Paths({"a/b.txt", "a/c"}));
+
+    // Overlapping inputs are listed as many times as they are requested
+    EXPECT_EQ(list({"a", "a/*"}, false), Paths({"a", "a/b.txt", "a/b.txt", "a/c", "a/c", "a/c/d.txt"}));
+
+    std::ostringstream out;
+    listIndex(db.get(), {(testFolder / "a").string()}, out, "text");
+    EXPECT_EQ(out.str(), "a/b.txt\na/c\n");
+}
+
+TEST(searchIndex, spatialFilters) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    auto addPoint = [&db](const std::string &path, double lon, double lat) {
+        auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth, point_geom) "
+                           "VALUES (?, 3, '{}', 0, 0, 0, MakePointZ(?, ?, 0, 4326))");
+        q->bind(1, path);
+        q->bind(2, lon);
+        q->bind(3, lat);
+        q->execute();
+    };
+
+    addPoint("a.jpg", 10.0, 45.0);
+    addPoint("b.jpg", 10.001, 45.0);
+    addPoint("c.jpg", 10.01, 45.01);
+    addPoint("d.jpg", 11.0, 46.0);
+    db->exec("INSERT INTO entries (path, type, properties, mtime, size, depth, polygon_geom) "
+             "VALUES ('e.tif', 4, '{}', 0, 0, 0, "
+             "GeomFromText('POLYGONZ((10.5 45.5 0, 10.6 45.5 0, 10.6 45.6 0, 10.5 45.6 0, 10.5 45.5 0))', 4326))");
+    db->exec("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES ('f.txt', 2, '{}', 0, 0, 0)");
+
+    auto search = [&db](const SearchFilter &filter, const std::string &query = "*") {
+        std::ostringstream out;
+        searchIndex(db.get(), query, out, "text", filter);
+        return out.str();
+    };
+
+    SearchFilter f;
+    EXPECT_EQ(search(f), "a.jpg\nb.jpg\nc.jpg\nd.jpg\ne.tif\nf.txt\n");
+
+    f.bbox = {9.9, 44.9, 10.55, 45.55};
+    EXPECT_EQ(search(f), "a.jpg\nb.jpg\nc.jpg\ne.tif\n");
+    EXPECT_EQ(search(f, "*.jpg"), "a.jpg\nb.jpg\nc.jpg\n");
+
+    f = SearchFilter();
+    f.intersects = "POLYGON((10.9 45.9, 11.1 45.9, 11.1 46.1, 10.9 46.1, 10.9 45.9))";
+    EXPECT_EQ(search(f), "d.jpg\n");
+
+    // Closest first
+    f = SearchFilter();
+    f.near = {10.0011, 45.0};
+    f.nearCount = 3;
+    EXPECT_EQ(search(f), "b.jpg\na.jpg\nc.jpg\n");
+    f.nearCount = 100;
+    EXPECT_EQ(search(f), "b.jpg\na.jpg\nc.jpg\nd.jpg\n");
+
+    f.intersects = "NOT WKT";
+    EXPECT_THROW(search(f), InvalidArgsException);
+    EXPECT_THROW(SearchFilter::fromJSON(json::parse(R"({"bbox": [1, 2, 3]})")), InvalidArgsException);
+}
+
+TEST(searchIndex, captureTime) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    double t0;
+    ASSERT_TRUE(utils::iso8601ToMillis("2021-05-01T10:00:00Z", t0));
+    const double minute = 60 * 1000;
+
+    db->exec("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES ('dir', 1, 'null', 0, 0, 0)");
+    auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth, capture_time) VALUES (?, 6, '{}', 0, 0, ?, ?)");
+    for (int i = 0; i < 4; i++) {
+        const std::string path = i < 2 ? "img" + std::to_string(i) + ".jpg" : "dir/img" + std::to_string(i) + ".jpg";
+        q->bind(1, path);
+        q->bind(2, i < 2 ? 0 : 1);
+        q->bind(3, t0 + i * 10 * minute);
+        q->execute();
+    }
+    db->exec("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES ('notes.txt', 2, '{}', 0, 0, 0)");
+
+    SearchFilter f;
+    f.captureTime = {t0 + 5 * minute, SearchFilter::parseTime("2021-05-01T10:20:00Z")};
+
+    std::ostringstream out;
+    searchIndex(db.get(), "*", out, "text", f);
+    EXPECT_EQ(out.str(), "dir/img2.jpg\nimg1.jpg\n");
+
+    // Folders are kept in listings
+    std::ostringstream list;
+    listIndex(db.get(), {testFolder.string()}, list, "text", true, 0, f);
+    EXPECT_EQ(list.str(), "dir\ndir/img2.jpg\nimg1.jpg\n");
+
+    const auto extent = db->getExtent();
+    EXPECT_EQ(extent["temporal"]["interval"][0][0], "2021-05-01T10:00:00.000Z");
+    EXPECT_EQ(extent["temporal"]["interval"][0][1], "2021-05-01T10:30:00.000Z");
+
+    EXPECT_THROW(SearchFilter::parseTime("yesterday"), InvalidArgsException);
+    EXPECT_THROW(SearchFilter::fromJSON(json::parse(R"({"captureTime": [2, 1]})")), InvalidArgsException);
+}
+
+TEST(searchIndex, fullText) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 3, '{}', 0, 0, 0)");
+    for (const std::string path : {"2021/SITE-12/flight-7/a.jpg", "2021/SITE-12/flight-8/b.jpg",
+                                   "2021/site-120/c.jpg", "2022/SITE-3/d.jpg", "readme.txt"}) {
+        q->bind(1, path);
+        q->execute();
+    }
+    db->exec("INSERT INTO entries_meta (path, key, data, mtime) VALUES ('2022/SITE-3/d.jpg', 'tags', '\"Bridge inspection\"', 0)");
+    db->exec("INSERT INTO entries_meta (path, key, data, mtime) VALUES ('2022/SITE-3/d.jpg', 'other', '\"tunnel\"', 0)");
+
+    auto search = [&db](const std::string &query, const std::string &text = "") {
+        SearchFilter f;
+        f.text = text;
+        std::ostringstream out;
+        searchIndex(db.get(), query, out, "text", f);
+        return out.str();
+    };
+
+    // Same results as LIKE (case insensitive), with or without the index
+    EXPECT_EQ(search("*site-12*"), "2021/SITE-12/flight-7/a.jpg\n2021/SITE-12/flight-8/b.jpg\n2021/site-120/c.jpg\n");
+    EXPECT_EQ(search("*SITE-12/*flight-8*"), "2021/SITE-12/flight-8/b.jpg\n");
+    EXPECT_EQ(search("*12*"), "2021/SITE-12/flight-7/a.jpg\n2021/SITE-12/flight-8/b.jpg\n2021/site-120/c.jpg\n");
+    EXPECT_EQ(search("2021/*flight*"), "2021/SITE-12/flight-7/a.jpg\n2021/SITE-12/flight-8/b.jpg\n");
+    EXPECT_EQ(getMatchingEntries(db.get(), "*flight-7*").size(), 1);
+
+    EXPECT_EQ(search("*", "bridge"), "2022/SITE-3/d.jpg\n");
+    EXPECT_EQ(search("*", "insp site"), "2022/SITE-3/d.jpg\n");
+    EXPECT_EQ(search("*", "3/"), "2022/SITE-3/d.jpg\n");
+    EXPECT_EQ(search("*", "tunnel"), "");
+    EXPECT_EQ(search("2021/*", "jpg 8"), "2021/SITE-12/flight-8/b.jpg\n");
+
+    // The index follows moves and deletes
+    db->exec("UPDATE entries SET path = '2023/d.jpg' WHERE path = '2022/SITE-3/d.jpg'");
+    db->exec("UPDATE entries_meta SET path = '2023/d.jpg' WHERE path = '2022/SITE-3/d.jpg'");
+    db->exec("DELETE FROM entries WHERE path = '2021/site-120/c.jpg'");
+
+    EXPECT_EQ(search("*", "bridge"), "2023/d.jpg\n");
+    EXPECT_EQ(search("*site*"), "2021/SITE-12/flight-7/a.jpg\n2021/SITE-12/flight-8/b.jpg\n");
+
+    db->exec("DELETE FROM entries_meta WHERE path = '2023/d.jpg'");
+    EXPECT_EQ(search("*", "bridge"), "");
+
+    // And restores that move a metadata id to another path
+    db->exec("INSERT INTO entries_meta (id, path, key, data, mtime) VALUES ('m1', '2023/d.jpg', 'tags', '\"bridge\"', 0)");
+    EXPECT_EQ(search("*", "bridge"), "2023/d.jpg\n");
+    db->getMetaManager()->restore(json::array({{{"id", "m1"}, {"path", "readme.txt"}, {"key", "tags"},
+                                                {"data", "\"harbour\""}, {"mtime", 0}}}));
+    EXPECT_EQ(search("*", "bridge"), "");
+    EXPECT_EQ(search("*", "harbour"), "readme.txt\n");
+
+    if (db->hasFullTextIndex()) {
+        auto count = db->query("SELECT COUNT(*) FROM entries_fts");
+        count->fetch();
+        EXPECT_EQ(count->getInt(0), 4);
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(searchIndex, DISABLED_fullTextBenchmark) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+    const int numEntries = 1000000;
+
+    db->exec("BEGIN TRANSACTION");
+    auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 3, '{}', 0, 0, 2)");
+    for (int i = 0; i < numEntries; i++) {
+        q->bind(1, "site-" + std::to_string(i / 10000) + "/flight-" + std::to_string(i / 100) + "/" +
+                   std::to_string(i) + ".jpg");
+        q->execute();
+    }
+    db->exec("COMMIT");
+
+    auto time = [](const std::function<size_t()> &f, size_t &rows) {
+        const auto start = std::chrono::steady_clock::now();
+        rows = f();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    size_t likeRows, indexRows;
+    const auto likeMs = time([&db]() {
+        auto q = db->query("SELECT path FROM entries WHERE path LIKE '%flight-4242/%' ORDER BY path");
+        size_t rows = 0;
+        while (q->fetch()) rows++;
+        return rows;
+    }, likeRows);
+    const auto indexMs = time([&db]() {
+        std::ostringstream out;
+        searchIndex(db.get(), "*flight-4242/*", out, "text");
+        const auto s = out.str();
+        return static_cast<size_t>(std::count(s.begin(), s.end(), '\n'));
+    }, indexRows);
+
+    EXPECT_EQ(likeRows, indexRows);
+    std::cout << "Searched " << numEntries << " entries for *flight-4242/*: " << likeMs << " ms (LIKE), "
+              << indexMs << " ms (" << (db->hasFullTextIndex() ? "full-text index" : "LIKE, no full-text index") << ")"
+              << std::endl;
+}
+
+TEST(sqliteDatabase, cachedQuery) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    const std::string insert = "INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 2, '{}', 0, ?, 0)";
+    auto q = db->cachedQuery(insert);
+    q->bind(1, "a.txt");
+    q->bind(2, 5);
+    q->execute();
+
+    // Same statement, with its bindings cleared
+    EXPECT_EQ(db->cachedQuery(insert), q);
+    q->bind(1, "b.txt");
+    q->execute();
+
+    // Still usable after a failure
+    q = db->cachedQuery(insert);
+    q->bind(1, "a.txt");
+    EXPECT_THROW(q->execute(), DBException);
+    q = db->cachedQuery(insert);
+    q->bind(1, "c.txt");
+    q->execute();
+
+    auto sel = db->cachedQuery("SELECT path, size FROM entries WHERE path >= ? ORDER BY path");
+    sel->bind(1, "a");
+    std::vector<std::string> rows;
+    while (sel->fetch()) rows.push_back(std::string(sel->getTextView(0)) + ":" + std::to_string(sel->getInt(1)));
+    sel->reset();
+    EXPECT_EQ(rows, std::vector<std::string>({"a.txt:5", "b.txt:0", "c.txt:0"}));
+
+    // Least recently used statements are finalized
+    for (int i = 0; i < STATEMENT_CACHE_SIZE + 1; i++) {
+        auto c = db->cachedQuery("SELECT " + std::to_string(i));
+        ASSERT_TRUE(c->fetch());
+        EXPECT_EQ(c->getTextView(0), std::to_string(i));
+        c->reset();
+    }
+
+    const char data[] = {1, 0, 2};
+    auto blob = db->cachedQuery("SELECT ?, ?");
+    blob->bind(1, data, 3);
+    blob->bindNull(2);
+    ASSERT_TRUE(blob->fetch());
+    const auto *b = static_cast<const char *>(blob->getBlob(0));
+    EXPECT_EQ(blob->getBytes(0), 3);
+    EXPECT_EQ(std::string(b, 3), std::string(data, 3));
+    EXPECT_TRUE(blob->getTextView(1).empty());
+    blob->reset();
+
+    EXPECT_TRUE(pathExists(db.get(), "c.txt"));
+    EXPECT_FALSE(pathExists(db.get(), "d.txt"));
+}
+
+TEST(database, bulkLoad) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    EXPECT_EQ(db->getProfile(), ProfileRead);
+    EXPECT_TRUE(db->indexExists("ix_entries_type"));
+
+    {
+        // Indexes of an empty table are built when the outermost load ends
+        BulkLoad outer(db.get());
+        EXPECT_EQ(db->getProfile(), ProfileBulk);
+        EXPECT_FALSE(db->indexExists("ix_entries_type"));
+        EXPECT_FALSE(db->indexExists("ix_entries_make"));
+
+        {
+            BulkLoad inner(db.get());
+        }
+        EXPECT_EQ(db->getProfile(), ProfileBulk);
+
+        auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 2, '{}', 0, 0, 0)");
+        for (int i = 0; i < 10; i++) {
+            q->bind(1, "f" + std::to_string(i) + ".txt");
+            q->execute();
+        }
+
+        // Schema checks are not triggered for other connections
+        auto other = ddb::open(testFolder.string(), false);
+        EXPECT_TRUE(other->hasCurrentSchema());
+
+        // which build the indexes if they start a load themselves
+        {
+            BulkLoad otherLoad(other.get());
+            EXPECT_TRUE(other->indexExists("ix_entries_type"));
+        }
+
+        EXPECT_NO_THROW(outer.end());
+    }
+
+    EXPECT_EQ(db->getProfile(), ProfileRead);
+    EXPECT_TRUE(db->indexExists("ix_entries_type"));
+    EXPECT_TRUE(db->indexExists("ix_entries_make"));
+
+    // Loads into a table with entries keep the indexes
+    {
+        BulkLoad bulkLoad(db.get());
+        EXPECT_TRUE(db->indexExists("ix_entries_type"));
+    }
+
+    db->setAutoBulkLoad(false);
+    {
+        BulkLoad bulkLoad(db.get());
+        EXPECT_EQ(db->getProfile(), ProfileRead);
+    }
+
+    db->setProfile(ProfileDefault);
+    auto cache = db->query("PRAGMA cache_size");
+    ASSERT_TRUE(cache->fetch());
+    EXPECT_EQ(cache->getInt(0), -2000);
+}
+
+TEST(database, schemaVersion) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    {
+        auto db = ddb::open(testFolder.string(), false);
+        EXPECT_EQ(db->getUserVersion(), DDB_SCHEMA_VERSION);
+        EXPECT_TRUE(db->hasCurrentSchema());
+
+        // An interrupted bulk load leaves the indexes missing,
+        // but the schema version is untouched
+        db->beginBulkLoad();
+        EXPECT_FALSE(db->indexExists("ix_entries_type"));
+        EXPECT_TRUE(db->hasCurrentSchema());
+        db->exec("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES ('a.txt', 2, '{}', 0, 0, 0)");
+    }
+
+    {
+        // The next bulk load builds them
+        auto db = ddb::open(testFolder.string(), false);
+        EXPECT_FALSE(db->indexExists("ix_entries_type"));
+        BulkLoad(db.get()).end();
+        EXPECT_TRUE(db->indexExists("ix_entries_type"));
+        EXPECT_EQ(db->getUserVersion(), DDB_SCHEMA_VERSION);
+
+        // Unversioned databases are checked and upgraded
+        db->exec("DROP TABLE passwords");
+        db->setUserVersion(0);
+    }
+
+    {
+        auto db = ddb::open(testFolder.string(), false);
+        EXPECT_TRUE(db->tableExists("passwords"));
+        EXPECT_EQ(db->getUserVersion(), DDB_SCHEMA_VERSION);
+
+        // Newer versions are left alone
+        db->setUserVersion(DDB_SCHEMA_VERSION + 1);
+        db->exec("DROP TABLE passwords");
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+    EXPECT_FALSE(db->tableExists("passwords"));
+    EXPECT_EQ(db->getUserVersion(), DDB_SCHEMA_VERSION + 1);
+}
+
+TEST(database, checksums) {
+    TestArea ta(TEST_NAME, true);
+    const auto folderA = ta.getFolder("a");
+    const auto folderB = ta.getFolder("b");
+    initIndex(folderA.string());
+    initIndex(folderB.string());
+    auto a = ddb::open(folderA.string(), false);
+    auto b = ddb::open(folderB.string(), false);
+
+    const std::string emptyRoot = a->getChecksum();
+    EXPECT_FALSE(emptyRoot.empty());
+    EXPECT_EQ(a->getChecksum("x"), "");
+
+    auto insert = [](Database *db, const std::vector<std::pair<std::string, std::string>> &entries) {
+        auto q = db->query("INSERT INTO entries (path, hash, type, properties, mtime, size, depth) VALUES (?, ?, ?, '{}', 0, 0, 0)");
+        for (const auto &e : entries) {
+            q->bind(1, e.first);
+            q->bind(2, e.second);
+            q->bind(3, e.second.empty() ? 1 : 2);
+            q->execute();
+        }
+    };
+    insert(a.get(), {{"x", ""}, {"x/b.txt", "h1"}, {"x/c", ""}, {"x/c/d.txt", "h2"}, {"y.txt", "h3"}});
+    insert(b.get(), {{"y.txt", "h3"}, {"x/c/d.txt", "h2"}, {"x/c", ""}, {"x/b.txt", "h1"}, {"x", ""}});
+
+    // Same contents, whatever the order they were added in
+    const std::string root = a->getChecksum();
+    const std::string x = a->getChecksum("x");
+    const std::string xc = a->getChecksum("x/c/");
+    EXPECT_NE(root, emptyRoot);
+    EXPECT_EQ(b->getChecksum(), root);
+    EXPECT_EQ(b->getChecksum("x/c"), xc);
+    EXPECT_EQ(a->getChildChecksums("x"), (std::map<std::string, std::string>{{"x/c/", xc}}));
+    EXPECT_EQ(a->getChildChecksums("").size(), 1);
+
+    // Only the folders above a change are affected
+    b->exec("UPDATE entries SET hash = 'h4' WHERE path = 'y.txt'");
+    EXPECT_NE(b->getChecksum(), root);
+    EXPECT_EQ(b->getChecksum("x"), x);
+
+    b->exec("INSERT INTO entries_meta (path, key, data, mtime) VALUES ('x/b.txt', 'tags', '\"t\"', 0)");
+    EXPECT_NE(b->getChecksum("x"), x);
+    EXPECT_EQ(b->getChecksum("x/c"), xc);
+
+    b->exec("UPDATE entries SET hash = 'h5' WHERE path = 'x/c/d.txt'");
+    EXPECT_NE(b->getChecksum("x/c"), xc);
+
+    // Read-only connections compute what they can't store
+    b->exec("DELETE FROM entries WHERE path = 'x/c/d.txt'");
+    {
+        const auto ro = ConnectionPool::instance().acquire(folderB.string());
+        const std::string pending = ro->getChecksum("x");
+        EXPECT_EQ(ro->getChecksum("x/c"), "");
+        EXPECT_EQ(b->getChecksum("x"), pending);
+    }
+    ConnectionPool::instance().clear();
+
+    // Undoing the changes brings the checksums back
+    b->exec("DELETE FROM entries_meta");
+    b->exec("UPDATE entries SET hash = 'h3' WHERE path = 'y.txt'");
+    insert(b.get(), {{"x/c/d.txt", "h2"}});
+    EXPECT_EQ(b->getChecksum(), root);
+
+    // Stamps are kept until something changes
+    const json stamp = a->getStamp();
+    EXPECT_EQ(a->getStamp(), stamp);
+    EXPECT_EQ(b->getStamp()["checksum"], stamp["checksum"]);
+    insert(a.get(), {{"z.txt", "h6"}});
+    EXPECT_EQ(a->getStamp()["entries"].size(), 6);
+
+    // Deltas skip the folders that are the same
+    b->exec("UPDATE entries SET hash = 'h7' WHERE path = 'x/b.txt'");
+    b->exec("INSERT INTO entries_meta (path, key, data, mtime) VALUES ('', 'name', '\"n\"', 0)");
+    for (const auto &pair : {std::make_pair(a.get(), b.get()), std::make_pair(b.get(), a.get())}) {
+        const json pruned = getDelta(pair.first, pair.second);
+        const json full = getDelta(pair.first->getStamp(), pair.second->getStamp());
+        EXPECT_EQ(pruned, full);
+    }
+    EXPECT_TRUE(getDelta(a.get(), a.get()).empty());
+}
+
+TEST(database, checksumsOnWrites) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    for (const auto &p : {"x/a.txt", "b.txt", "c.txt"}) {
+        fs::create_directories((testFolder / p).parent_path());
+        std::ofstream((testFolder / p).string()) << p;
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+    auto dirty = [&db]() {
+        auto q = db->query("SELECT COUNT(*) FROM entries_checksums_dirty");
+        q->fetch();
+        return q->getInt(0);
+    };
+
+    // Writes store the checksums, so readers only look them up
+    addToIndex(db.get(), {(testFolder / "x").string(), (testFolder / "b.txt").string(),
+                          (testFolder / "c.txt").string()});
+    EXPECT_EQ(dirty(), 0);
+    moveEntry(db.get(), "c.txt", "x/c.txt");
+    EXPECT_EQ(dirty(), 0);
+    const std::string x = db->getChecksum("x");
+
+    // Restoring an id that is now in another folder replaces
+    // the row, which changes the folder it was in
+    db->exec("INSERT INTO entries_meta (id, path, key, data, mtime) VALUES ('m1', 'x/a.txt', 'tags', '\"t\"', 0)");
+    EXPECT_NE(db->getChecksum("x"), x);
+    db->getMetaManager()->restore(json::array({{{"id", "m1"}, {"path", "b.txt"}, {"key", "tags"},
+                                                {"data", "\"t\""}, {"mtime", 0}}}));
+    EXPECT_EQ(dirty(), 0);
+    EXPECT_EQ(db->getChecksum("x"), x);
+
+    const json stamp = db->getStamp();
+    deleteFromIndex(db.get(), "b.txt");
+    EXPECT_EQ(dirty(), 0);
+    EXPECT_NE(db->getStamp()["checksum"], stamp["checksum"]);
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(database, DISABLED_openBenchmark) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    const int opens = 1000;
+
+    auto time = [&](bool versioned) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < opens; i++) {
+            auto db = ddb::open(testFolder.string(), false);
+
+            // Makes the next open run all the schema checks
+            if (!versioned) db->setUserVersion(0);
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / opens;
+    };
+
+    const auto checkedUs = time(false);
+    ddb::open(testFolder.string(), false);
+    const auto versionedUs = time(true);
+
+    std::cout << "Opened database " << opens << " times: " << checkedUs << " us per open with schema checks, "
+              << versionedUs << " us with the schema version" << std::endl;
+}
+
+TEST(statusIndex, mergeJoin) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    auto write = [&testFolder](const std::string &path, const std::string &content) {
+        fs::create_directories((testFolder / path).parent_path());
+        std::ofstream f((testFolder / path).string());
+        f << content;
+    };
+
+    write("a/b.txt", "b");
+    write("a.txt", "a");
+    write("c/d.txt", "d");
+    write("c/e.txt", "e");
+
+    auto db = ddb::open(testFolder.string(), false);
+    addToIndex(db.get(), {(testFolder / "a").string(), (testFolder / "a.txt").string(),
+                          (testFolder / "c").string()});
+
+    write("a.txt", "modified");
+    write("a-b.txt", "not indexed");
+    write("new/x.txt", "not indexed");
+    write("x.ddb", "not indexed");
+    fs::remove(testFolder / "c" / "d.txt");
+
+    // Same size and content, different modified time
+    db->exec("UPDATE entries SET mtime = mtime - 10 WHERE path = 'c/e.txt'");
+
+    typedef std::vector<std::pair<FileStatus, std::string>> Results;
+    const Results expected = {
+        {NotModified, "a"},
+        {NotIndexed, "a-b.txt"},
+        {Modified, "a.txt"},
+        {NotModified, "a/b.txt"},
+        {NotModified, "c"},
+        {Deleted, "c/d.txt"},
+        {NotModified, "c/e.txt"},
+        {NotIndexed, "new"},
+        {NotIndexed, "new/x.txt"},
+        {NotIndexed, "x.ddb"}
+    };
+
+    for (int threads : {1, 4}) {
+        Results results;
+        statusIndex(db.get(), [&results](FileStatus status, const std::string &path) {
+            results.push_back({status, path});
+        }, threads);
+
+        EXPECT_EQ(results, expected) << "threads: " << threads;
+    }
+}
+
+TEST(syncIndex, parallel) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 200; i++) {
+        const auto p = testFolder / ("file" + std::to_string(i) + ".txt");
+        std::ofstream f(p.string());
+        f << "content " << i;
+        paths.push_back(p.string());
+    }
+
+    auto db = ddb::open(testFolder.string(), false);
+    addToIndex(db.get(), paths);
+
+    // Deletes span more than one group
+    std::set<std::string> deleted;
+    for (int i = 0; i < 70; i++) {
+        fs::remove(paths[i]);
+        deleted.insert(fs::path(paths[i]).filename().string());
+    }
+
+    // Updated files have a new size, so they are only hashed once parsed
+    // (SHA256, with the quick hash from the same read). The touched file is
+    // hashed by checkUpdate only.
+    std::set<std::string> updated;
+    std::uintmax_t expectedBytes = fs::file_size(paths[150]);
+    for (int i = 100; i < 110; i++) {
+        {
+            std::ofstream f(paths[i]);
+            f << "modified content " << i;
+        }
+        updated.insert(fs::path(paths[i]).filename().string());
+        expectedBytes += fs::file_size(paths[i]);
+    }
+
+    db->exec("UPDATE entries SET mtime = mtime - 10 WHERE path = 'file150.txt'");
+
+    std::set<std::string> reportedDeleted, reportedUpdated;
+    const auto stats = syncIndex(db.get(), [&](const std::string &path, bool isDeleted) {
+        (isDeleted ? reportedDeleted : reportedUpdated).insert(path);
+        return true;
+    }, 4);
+
+    EXPECT_EQ(reportedDeleted, deleted);
+    EXPECT_EQ(reportedUpdated, updated);
+    EXPECT_EQ(stats.files, 200);
+    EXPECT_EQ(stats.deleted, 70);
+    EXPECT_EQ(stats.updated, 10);
+    EXPECT_EQ(stats.touched, 1);
+    EXPECT_EQ(stats.bytesHashed, expectedBytes);
+    EXPECT_EQ(countEntries(db.get()), 130);
+
+    // Nothing left to do
+    const auto again = syncIndex(db.get(), [](const std::string &, bool) {
+        ADD_FAILURE();
+        return true;
+    });
+    EXPECT_EQ(again.files, 130);
+    EXPECT_EQ(again.bytesHashed, 0);
+}
+
 }
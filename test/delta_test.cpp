@@ -0,0 +1,94 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <chrono>
+#include "gtest/gtest.h"
+#include "delta.h"
+#include "exceptions.h"
+#include "test.h"
+
+namespace {
+
+using namespace ddb;
+
+json makeStamp(const std::vector<std::pair<std::string, std::string>> &entries,
+               const std::vector<std::string> &meta = {}) {
+    json j;
+    j["entries"] = json::array();
+    for (const auto &e : entries) j["entries"].push_back(json::object({{e.first, e.second}}));
+    j["meta"] = meta;
+    return j;
+}
+
+// Synthetic stamp of n files in folders of 1000, where every step-th file has another hash
+json syntheticStamp(int n, int step) {
+    json j;
+    j["entries"] = json::array();
+    for (int i = 0; i < n; i++) {
+        if (i % 1000 == 0) j["entries"].push_back(json::object({{"f" + std::to_string(i / 1000), ""}}));
+        j["entries"].push_back(json::object({{"f" + std::to_string(i / 1000) + "/" + std::to_string(i) + ".jpg",
+                                              (step > 0 && i % step == 0 ? "x" : "") + std::to_string(i)}}));
+    }
+    j["meta"] = json::array();
+    return j;
+}
+
+TEST(getDelta, sortedMerge) {
+    const auto source = makeStamp({{"b.txt", "h2"}, {"a", ""}, {"a/1.txt", "h1"}, {"c", "h3"}, {"e.txt", "h5"}},
+                                  {"m1", "m2"});
+    const auto destination = makeStamp({{"a", ""}, {"a/1.txt", "h0"}, {"c", ""}, {"d.txt", "h4"}, {"e.txt", "h5"}},
+                                       {"m2", "m3"});
+
+    const auto d = getDelta(source, destination);
+
+    // A folder replaced by a file at the same path is removed and added
+    std::vector<std::string> adds, removes;
+    for (const auto &a : d.adds) adds.push_back(a.path + ":" + a.hash);
+    for (const auto &r : d.removes) removes.push_back(r.path + ":" + r.hash);
+    EXPECT_EQ(adds, std::vector<std::string>({"a/1.txt:h1", "b.txt:h2", "c:h3"}));
+    EXPECT_EQ(removes, std::vector<std::string>({"d.txt:h4", "c:"}));
+    EXPECT_EQ(d.metaAdds, std::vector<std::string>({"m1"}));
+    EXPECT_EQ(d.metaRemoves, std::vector<std::string>({"m3"}));
+
+    EXPECT_TRUE(getDelta(source, source).empty());
+    EXPECT_EQ(getDelta(source, makeStamp({})).adds.size(), 5);
+    EXPECT_EQ(getDelta(makeStamp({}), destination).removes.size(), 5);
+
+    // Repeated paths match any entry with the same path
+    const auto repeated = getDelta(makeStamp({{"x", "h1"}, {"x", "h2"}}), makeStamp({{"x", "h2"}, {"x", ""}}));
+    ASSERT_EQ(repeated.adds.size(), 1);
+    EXPECT_EQ(repeated.adds[0].hash, "h1");
+    ASSERT_EQ(repeated.removes.size(), 1);
+    EXPECT_TRUE(repeated.removes[0].isDirectory());
+
+    EXPECT_THROW(getDelta(json::object(), destination), InvalidArgsException);
+}
+
+TEST(getDelta, largeStamps) {
+    // Quadratic diffs take minutes on this
+    const int n = 200000;
+    const auto d = getDelta(syntheticStamp(n, 10), syntheticStamp(n + 1000, 0));
+
+    EXPECT_EQ(d.adds.size(), n / 10);
+    ASSERT_EQ(d.removes.size(), 1001);
+    EXPECT_EQ(d.removes.front().path, "f200/200999.jpg");
+    EXPECT_EQ(d.removes.back().path, "f200");
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(getDelta, DISABLED_benchmark) {
+    const int n = 1000000;
+    const auto source = syntheticStamp(n, 100);
+    const auto destination = syntheticStamp(n, 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto d = getDelta(source, destination);
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(d.adds.size(), n / 100);
+    EXPECT_TRUE(d.removes.empty());
+    std::cout << "Computed delta of " << n << " entries in " << ms << " ms" << std::endl;
+}
+
+}  // namespace
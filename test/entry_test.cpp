@@ -2,8 +2,13 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
+#include <cstring>
+#include <fstream>
 #include "gtest/gtest.h"
 #include "entry.h"
+#include "fileprobe.h"
+#include "test.h"
+#include "testarea.h"
 
 namespace{
 
@@ -21,6 +26,43 @@ TEST(calculateFootprint, Normal) {
 	EXPECT_STREQ(geom.toWkt().c_str(), "POLYGONZ ((-91.994308101 46.84345864217 98.31, -91.99431905836 46.84287152156 98.31, -91.99300336858 46.84285995357 98.31, -91.99299239689 46.84344707395 98.31, -91.994308101 46.84345864217 98.31))");
 }
 
+TEST(basicGeometry, toWkb){
+    auto readDouble = [](const std::string &wkb, size_t offset){
+        double d;
+        std::memcpy(&d, wkb.data() + offset, sizeof(d));
+        return d;
+    };
+    auto readUInt = [](const std::string &wkb, size_t offset){
+        uint32_t n;
+        std::memcpy(&n, wkb.data() + offset, sizeof(n));
+        return n;
+    };
+
+    BasicPointGeometry point;
+    EXPECT_TRUE(point.toWkb().empty());
+
+    // No rounding, unlike WKT
+    point.addPoint(-91.994308101123456, 46.84345864217, 98.31);
+    auto wkb = point.toWkb();
+    ASSERT_EQ(wkb.size(), 29);
+    EXPECT_EQ(readUInt(wkb, 1), 1001);
+    EXPECT_EQ(readDouble(wkb, 5), -91.994308101123456);
+    EXPECT_EQ(readDouble(wkb, 13), 46.84345864217);
+    EXPECT_EQ(readDouble(wkb, 21), 98.31);
+
+    BasicPolygonGeometry polygon;
+    polygon.addPoint(0, 0, 0);
+    polygon.addPoint(1, 0, 0);
+    polygon.addPoint(1, 1, 1);
+    polygon.addPoint(0, 0, 0);
+    wkb = polygon.toWkb();
+    ASSERT_EQ(wkb.size(), 13 + 4 * 24);
+    EXPECT_EQ(readUInt(wkb, 1), 1003);
+    EXPECT_EQ(readUInt(wkb, 5), 1);
+    EXPECT_EQ(readUInt(wkb, 9), 4);
+    EXPECT_EQ(readDouble(wkb, 13 + 2 * 24 + 16), 1.0);
+}
+
 TEST(parseJsonGeometries, Normal){
     Entry e;
     e.parsePointGeometry("[1, 2, 3]");
@@ -30,4 +72,23 @@ TEST(parseJsonGeometries, Normal){
     EXPECT_EQ(e.polygon_geom.size(), 2);
 }
 
+TEST(fingerprint, probeSharesHeader) {
+    TestArea ta(TEST_NAME, true);
+    const auto ply = ta.getFolder() / "mesh.ply";
+    {
+        std::ofstream f(ply.string());
+        f << "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\n"
+             "property float y\nproperty float z\nelement face 1\n"
+             "property list uchar int vertex_indices\nend_header\n"
+             "0 0 0\n1 0 0\n0 1 0\n3 0 1 2\n";
+    }
+
+    FileProbe probe(ply);
+    EXPECT_EQ(fingerprint(probe), EntryType::Model);
+    EXPECT_EQ(probe.getHeader().substr(0, 4), "ply\n");
+
+    // Same result as opening by path
+    EXPECT_EQ(fingerprint(ply), EntryType::Model);
+}
+
 }
@@ -0,0 +1,86 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <sstream>
+#include "gtest/gtest.h"
+#include "dbops.h"
+#include "exceptions.h"
+#include "filterexpression.h"
+#include "test.h"
+#include "testarea.h"
+
+namespace {
+
+using namespace ddb;
+
+TEST(filterExpression, compile) {
+    EXPECT_EQ(FilterExpression("make = \"DJI\" and cameraYaw between -20 and 20").sql,
+              "((json_extract(e.properties, '$.make') = ?) AND "
+              "(json_extract(e.properties, '$.cameraYaw') BETWEEN ? AND ?))");
+
+    EXPECT_EQ(FilterExpression("NOT (type in (3, 6) OR size <= 1e3) and a.b is not null").sql,
+              "(NOT ((e.type IN (?, ?)) OR (e.size <= ?)) AND "
+              "(json_extract(e.properties, '$.a.b') IS NOT NULL))");
+
+    EXPECT_EQ(FilterExpression("properties.size > 0 and path not like '%.JPG'").sql,
+              "((json_extract(e.properties, '$.size') > ?) AND (e.path NOT LIKE ?))");
+
+    EXPECT_EQ(FilterExpression("captureTime >= '2021-05-01T10:00:00Z'").sql, "(e.capture_time >= ?)");
+
+    for (const std::string bad : {"", "make", "make =", "make = DJI", "(make = 'DJI'", "make = 'DJI",
+                                  "make = 'DJI' model", "make # 1", "make not = 1", "a..b = 1",
+                                  "a = 1 and", "captureTime > 'yesterday'", "a' = 1"}) {
+        EXPECT_THROW(FilterExpression e(bad), InvalidArgsException) << bad;
+    }
+}
+
+TEST(filterExpression, search) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    const std::vector<std::pair<std::string, std::string>> entries = {
+        {"a.jpg", R"({"make": "DJI", "model": "FC6310", "relativeAltitude": 120.5, "cameraYaw": -10.2})"},
+        {"b.jpg", R"({"make": "DJI", "model": "FC6310", "relativeAltitude": 80, "cameraYaw": 5})"},
+        {"c.jpg", R"({"make": "DJI", "model": "FC6310", "relativeAltitude": 150, "cameraYaw": 90})"},
+        {"d.jpg", R"({"make": "DJI", "model": "FC330", "relativeAltitude": 110, "cameraYaw": 0})"},
+        {"e.jpg", R"({"make": "Parrot", "model": "FC6310", "relativeAltitude": 130, "cameraYaw": 19.9})"},
+        {"f.jpg", R"({"make": "DJI", "model": "FC6310", "relativeAltitude": 101, "cameraYaw": 20, "gimbal": {"locked": true}})"}
+    };
+
+    auto q = db->query("INSERT INTO entries (path, type, properties, mtime, size, depth) VALUES (?, 6, ?, 0, 0, 0)");
+    for (const auto &e : entries) {
+        q->bind(1, e.first);
+        q->bind(2, e.second);
+        q->execute();
+    }
+
+    auto search = [&db](const std::string &where) {
+        SearchFilter f;
+        f.where = where;
+        std::ostringstream out;
+        searchIndex(db.get(), "*", out, "text", f);
+        return out.str();
+    };
+
+    EXPECT_EQ(search("make = \"DJI\" and model = 'FC6310' and relativeAltitude > 100 and cameraYaw between -20 and 20"),
+              "a.jpg\nf.jpg\n");
+    EXPECT_EQ(search("make != 'DJI' or model in ('FC330')"), "d.jpg\ne.jpg\n");
+    EXPECT_EQ(search("gimbal.locked = true"), "f.jpg\n");
+    EXPECT_EQ(search("not cameraYaw < 20"), "c.jpg\nf.jpg\n");
+
+    // Hot keys are looked up in their expression index
+    const FilterExpression fe("make = 'Parrot'");
+    auto plan = db->query("EXPLAIN QUERY PLAN SELECT e.path FROM entries e WHERE " + fe.sql);
+    fe.bind(plan.get(), 1);
+    std::string details;
+    while (plan->fetch()) details += plan->getText(3) + "\n";
+    EXPECT_NE(details.find("ix_entries_make"), std::string::npos) << details;
+
+    EXPECT_THROW(SearchFilter::fromJSON(json::parse(R"({"where": "make ="})")), InvalidArgsException);
+    EXPECT_EQ(SearchFilter::fromJSON(json::parse(R"({"where": "make = 'DJI'"})")).where, "make = 'DJI'");
+}
+
+}
@@ -0,0 +1,199 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <fstream>
+#include <random>
+#include "gtest/gtest.h"
+#include "blake3hash.h"
+#include "fastsha256.h"
+#include "hash.h"
+#include "test.h"
+#include "testarea.h"
+#include "workqueue.h"
+
+namespace {
+
+using namespace ddb;
+
+TEST(fastSHA256, matchesReference) {
+    const std::string defaultBackend = FastSHA256::backend();
+    std::mt19937 rng(42);
+
+    for (const auto &backend : {"sha-ni", "armv8", "portable"}) {
+        if (!FastSHA256::setBackend(backend)) continue;
+
+        for (size_t size = 0; size < 300; size++) {
+            std::vector<uint8_t> data(size);
+            for (auto &b : data) b = static_cast<uint8_t>(rng());
+
+            SHA256 reference;
+            reference.add(data.data(), data.size());
+
+            // Feed data in random sized pieces
+            FastSHA256 sha;
+            size_t offset = 0;
+            while (offset < size) {
+                const size_t n = std::min<size_t>(size - offset, rng() % 130 + 1);
+                sha.add(data.data() + offset, n);
+                offset += n;
+            }
+
+            EXPECT_EQ(sha.getHash(), reference.getHash()) << backend << " (" << size << " bytes)";
+        }
+    }
+
+    EXPECT_TRUE(FastSHA256::setBackend(defaultBackend));
+}
+
+TEST(fastSHA256, knownVectors) {
+    FastSHA256 sha;
+    EXPECT_EQ(sha.getHash(), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    sha.add("abc", 3);
+    EXPECT_EQ(sha.getHash(), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    EXPECT_EQ(Hash::strSHA256("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST(fileSHA256, largeFile) {
+    TestArea ta(TEST_NAME, true);
+    const auto file = ta.getFolder() / "large.bin";
+
+    // Spans multiple read buffers and is not block aligned
+    std::string data(9 * 1024 * 1024 + 123, '\0');
+    std::mt19937 rng(7);
+    for (auto &c : data) c = static_cast<char>(rng());
+    {
+        std::ofstream f(file.string(), std::ios::binary);
+        f.write(data.data(), data.size());
+    }
+
+    SHA256 reference;
+    reference.add(data.data(), data.size());
+    EXPECT_EQ(Hash::fileSHA256(file.string()), reference.getHash());
+
+    // In-memory variants match the file ones
+    EXPECT_EQ(Hash::dataSHA256(data.data(), data.size()), reference.getHash());
+    EXPECT_EQ(Hash::dataQuickHash(data.data(), data.size()), Hash::fileQuickHash(file.string()));
+    EXPECT_EQ(Hash::dataQuickHash(data.data(), 1000), Hash::strSHA256("1000" + data.substr(0, 1000)));
+}
+
+TEST(fileSHA256, quickHashFromFullRead) {
+    TestArea ta(TEST_NAME, true);
+    const auto file = ta.getFolder() / "file.bin";
+    std::mt19937 rng(5);
+
+    // Empty, within the head, head and partial tail, and
+    // a tail that spans read buffers
+    for (size_t size : {size_t(0), size_t(1000), size_t(QUICK_HASH_CHUNK_SIZE + 10),
+                        size_t(4 * 1024 * 1024 + QUICK_HASH_CHUNK_SIZE / 2)}) {
+        std::string data(size, '\0');
+        for (auto &c : data) c = static_cast<char>(rng());
+        {
+            std::ofstream f(file.string(), std::ios::binary);
+            f.write(data.data(), data.size());
+        }
+
+        const std::string expected = Hash::fileQuickHash(file.string());
+        std::string quickHash, sha256, blake3;
+        EXPECT_EQ(Hash::fileSHA256(file.string(), &quickHash), Hash::fileSHA256(file.string())) << size;
+        EXPECT_EQ(quickHash, expected) << size;
+
+        quickHash = "";
+        Hash::fileBLAKE3(file.string(), 1, &quickHash);
+        EXPECT_EQ(quickHash, expected) << size;
+
+        quickHash = "";
+        Hash::fileSHA256AndBLAKE3(file.string(), sha256, blake3, 1, &quickHash);
+        EXPECT_EQ(quickHash, expected) << size;
+    }
+}
+
+// Inputs are the byte pattern i % 251 (as in the official BLAKE3 test vectors)
+std::string blake3Of(size_t size, int threads, size_t segmentChunks) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) data[i] = static_cast<uint8_t>(i % 251);
+
+    Blake3Hash b(threads, segmentChunks);
+    size_t offset = 0;
+    while (offset < size) {
+        const size_t n = std::min<size_t>(size - offset, 700);
+        b.add(data.data() + offset, n);
+        offset += n;
+    }
+    return b.getHash();
+}
+
+TEST(blake3, knownVectors) {
+    const std::vector<std::pair<size_t, std::string>> vectors = {
+        {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+        {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+        {1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+        {1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+        {1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+        {2048, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a"},
+        {2049, "5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030"},
+        {3072, "b98cb0ff3623be03326b373de6b9095218513e64f1ee2edd2525c7ad1e5cffd2"},
+        {3073, "7124b49501012f81cc7f11ca069ec9226cecb8a2c850cfe644e327d22d3e1cd3"},
+        {4096, "015094013f57a5277b59d8475c0501042c0b642e531b0a1c8f58d2163229e969"},
+        {4097, "9b4052b38f1c5fc8b1f9ff7ac7b27cd242487b3d890d15c96a1c25b8aa0fb995"},
+        {5120, "9cadc15fed8b5d854562b26a9536d9707cadeda9b143978f319ab34230535833"},
+        {5121, "628bd2cb2004694adaab7bbd778a25df25c47b9d4155a55f8fbd79f2fe154cff"},
+        {8192, "aae792484c8efe4f19e2ca7d371d8c467ffb10748d8a5a1ae579948f718a2a63"},
+        {8193, "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b"},
+        {16384, "f875d6646de28985646f34ee13be9a576fd515f76b5b0a26bb324735041ddde4"},
+        {31744, "62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47"},
+        {102400, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+    };
+
+    for (const auto &v : vectors) {
+        EXPECT_EQ(blake3Of(v.first, 1, 8192), v.second) << v.first << " bytes";
+
+        // Small segments exercise the multi-threaded subtree path
+        for (size_t segmentChunks : {1, 2, 4}) {
+            EXPECT_EQ(blake3Of(v.first, 4, segmentChunks), v.second) << v.first << " bytes, " << segmentChunks << " chunks/segment";
+        }
+    }
+}
+
+TEST(blake3, insideWorkQueueJobs) {
+    const size_t cores = std::thread::hardware_concurrency();
+
+    // A lone job gets the cores of the idle workers
+    OrderedWorkQueue<size_t> queue(2);
+    queue.push([]() { return Blake3Hash(0).concurrency(); });
+    EXPECT_EQ(queue.pop(), cores > 1 ? cores : 1);
+
+    // The result is the same however many threads hash it
+    OrderedWorkQueue<std::string> hashes(2);
+    hashes.push([]() { return blake3Of(3 * 1024 * 1024 + 5, 0, 4); });
+    EXPECT_EQ(hashes.pop(), blake3Of(3 * 1024 * 1024 + 5, 1, 4));
+}
+
+TEST(fileBLAKE3, largeFile) {
+    TestArea ta(TEST_NAME, true);
+    const auto file = ta.getFolder() / "large.bin";
+
+    // More than one default segment
+    std::string data(17 * 1024 * 1024 + 321, '\0');
+    std::mt19937 rng(11);
+    for (auto &c : data) c = static_cast<char>(rng());
+    {
+        std::ofstream f(file.string(), std::ios::binary);
+        f.write(data.data(), data.size());
+    }
+
+    Blake3Hash single(1);
+    single.add(data.data(), data.size());
+    const std::string expected = single.getHash();
+
+    EXPECT_EQ(Hash::fileBLAKE3(file.string(), 4), expected);
+
+    std::string sha256, blake3;
+    Hash::fileSHA256AndBLAKE3(file.string(), sha256, blake3, 4);
+    EXPECT_EQ(blake3, expected);
+    EXPECT_EQ(sha256, Hash::fileSHA256(file.string()));
+}
+
+}
@@ -0,0 +1,103 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "exceptions.h"
+#include "sqlite_database.h"
+#include "test.h"
+#include "testarea.h"
+#include "transactionbatch.h"
+
+namespace {
+
+using namespace ddb;
+
+int countRows(SqliteDatabase &db) {
+    auto q = db.query("SELECT COUNT(*) FROM t");
+    q->fetch();
+    return q->getInt(0);
+}
+
+TEST(transactionBatch, commitsEveryNRows) {
+    TestArea ta(TEST_NAME, true);
+    SqliteDatabase db;
+    db.open((ta.getFolder() / "batch.sqlite").string());
+    db.exec("CREATE TABLE t (v INTEGER)");
+
+    auto insertQ = db.query("INSERT INTO t (v) VALUES (?)");
+    TransactionBatch batch(&db, 10, 60000);
+
+    for (int i = 0; i < 25; i++) {
+        EXPECT_TRUE(batch.add([&insertQ, i]() {
+            insertQ->bind(1, i);
+            insertQ->execute();
+            return true;
+        }));
+    }
+
+    EXPECT_EQ(batch.pending(), 5);
+
+    // A second connection sees the committed batches only
+    SqliteDatabase reader;
+    reader.open((ta.getFolder() / "batch.sqlite").string());
+    EXPECT_EQ(countRows(reader), 20);
+
+    EXPECT_TRUE(batch.flush());
+    EXPECT_EQ(batch.pending(), 0);
+    EXPECT_EQ(countRows(reader), 25);
+}
+
+TEST(transactionBatch, cancel) {
+    TestArea ta(TEST_NAME, true);
+    SqliteDatabase db;
+    db.open((ta.getFolder() / "batch.sqlite").string());
+    db.exec("CREATE TABLE t (v INTEGER)");
+
+    auto insertQ = db.query("INSERT INTO t (v) VALUES (?)");
+    TransactionBatch batch(&db, 100, 60000);
+
+    for (int i = 0; i < 10; i++) {
+        batch.add([&insertQ, i]() {
+            insertQ->bind(1, i);
+            insertQ->execute();
+            return i < 3;
+        });
+    }
+
+    EXPECT_FALSE(batch.flush());
+    EXPECT_TRUE(batch.isCancelled());
+    EXPECT_FALSE(batch.add([]() { return true; }));
+
+    // Writes up to the cancelling one are kept
+    EXPECT_EQ(countRows(db), 4);
+}
+
+TEST(transactionBatch, rollbackOnError) {
+    TestArea ta(TEST_NAME, true);
+    SqliteDatabase db;
+    db.open((ta.getFolder() / "batch.sqlite").string());
+    db.exec("CREATE TABLE t (v INTEGER)");
+
+    auto insertQ = db.query("INSERT INTO t (v) VALUES (?)");
+    TransactionBatch batch(&db, 2, 60000);
+
+    auto write = [&insertQ](int v) {
+        return [&insertQ, v]() {
+            if (v < 0) throw DBException("Invalid value");
+            insertQ->bind(1, v);
+            insertQ->execute();
+            return true;
+        };
+    };
+
+    batch.add(write(1));
+    batch.add(write(2));
+    batch.add(write(3));
+    EXPECT_THROW(batch.add(write(-1)), DBException);
+
+    // The first batch stays committed, the failed one is rolled back
+    EXPECT_EQ(countRows(db), 2);
+}
+
+}
@@ -0,0 +1,150 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <fstream>
+#include <set>
+#include <unordered_map>
+#include "gtest/gtest.h"
+#include "exceptions.h"
+#include "test.h"
+#include "testarea.h"
+#include "walker.h"
+
+namespace {
+
+using namespace ddb;
+
+// Creates a tree with fanout subfolders per level and a few files in each
+fs::path makeTree(TestArea &ta, int levels, int fanout) {
+    const fs::path root = ta.getFolder("tree");
+    std::vector<fs::path> current = {root};
+
+    for (int l = 0; l < levels; l++) {
+        std::vector<fs::path> next;
+        for (const auto &d : current) {
+            for (int i = 0; i < 3; i++) {
+                std::ofstream f((d / ("file" + std::to_string(i) + ".txt")).string());
+                f << std::string(static_cast<size_t>(i * 10), 'x');
+            }
+            for (int i = 0; i < fanout; i++) {
+                const auto sub = d / ("dir" + std::to_string(i));
+                fs::create_directory(sub);
+                next.push_back(sub);
+            }
+        }
+        current = next;
+    }
+
+    return root;
+}
+
+TEST(directoryWalker, matchesRecursiveIterator) {
+    TestArea ta(TEST_NAME, true);
+    const auto root = makeTree(ta, 4, 3);
+
+    std::set<std::string> expected;
+    for (auto i = fs::recursive_directory_iterator(root); i != fs::recursive_directory_iterator(); ++i)
+        expected.insert(i->path().string());
+
+    std::set<std::string> walked;
+    std::unordered_map<std::string, size_t> position;
+    DirectoryWalker walker(root);
+    WalkEntry e;
+    while (walker.next(e)) {
+        EXPECT_TRUE(walked.insert(e.path.string()).second) << "Duplicate " << e.path;
+        position[e.path.string()] = position.size();
+
+        EXPECT_EQ(e.directory, fs::is_directory(e.path));
+        if (!e.directory) {
+            EXPECT_EQ(e.size, fs::file_size(e.path));
+        }
+
+        // Parents come first
+        if (e.path.parent_path() != root) {
+            EXPECT_EQ(position.count(e.path.parent_path().string()), 1) << e.path;
+        }
+
+        const fs::path rel = e.path.lexically_relative(root);
+        EXPECT_EQ(e.depth, static_cast<int>(std::distance(rel.begin(), rel.end())) - 1);
+    }
+
+    EXPECT_EQ(walked, expected);
+}
+
+TEST(directoryWalker, maxDepth) {
+    TestArea ta(TEST_NAME, true);
+    const auto root = makeTree(ta, 3, 2);
+
+    auto count = [&root](int maxDepth) {
+        DirectoryWalker walker(root, maxDepth, 2);
+        WalkEntry e;
+        int maxSeen = -1;
+        int n = 0;
+        while (walker.next(e)) {
+            maxSeen = std::max(maxSeen, e.depth);
+            n++;
+        }
+        return std::make_pair(n, maxSeen);
+    };
+
+    // 3 files + 2 dirs at the first level
+    EXPECT_EQ(count(1), std::make_pair(5, 0));
+    EXPECT_EQ(count(-1), std::make_pair(5, 0));
+    EXPECT_EQ(count(2), std::make_pair(15, 1));
+    EXPECT_EQ(count(0), count(10));
+}
+
+TEST(directoryWalker, skipsDdbFolder) {
+    TestArea ta(TEST_NAME, true);
+    const auto root = ta.getFolder("tree");
+    fs::create_directories(root / ".ddb" / "build");
+    std::ofstream((root / "a.txt").string()) << "a";
+
+    std::set<std::string> walked;
+    DirectoryWalker walker(root);
+    WalkEntry e;
+    while (walker.next(e)) walked.insert(e.path.filename().string());
+
+    EXPECT_EQ(walked, std::set<std::string>({".ddb", "a.txt"}));
+}
+
+TEST(directoryWalker, missingRoot) {
+    TestArea ta(TEST_NAME, true);
+    DirectoryWalker walker(ta.getFolder() / "missing");
+    WalkEntry e;
+    EXPECT_THROW(walker.next(e), FSException);
+}
+
+TEST(directoryWalker, sameOrderEveryTime) {
+    TestArea ta(TEST_NAME, true);
+    const auto root = makeTree(ta, 4, 3);
+
+    auto walk = [&root](int threads) {
+        std::vector<std::string> paths;
+        DirectoryWalker walker(root, 0, threads);
+        WalkEntry e;
+        while (walker.next(e)) paths.push_back(e.path.lexically_relative(root).generic_string());
+        return paths;
+    };
+
+    const auto expected = walk(1);
+    for (int i = 0; i < 5; i++) EXPECT_EQ(walk(8), expected);
+
+    // Breadth first, sorted by name within a folder
+    ASSERT_GE(expected.size(), 7);
+    EXPECT_EQ(std::vector<std::string>(expected.begin(), expected.begin() + 7),
+              std::vector<std::string>({"dir0", "dir1", "dir2", "file0.txt", "file1.txt", "file2.txt", "dir0/dir0"}));
+}
+
+TEST(directoryWalker, stopEarly) {
+    TestArea ta(TEST_NAME, true);
+    const auto root = makeTree(ta, 5, 3);
+
+    // Destroying the walker mid-way must not hang
+    DirectoryWalker walker(root, 0, 4);
+    WalkEntry e;
+    EXPECT_TRUE(walker.next(e));
+}
+
+}
@@ -0,0 +1,159 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "dbops.h"
+#include "test.h"
+#include "testarea.h"
+#include "watcher.h"
+
+namespace {
+
+using namespace ddb;
+
+#ifdef __linux__
+
+TEST(datasetWatcher, indexesQuietFiles) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    std::ofstream((testFolder / "deleted.txt").string()) << "deleted";
+    addToIndex(db.get(), {(testFolder / "deleted.txt").string()});
+
+    DatasetWatcher watcher(db.get(), 200, 1);
+
+    std::vector<std::pair<std::string, WatchAction>> changes;
+    std::thread t([&watcher, &changes]() {
+        watcher.run([&changes](const std::string &path, WatchAction action) {
+            changes.push_back({path, action});
+            return changes.size() < 3;
+        });
+    });
+
+    // Deletes are processed before additions
+    fs::remove(testFolder / "deleted.txt");
+
+    // A burst of writes is indexed once
+    for (int i = 0; i < 5; i++) {
+        std::ofstream f((testFolder / "a.txt").string(), std::ios::app);
+        f << "line " << i << std::endl;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    fs::create_directories(testFolder / "dir");
+    std::ofstream((testFolder / "dir" / "b.txt").string()) << "b";
+
+    t.join();
+
+    const std::vector<std::pair<std::string, WatchAction>> expected = {
+        {"a.txt", WatchAdded},
+        {"deleted.txt", WatchDeleted},
+        {"dir", WatchAdded},
+        {"dir/b.txt", WatchAdded}
+    };
+
+    // The callback stops the watcher at the third change,
+    // which ones come first depends on timing
+    ASSERT_GE(changes.size(), 3);
+    for (const auto &c : changes) {
+        EXPECT_NE(std::find(expected.begin(), expected.end(), c), expected.end()) << c.first;
+    }
+
+    Entry e;
+    EXPECT_FALSE(getEntry(db.get(), "deleted.txt", e));
+}
+
+TEST(datasetWatcher, literalDeletes) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    for (const auto &p : {"a*.txt", "ab.txt", "a*/c.txt", "ab/d.txt"}) {
+        fs::create_directories((testFolder / p).parent_path());
+        std::ofstream((testFolder / p).string()) << p;
+    }
+    addToIndex(db.get(), {(testFolder / "a*.txt").string(), (testFolder / "ab.txt").string(),
+                          (testFolder / "a*").string(), (testFolder / "ab").string()});
+
+    DatasetWatcher watcher(db.get(), 200, 1);
+
+    std::vector<std::string> deleted;
+    std::thread t([&watcher, &deleted]() {
+        watcher.run([&deleted](const std::string &path, WatchAction action) {
+            if (action == WatchDeleted) deleted.push_back(path);
+            return deleted.size() < 3;
+        });
+    });
+
+    fs::remove(testFolder / "a*.txt");
+    fs::remove_all(testFolder / "a*");
+
+    t.join();
+
+    std::sort(deleted.begin(), deleted.end());
+    EXPECT_EQ(deleted, std::vector<std::string>({"a*", "a*.txt", "a*/c.txt"}));
+
+    Entry e;
+    EXPECT_TRUE(getEntry(db.get(), "ab.txt", e));
+    EXPECT_TRUE(getEntry(db.get(), "ab/d.txt", e));
+}
+
+TEST(datasetWatcher, unreadableFiles) {
+    // Root reads files whatever their permissions
+    if (geteuid() == 0) GTEST_SKIP() << "Needs a user that permissions apply to";
+
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    DatasetWatcher watcher(db.get(), 100, 1);
+
+    std::vector<std::string> added;
+    std::thread t([&watcher, &added]() {
+        watcher.run([&added](const std::string &path, WatchAction) {
+            added.push_back(path);
+            return true;
+        });
+    });
+
+    const auto bad = testFolder / "bad.txt";
+    std::ofstream(bad.string()) << "bad";
+    fs::permissions(bad, fs::perms::none);
+    std::ofstream((testFolder / "good.txt").string()) << "good";
+
+    // Long enough for every try
+    std::this_thread::sleep_for(std::chrono::milliseconds(100 * (WATCH_MAX_FAILURES + 5)));
+    watcher.stop();
+    t.join();
+    fs::permissions(bad, fs::perms::owner_all);
+
+    // The readable file is indexed once, the other one is given up on
+    EXPECT_EQ(added, std::vector<std::string>({"good.txt"}));
+    Entry e;
+    EXPECT_FALSE(getEntry(db.get(), "bad.txt", e));
+}
+
+TEST(datasetWatcher, stop) {
+    TestArea ta(TEST_NAME, true);
+    const auto testFolder = ta.getFolder("test");
+    initIndex(testFolder.string());
+    auto db = ddb::open(testFolder.string(), false);
+
+    DatasetWatcher watcher(db.get());
+    std::thread t([&watcher]() { watcher.run(); });
+    watcher.stop();
+    t.join();
+}
+
+#endif
+
+}
@@ -0,0 +1,72 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+#include "gtest/gtest.h"
+#include "exceptions.h"
+#include "workqueue.h"
+
+namespace {
+
+using namespace ddb;
+
+TEST(orderedWorkQueue, preservesOrder) {
+    OrderedWorkQueue<int> queue(8);
+
+    for (int i = 0; i < 200; i++) {
+        queue.push([i]() {
+            // Make later jobs finish first
+            std::this_thread::sleep_for(std::chrono::microseconds((200 - i) % 7 * 100));
+            return i;
+        });
+    }
+
+    EXPECT_EQ(queue.pending(), 200);
+    for (int i = 0; i < 200; i++) EXPECT_EQ(queue.pop(), i);
+    EXPECT_EQ(queue.pending(), 0);
+}
+
+TEST(orderedWorkQueue, singleThread) {
+    OrderedWorkQueue<int> queue(1);
+    EXPECT_EQ(queue.concurrency(), 1);
+
+    queue.push([]() { return 1; });
+    queue.push([]() { return 2; });
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_EQ(queue.pop(), 2);
+}
+
+TEST(orderedWorkQueue, workerThreads) {
+    EXPECT_FALSE(isWorkerThread());
+
+    OrderedWorkQueue<bool> queue(4);
+    queue.push([]() { return isWorkerThread(); });
+    EXPECT_TRUE(queue.pop());
+
+    // Inline jobs run on the caller's thread
+    OrderedWorkQueue<bool> inlineQueue(1);
+    inlineQueue.push([]() { return isWorkerThread(); });
+    EXPECT_FALSE(inlineQueue.pop());
+}
+
+TEST(orderedWorkQueue, busyWorkerThreads) {
+    EXPECT_EQ(busyWorkerThreads(), 0);
+
+    OrderedWorkQueue<int> queue(4);
+    queue.push([]() { return busyWorkerThreads(); });
+    EXPECT_EQ(queue.pop(), 1);
+}
+
+TEST(orderedWorkQueue, rethrows) {
+    OrderedWorkQueue<int> queue(4);
+
+    queue.push([]() { return 1; });
+    queue.push([]() -> int { throw FSException("boom"); });
+    queue.push([]() { return 3; });
+
+    EXPECT_EQ(queue.pop(), 1);
+    EXPECT_THROW(queue.pop(), FSException);
+    EXPECT_EQ(queue.pop(), 3);
+}
+
+}